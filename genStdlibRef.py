@@ -164,6 +164,11 @@ def genLineFunction(file, symbol, comments, funcName, isDefine, doWrapLine = Tru
 	if symbol["isNoDiscard"]:
 		line += " nodiscard"
 
+	if symbol["isInline"]:
+		line += " inline"
+	elif symbol["isNoInline"]:
+		line += " noinline"
+
 	if not isDefine:
 		line += " ..."
 
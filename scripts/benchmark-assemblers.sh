@@ -0,0 +1,22 @@
+#!/bin/bash
+
+# Compiles the largest programs with every assembler/backend and prints the time spent assembling and linking
+
+./scripts/build.sh Release
+
+QINP=./bin/Release/qinp
+PROGRAMS="examples/gameoflife.qnp tests/ir-lowering.qnp tests/inlining.qnp"
+CONFIGS="--assembler=nasm --assembler=gas --backend=elf"
+RUNS=5
+
+for program in ${PROGRAMS}; do
+    echo "${program} ($(${QINP} -k -o=/tmp/qinp-benchmark.out ${program} >/dev/null && wc -c < ${program%.qnp}.asm) bytes of assembly)"
+    rm -f ${program%.qnp}.asm
+
+    for config in ${CONFIGS}; do
+        # Best of ${RUNS}, the phase times are printed as ' DONE: <seconds>s' after 'Assembling...'/'Linking...'
+        for run in $(seq ${RUNS}); do
+            ${QINP} -v ${config} -o=/tmp/qinp-benchmark.out ${program} | grep -A1 -E "^(Assembling|Linking)" | grep DONE | tr -d 'DONE:s ' | paste -sd' '
+        done | sort -n | head -n 1 | awk -v config="${config}" '{ printf "  %-18s assemble: %.2fms link: %.2fms\n", config, $1 * 1000, $2 * 1000 }'
+    done
+done
@@ -0,0 +1,43 @@
+#!/bin/bash
+
+# Generates a program with 10000 functions and prints the time spent generating assembly with 1 to 16 threads
+# (the elf backend keeps the remaining phases short)
+
+./scripts/build.sh Release
+
+QINP=./bin/Release/qinp
+PROGRAM=/tmp/qinp-benchmark-functions.qnp
+N_FUNCTIONS=10000
+JOBS="1 2 4 8 16"
+RUNS=3
+
+{
+    echo 'import "stdio.qnp"'
+    echo
+    echo 'fn<u64> f0(u64 x) nodiscard:'
+    echo '    return x'
+    for i in $(seq 1 $((N_FUNCTIONS - 1))); do
+        echo
+        echo "fn<u64> f${i}(u64 x) nodiscard:"
+        echo '    var<u64> sum = 0'
+        echo '    var<u64> i = 0'
+        echo '    while i < x:'
+        echo "        if i % ${i} == 0:"
+        echo '            sum += i * 3'
+        echo '        else:'
+        echo '            sum ^= i'
+        echo '        ++i'
+        echo "    return sum + f$((i - 1))(x / 2)"
+    done
+    echo
+    echo "std.println(f$((N_FUNCTIONS - 1))(100))"
+} > ${PROGRAM}
+
+for jobs in ${JOBS}; do
+    # Best of ${RUNS}, the phase time is printed as ' DONE: <seconds>s' after 'Generating assembly...'
+    for run in $(seq ${RUNS}); do
+        ${QINP} -v -j=${jobs} --backend=elf -o=/tmp/qinp-benchmark.out ${PROGRAM} | grep -A1 "^Generating assembly" | grep DONE | tr -d 'DONE:s '
+    done | sort -n | head -n 1 | awk -v jobs="${jobs}" '{ printf "  -j=%-3s %.2fms\n", jobs, $1 * 1000 }'
+done
+
+rm -f ${PROGRAM}
@@ -0,0 +1,34 @@
+#!/bin/bash
+
+# Generates a program printing many string literals and prints the size of the assembly
+# and the time spent assembling it with every assembler/backend
+
+./scripts/build.sh Release
+
+QINP=./bin/Release/qinp
+PROGRAM=/tmp/qinp-benchmark-strings.qnp
+N_LINES=20000
+CONFIGS="--assembler=nasm --assembler=gas --backend=elf"
+RUNS=5
+
+{
+    echo 'import "stdio.qnp"'
+    echo
+    for i in $(seq 1 ${N_LINES}); do
+        echo "std.print(\"Line ${i}: The quick brown fox jumps over the lazy dog.\\n\")"
+        echo "std.print(\"dog.\\n\")"
+    done
+} > ${PROGRAM}
+
+${QINP} -k -o=/tmp/qinp-benchmark.out ${PROGRAM} >/dev/null
+echo "${PROGRAM} ($(wc -c < ${PROGRAM%.qnp}.asm) bytes of assembly)"
+rm -f ${PROGRAM%.qnp}.asm
+
+for config in ${CONFIGS}; do
+    # Best of ${RUNS}, the phase time is printed as ' DONE: <seconds>s' after 'Assembling...'
+    for run in $(seq ${RUNS}); do
+        ${QINP} -v ${config} -o=/tmp/qinp-benchmark.out ${PROGRAM} | grep -A1 "^Assembling" | grep DONE | tr -d 'DONE:s '
+    done | sort -n | head -n 1 | awk -v config="${config}" '{ printf "  %-18s %.2fms\n", config, $1 * 1000 }'
+done
+
+rm -f ${PROGRAM}
@@ -0,0 +1,19 @@
+#!/bin/bash
+
+# Runs the benchmarks with every optimization level and prints the cycles per iteration
+
+./scripts/build.sh Release
+
+QINP=./bin/Release/QINP
+OPT_LEVELS="0 1"
+
+for benchmark in benchmarks/*.qnp; do
+    if [ "$(basename ${benchmark})" = "cycles.qnp" ]; then
+        continue
+    fi
+
+    for level in ${OPT_LEVELS}; do
+        echo -n "-O=${level} "
+        ${QINP} -O=${level} -r -o=/tmp/qinp-benchmark.out ${benchmark} | head -n 1
+    done
+done
@@ -0,0 +1,20 @@
+#!/bin/bash
+
+# Prints the section sizes of the compiled tests, examples and benchmarks and their sum
+# (compare the output of two revisions to see the effect of a change on the binary size)
+
+./scripts/build.sh Release
+
+QINP=./bin/Release/qinp
+PROGRAMS="tests/*.qnp examples/*.qnp benchmarks/*.qnp"
+CONFIG=${1:---backend=elf}
+
+for program in ${PROGRAMS}; do
+    ${QINP} ${CONFIG} -o=/tmp/qinp-sizes.out ${program} >/dev/null 2>&1 || continue
+    size -A /tmp/qinp-sizes.out | awk -v program="${program}" -v file="$(stat -c %s /tmp/qinp-sizes.out)" \
+        '$1 == ".text" { text = $2 } $1 == ".rodata" { rodata = $2 } $1 == ".data" { data = $2 } $1 == ".bss" { bss = $2 }
+        END { printf "%-50s %8d %8d %8d %8d %8d\n", program, text, rodata, data, bss, file }'
+done | awk '{ print } { for (i = 2; i <= 6; ++i) sum[i] += $i }
+    END { printf "%-50s %8d %8d %8d %8d %8d\n", "total (.text .rodata .data .bss file)", sum[2], sum[3], sum[4], sum[5], sum[6] }'
+
+rm -f /tmp/qinp-sizes.out
@@ -0,0 +1,55 @@
+#include "AsmBuffer.h"
+
+#include <algorithm>
+
+AsmBuffer& AsmBuffer::operator<<(std::string_view str)
+{
+	if (m_chunks.empty() || m_chunks.back().size() + str.size() > m_chunks.back().capacity())
+	{
+		size_t capacity = m_chunks.empty() ? ASM_BUFFER_FIRST_CHUNK_SIZE : std::min<size_t>(ASM_BUFFER_MAX_CHUNK_SIZE, 2 * m_chunks.back().capacity());
+		m_chunks.emplace_back();
+		m_chunks.back().reserve(std::max(capacity, str.size()));
+	}
+	m_chunks.back().append(str);
+	return *this;
+}
+
+AsmBuffer& AsmBuffer::operator<<(char c)
+{
+	return *this << std::string_view(&c, 1);
+}
+
+std::string AsmBuffer::str() const
+{
+	if (m_chunks.size() == 1)
+		return m_chunks.front();
+
+	size_t size = 0;
+	for (auto& chunk : m_chunks)
+		size += chunk.size();
+
+	std::string text;
+	text.reserve(size);
+	for (auto& chunk : m_chunks)
+		text += chunk;
+	return text;
+}
+
+std::string AsmBuffer::release()
+{
+	std::string text = m_chunks.size() == 1 ? std::move(m_chunks.front()) : str();
+	clear();
+	return text;
+}
+
+void AsmBuffer::clear()
+{
+	m_chunks.clear();
+}
+
+std::string hexString(uint64_t val)
+{
+	char buf[2 + 16] = { '0', 'x' };
+	auto result = std::to_chars(buf + 2, buf + sizeof(buf), val, 16);
+	return std::string(buf, result.ptr - buf);
+}
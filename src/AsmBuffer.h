@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <charconv>
+#include <string_view>
+#include <type_traits>
+
+#define ASM_BUFFER_FIRST_CHUNK_SIZE 1024
+#define ASM_BUFFER_MAX_CHUNK_SIZE 65536
+
+// Append-only text buffer for the generated assembly.
+// The text is written into preallocated chunks, so appending never copies the text written before.
+// The chunk size doubles up to the maximum, so small buffers (e.g. of a single function) stay small.
+// Integers are formatted with std::to_chars.
+class AsmBuffer
+{
+public:
+	AsmBuffer& operator<<(std::string_view str);
+	AsmBuffer& operator<<(const char* str) { return *this << std::string_view(str); }
+	AsmBuffer& operator<<(char c);
+	// Would be converted to char silently
+	AsmBuffer& operator<<(bool) = delete;
+	AsmBuffer& operator<<(signed char) = delete;
+	AsmBuffer& operator<<(unsigned char) = delete;
+	AsmBuffer& operator<<(double) = delete;
+
+	template <typename T, typename = std::enable_if_t<std::is_integral_v<T> && (sizeof(T) > 1)>>
+	AsmBuffer& operator<<(T value)
+	{
+		char buf[24];
+		auto result = std::to_chars(buf, buf + sizeof(buf), value);
+		return *this << std::string_view(buf, result.ptr - buf);
+	}
+
+	// Returns the complete text
+	std::string str() const;
+	// Returns the complete text and clears the buffer, avoids copying the text if it fits into a single chunk
+	std::string release();
+	void clear();
+private:
+	std::vector<std::string> m_chunks;
+};
+
+// Formats the value as hexadecimal number with '0x' prefix (lowercase digits)
+std::string hexString(uint64_t val);
@@ -0,0 +1,228 @@
+#include "CompileServer.h"
+
+#include "Errors/QinpError.h"
+
+#if defined QINP_PLATFORM_UNIX
+
+#include <iostream>
+#include <sstream>
+#include <filesystem>
+#include <cstring>
+#include <csignal>
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "TokenCache.h"
+
+// Protocol (all integers in host byte order):
+//   Request: u32 count, <count> strings (working directory followed by the commandline arguments)
+//   Reply:   i32 exit code, string output filename, string output
+//   String:  u32 length, <length> bytes
+
+void writeAll(int fd, const void* data, size_t size)
+{
+	auto ptr = (const char*)data;
+	while (size > 0)
+	{
+		auto n = write(fd, ptr, size);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			THROW_QINP_ERROR("Failed to write to socket!");
+		ptr += n;
+		size -= n;
+	}
+}
+
+void readAll(int fd, void* data, size_t size)
+{
+	auto ptr = (char*)data;
+	while (size > 0)
+	{
+		auto n = read(fd, ptr, size);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			THROW_QINP_ERROR("Failed to read from socket!");
+		ptr += n;
+		size -= n;
+	}
+}
+
+void sendString(int fd, const std::string& str)
+{
+	uint32_t size = str.size();
+	writeAll(fd, &size, sizeof(size));
+	writeAll(fd, str.data(), str.size());
+}
+
+std::string recvString(int fd)
+{
+	uint32_t size;
+	readAll(fd, &size, sizeof(size));
+	std::string str(size, '\0');
+	readAll(fd, str.data(), size);
+	return str;
+}
+
+sockaddr_un makeSocketAddress(const std::string& socketPath)
+{
+	sockaddr_un addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (socketPath.size() >= sizeof(addr.sun_path))
+		THROW_QINP_ERROR("Socket path '" + socketPath + "' is too long!");
+	std::strcpy(addr.sun_path, socketPath.c_str());
+	return addr;
+}
+
+void handleCompileRequest(int connFd, CompileFunc compile)
+{
+	uint32_t count;
+	readAll(connFd, &count, sizeof(count));
+	if (count == 0)
+		THROW_QINP_ERROR("Received invalid compilation request!");
+
+	std::vector<std::string> args;
+	for (uint32_t i = 0; i < count; ++i)
+		args.push_back(recvString(connFd));
+
+	CompileReply reply;
+	std::stringstream output;
+	auto coutBuf = std::cout.rdbuf(output.rdbuf());
+	try
+	{
+		std::filesystem::current_path(args.front());
+		args.erase(args.begin());
+		reply.exitCode = compile(args, reply.outFilename);
+	}
+	catch (const std::exception& e)
+	{
+		std::cout << "[ ERR ]: STD: " << e.what() << std::endl;
+		reply.exitCode = -1;
+	}
+	std::cout.rdbuf(coutBuf);
+	reply.output = output.str();
+
+	int32_t exitCode = reply.exitCode;
+	writeAll(connFd, &exitCode, sizeof(exitCode));
+	sendString(connFd, reply.outFilename);
+	sendString(connFd, reply.output);
+}
+
+int runCompileServer(const std::string& socketPath, CompileFunc compile)
+{
+	auto addr = makeSocketAddress(socketPath);
+
+	int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listenFd == -1)
+		THROW_QINP_ERROR("Failed to create socket!");
+
+	unlink(socketPath.c_str()); // Remove the socket of a previous server
+	if (bind(listenFd, (sockaddr*)&addr, sizeof(addr)) == -1)
+		THROW_QINP_ERROR("Failed to bind socket '" + socketPath + "'!");
+	if (listen(listenFd, SOMAXCONN) == -1)
+		THROW_QINP_ERROR("Failed to listen on socket '" + socketPath + "'!");
+
+	signal(SIGCHLD, SIG_IGN); // Finished workers get reaped automatically
+
+	std::cout << "Listening on '" << socketPath << "'..." << std::endl;
+
+	while (true)
+	{
+		int connFd = accept(listenFd, nullptr, nullptr);
+		if (connFd == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			THROW_QINP_ERROR("Failed to accept connection!");
+		}
+
+		// Keep the shared state warm, every worker checks its files again anyways
+		refreshTokenCache();
+
+		std::cout.flush();
+		pid_t p = fork();
+		if (p == -1)
+		{
+			close(connFd);
+			THROW_QINP_ERROR("Fork failed!");
+		}
+
+		if (p == 0)
+		{
+			close(listenFd);
+			signal(SIGCHLD, SIG_DFL); // Required by execCmd
+			int ret = 0;
+			try
+			{
+				handleCompileRequest(connFd, compile);
+			}
+			catch (const QinpError& e)
+			{
+				std::cout << "[ ERR ]: QNP: " << e.what() << std::endl;
+				ret = -1;
+			}
+			close(connFd);
+			std::cout.flush();
+			_exit(ret);
+		}
+
+		close(connFd);
+	}
+}
+
+CompileReply requestCompilation(const std::string& socketPath, const std::vector<std::string>& args)
+{
+	auto addr = makeSocketAddress(socketPath);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1)
+		THROW_QINP_ERROR("Failed to create socket!");
+	if (connect(fd, (sockaddr*)&addr, sizeof(addr)) == -1)
+	{
+		close(fd);
+		THROW_QINP_ERROR("Failed to connect to compile server at '" + socketPath + "'!");
+	}
+
+	CompileReply reply;
+	try
+	{
+		uint32_t count = args.size() + 1;
+		writeAll(fd, &count, sizeof(count));
+		sendString(fd, std::filesystem::current_path().string());
+		for (auto& arg : args)
+			sendString(fd, arg);
+
+		int32_t exitCode;
+		readAll(fd, &exitCode, sizeof(exitCode));
+		reply.exitCode = exitCode;
+		reply.outFilename = recvString(fd);
+		reply.output = recvString(fd);
+	}
+	catch (...)
+	{
+		close(fd);
+		throw;
+	}
+	close(fd);
+
+	return reply;
+}
+
+#else
+
+int runCompileServer(const std::string& socketPath, CompileFunc compile)
+{
+	THROW_QINP_ERROR("The compile server is not supported on this platform!");
+}
+
+CompileReply requestCompilation(const std::string& socketPath, const std::vector<std::string>& args)
+{
+	THROW_QINP_ERROR("The compile server is not supported on this platform!");
+}
+
+#endif
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+
+struct CompileReply
+{
+	int exitCode;
+	std::string outFilename;
+	std::string output;
+};
+
+// Compiles the program described by the commandline arguments. Returns the exit code and sets the output filename.
+typedef std::function<int(const std::vector<std::string>& args, std::string& outFilename)> CompileFunc;
+
+// Listens on the specified unix socket and handles every compilation request in a forked worker process.
+// The workers share the state of the server (e.g. the token cache) copy-on-write.
+int runCompileServer(const std::string& socketPath, CompileFunc compile);
+
+// Sends the commandline arguments to the compile server listening on the specified unix socket
+// and waits for the compilation to finish.
+CompileReply requestCompilation(const std::string& socketPath, const std::vector<std::string>& args);
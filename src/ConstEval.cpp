@@ -0,0 +1,545 @@
+#include "ConstEval.h"
+
+#define CONST_EVAL_STEP_BUDGET 1000000
+#define CONST_EVAL_MAX_CALL_DEPTH 256
+
+int getConstBitWidth(const Datatype& datatype)
+{
+	int size = getBuiltinTypeSize(datatype.name);
+	if (isOfType(datatype, DTType::Name) && size > 0)
+		return size * 8;
+	return 64;
+}
+
+uint64_t truncateConst(uint64_t value, const Datatype& datatype)
+{
+	int width = getConstBitWidth(datatype);
+	if (width >= 64)
+		return value;
+	return value & ((uint64_t(1) << width) - 1);
+}
+
+int64_t signExtendConst(uint64_t value, int width)
+{
+	if (width >= 64)
+		return (int64_t)value;
+	uint64_t signBit = uint64_t(1) << (width - 1);
+	value &= (signBit << 1) - 1;
+	return (int64_t)((value ^ signBit) - signBit);
+}
+
+bool isConstFoldable(const Datatype& datatype)
+{
+	if (isInteger(datatype) || isBool(datatype))
+		return true;
+
+	// Remaining named non-builtin types of literals are enums
+	return
+		isOfType(datatype, DTType::Name) &&
+		getBuiltinTypeSize(datatype.name) < 0 &&
+		!isNull(datatype);
+}
+
+bool evalConstUnary(Expression::ExprType eType, const Datatype& datatype, uint64_t operand, uint64_t& result)
+{
+	switch (eType)
+	{
+	case Expression::ExprType::Logical_NOT:
+		result = operand == 0;
+		return true;
+	case Expression::ExprType::Bitwise_NOT:
+		result = truncateConst(~operand, datatype);
+		return true;
+	case Expression::ExprType::Prefix_Plus:
+		result = truncateConst(operand, datatype);
+		return true;
+	case Expression::ExprType::Prefix_Minus:
+		result = truncateConst(-operand, datatype);
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool evalConstBinary(Expression::ExprType eType, const Datatype& operandType, uint64_t left, uint64_t right, uint64_t& result)
+{
+	int width = getConstBitWidth(operandType);
+	left = truncateConst(left, operandType);
+	right = truncateConst(right, operandType);
+
+	switch (eType)
+	{
+	case Expression::ExprType::Logical_OR:
+		result = left || right;
+		return true;
+	case Expression::ExprType::Logical_AND:
+		result = left && right;
+		return true;
+	case Expression::ExprType::Bitwise_OR:
+		result = left | right;
+		return true;
+	case Expression::ExprType::Bitwise_XOR:
+		result = left ^ right;
+		return true;
+	case Expression::ExprType::Bitwise_AND:
+		result = left & right;
+		return true;
+	case Expression::ExprType::Comparison_Equal:
+		result = left == right;
+		return true;
+	case Expression::ExprType::Comparison_NotEqual:
+		result = left != right;
+		return true;
+	// The generated code uses the signed condition codes (setl, setg, ...) for every operand type
+	case Expression::ExprType::Comparison_Less:
+		result = signExtendConst(left, width) < signExtendConst(right, width);
+		return true;
+	case Expression::ExprType::Comparison_LessEqual:
+		result = signExtendConst(left, width) <= signExtendConst(right, width);
+		return true;
+	case Expression::ExprType::Comparison_Greater:
+		result = signExtendConst(left, width) > signExtendConst(right, width);
+		return true;
+	case Expression::ExprType::Comparison_GreaterEqual:
+		result = signExtendConst(left, width) >= signExtendConst(right, width);
+		return true;
+	// Shifts are logical and the count is masked like the 'shl'/'shr' instructions do
+	case Expression::ExprType::Shift_Left:
+	case Expression::ExprType::Shift_Right:
+	{
+		uint64_t count = right & (width == 64 ? 63 : 31);
+		if (count >= (uint64_t)width)
+			result = 0;
+		else if (eType == Expression::ExprType::Shift_Left)
+			result = truncateConst(left << count, operandType);
+		else
+			result = left >> count;
+	}
+		return true;
+	case Expression::ExprType::Sum:
+		result = truncateConst(left + right, operandType);
+		return true;
+	case Expression::ExprType::Difference:
+		result = truncateConst(left - right, operandType);
+		return true;
+	case Expression::ExprType::Product:
+		result = truncateConst(left * right, operandType);
+		return true;
+	case Expression::ExprType::Quotient:
+	case Expression::ExprType::Remainder:
+	{
+		if (right == 0)
+			return false;
+
+		bool isQuotient = eType == Expression::ExprType::Quotient;
+		if (!isSignedInt(operandType))
+		{
+			result = isQuotient ? left / right : left % right;
+			return true;
+		}
+
+		int64_t sLeft = signExtendConst(left, width);
+		int64_t sRight = signExtendConst(right, width);
+		// The smallest value divided by -1 overflows (the division traps at runtime)
+		if (sRight == -1 && sLeft == signExtendConst((uint64_t)1 << (width - 1), width))
+			return false;
+		result = truncateConst(uint64_t(isQuotient ? sLeft / sRight : sLeft % sRight), operandType);
+	}
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool evalConstConversion(const Datatype& oldType, const Datatype& newType, uint64_t value, uint64_t& result)
+{
+	if (!isConstFoldable(newType))
+		return false;
+
+	if (isNull(oldType))
+	{
+		result = 0;
+		return true;
+	}
+
+	if (!isConstFoldable(oldType))
+		return false;
+
+	value = truncateConst(value, oldType);
+
+	if (isBool(newType))
+		result = value != 0;
+	else if (isSignedInt(oldType) && isInteger(newType))
+		result = truncateConst(uint64_t(signExtendConst(value, getConstBitWidth(oldType))), newType);
+	else
+		result = truncateConst(value, newType);
+
+	return true;
+}
+
+struct ConstCallFrame
+{
+	std::map<const Symbol*, uint64_t> vars; // Parameters & local variables -> value
+	uint64_t retValue = 0;
+};
+
+enum class ConstExecState
+{
+	Normal,
+	Return,
+	Break,
+	Continue,
+	Unsupported,
+};
+
+bool isConstEvaluable(ConstEvalInfo& cei, const Datatype& datatype)
+{
+	return isInteger(datatype) || isBool(datatype) || isEnum(cei.program, datatype);
+}
+
+bool evalConstCall(ConstEvalInfo& cei, SymbolRef func, const std::vector<uint64_t>& args, uint64_t& result);
+
+// Returns the variable the expression refers to if it can be held by the call frame.
+const Symbol* getConstFrameVariable(ConstEvalInfo& cei, const Expression* expr)
+{
+	if (expr->eType != Expression::ExprType::Symbol || !expr->symbol)
+		return nullptr;
+	if (!isVarLocal(expr->symbol) && !isVarParameter(expr->symbol))
+		return nullptr;
+	if (!isConstEvaluable(cei, expr->symbol->var.datatype))
+		return nullptr;
+	return expr->symbol.get();
+}
+
+bool getCompoundAssignOperator(Expression::ExprType eType, Expression::ExprType& op)
+{
+	switch (eType)
+	{
+	case Expression::ExprType::Assign_Sum: op = Expression::ExprType::Sum; return true;
+	case Expression::ExprType::Assign_Difference: op = Expression::ExprType::Difference; return true;
+	case Expression::ExprType::Assign_Product: op = Expression::ExprType::Product; return true;
+	case Expression::ExprType::Assign_Quotient: op = Expression::ExprType::Quotient; return true;
+	case Expression::ExprType::Assign_Remainder: op = Expression::ExprType::Remainder; return true;
+	case Expression::ExprType::Assign_Bw_LeftShift: op = Expression::ExprType::Shift_Left; return true;
+	case Expression::ExprType::Assign_Bw_RightShift: op = Expression::ExprType::Shift_Right; return true;
+	case Expression::ExprType::Assign_Bw_AND: op = Expression::ExprType::Bitwise_AND; return true;
+	case Expression::ExprType::Assign_Bw_XOR: op = Expression::ExprType::Bitwise_XOR; return true;
+	case Expression::ExprType::Assign_Bw_OR: op = Expression::ExprType::Bitwise_OR; return true;
+	default: return false;
+	}
+}
+
+bool evalConstExpr(ConstEvalInfo& cei, ConstCallFrame& frame, const Expression* expr, uint64_t& value)
+{
+	if (cei.stepsLeft == 0)
+		return false;
+	--cei.stepsLeft;
+
+	uint64_t left, right;
+	Expression::ExprType op;
+
+	switch (expr->eType)
+	{
+	case Expression::ExprType::Literal:
+		if (!isConstFoldable(expr->datatype) && !isNull(expr->datatype))
+			return false;
+		value = expr->value.u64;
+		return true;
+	case Expression::ExprType::Symbol:
+	{
+		auto var = getConstFrameVariable(cei, expr);
+		if (!var)
+			return false;
+		auto it = frame.vars.find(var);
+		if (it == frame.vars.end()) // Read before initialization
+			return false;
+		value = it->second;
+	}
+		return true;
+	case Expression::ExprType::Conversion:
+		if (!isConstEvaluable(cei, expr->datatype))
+			return false;
+		if (!evalConstExpr(cei, frame, expr->left.get(), left))
+			return false;
+		return evalConstConversion(expr->left->datatype, expr->datatype, left, value);
+	case Expression::ExprType::Assign:
+	case Expression::ExprType::Assign_Sum:
+	case Expression::ExprType::Assign_Difference:
+	case Expression::ExprType::Assign_Product:
+	case Expression::ExprType::Assign_Quotient:
+	case Expression::ExprType::Assign_Remainder:
+	case Expression::ExprType::Assign_Bw_LeftShift:
+	case Expression::ExprType::Assign_Bw_RightShift:
+	case Expression::ExprType::Assign_Bw_AND:
+	case Expression::ExprType::Assign_Bw_XOR:
+	case Expression::ExprType::Assign_Bw_OR:
+	{
+		auto var = getConstFrameVariable(cei, expr->left.get());
+		if (!var)
+			return false;
+		if (!evalConstExpr(cei, frame, expr->right.get(), right))
+			return false;
+
+		if (expr->eType == Expression::ExprType::Assign)
+		{
+			value = truncateConst(right, var->var.datatype);
+		}
+		else
+		{
+			auto it = frame.vars.find(var);
+			if (it == frame.vars.end())
+				return false;
+			getCompoundAssignOperator(expr->eType, op);
+			if (!evalConstBinary(op, var->var.datatype, it->second, right, value))
+				return false;
+		}
+		frame.vars[var] = value;
+	}
+		return true;
+	case Expression::ExprType::Conditional_Op:
+		if (!evalConstExpr(cei, frame, expr->left.get(), left))
+			return false;
+		return evalConstExpr(cei, frame, left != 0 ? expr->right.get() : expr->farRight.get(), value);
+	// The generated code only skips the right operand if the left one is exactly 1 (OR) or 0 (AND)
+	case Expression::ExprType::Logical_OR:
+		if (!evalConstExpr(cei, frame, expr->left.get(), left))
+			return false;
+		if (left == 1)
+		{
+			value = left;
+			return true;
+		}
+		return evalConstExpr(cei, frame, expr->right.get(), value);
+	case Expression::ExprType::Logical_AND:
+		if (!evalConstExpr(cei, frame, expr->left.get(), left))
+			return false;
+		if (left == 0)
+		{
+			value = left;
+			return true;
+		}
+		return evalConstExpr(cei, frame, expr->right.get(), value);
+	case Expression::ExprType::Bitwise_OR:
+	case Expression::ExprType::Bitwise_XOR:
+	case Expression::ExprType::Bitwise_AND:
+	case Expression::ExprType::Comparison_Equal:
+	case Expression::ExprType::Comparison_NotEqual:
+	case Expression::ExprType::Comparison_Less:
+	case Expression::ExprType::Comparison_LessEqual:
+	case Expression::ExprType::Comparison_Greater:
+	case Expression::ExprType::Comparison_GreaterEqual:
+	case Expression::ExprType::Shift_Left:
+	case Expression::ExprType::Shift_Right:
+	case Expression::ExprType::Sum:
+	case Expression::ExprType::Difference:
+	case Expression::ExprType::Product:
+	case Expression::ExprType::Quotient:
+	case Expression::ExprType::Remainder:
+		if (!isConstEvaluable(cei, expr->datatype) || !isConstEvaluable(cei, expr->left->datatype))
+			return false;
+		if (!evalConstExpr(cei, frame, expr->left.get(), left))
+			return false;
+		if (!evalConstExpr(cei, frame, expr->right.get(), right))
+			return false;
+		return evalConstBinary(expr->eType, expr->left->datatype, left, right, value);
+	case Expression::ExprType::Logical_NOT:
+	case Expression::ExprType::Bitwise_NOT:
+	case Expression::ExprType::Prefix_Plus:
+	case Expression::ExprType::Prefix_Minus:
+		if (!isConstEvaluable(cei, expr->datatype))
+			return false;
+		if (!evalConstExpr(cei, frame, expr->left.get(), left))
+			return false;
+		return evalConstUnary(expr->eType, expr->datatype, left, value);
+	case Expression::ExprType::Prefix_Increment:
+	case Expression::ExprType::Prefix_Decrement:
+	case Expression::ExprType::Suffix_Increment:
+	case Expression::ExprType::Suffix_Decrement:
+	{
+		auto var = getConstFrameVariable(cei, expr->left.get());
+		if (!var || !isInteger(var->var.datatype))
+			return false;
+		auto it = frame.vars.find(var);
+		if (it == frame.vars.end())
+			return false;
+
+		bool isIncrement =
+			expr->eType == Expression::ExprType::Prefix_Increment ||
+			expr->eType == Expression::ExprType::Suffix_Increment;
+		bool isPrefix =
+			expr->eType == Expression::ExprType::Prefix_Increment ||
+			expr->eType == Expression::ExprType::Prefix_Decrement;
+
+		uint64_t oldValue = it->second;
+		it->second = truncateConst(isIncrement ? oldValue + 1 : oldValue - 1, var->var.datatype);
+		value = isPrefix ? it->second : oldValue;
+	}
+		return true;
+	case Expression::ExprType::FunctionCall:
+	{
+		if (expr->isExtCall || expr->left->eType != Expression::ExprType::Symbol || !isFuncSpec(expr->left->symbol))
+			return false;
+
+		// Parameters are evaluated from right to left, just like the generated code pushes them
+		std::vector<uint64_t> args(expr->paramExpr.size());
+		for (int i = (int)expr->paramExpr.size() - 1; i >= 0; --i)
+		{
+			if (!isConstEvaluable(cei, expr->paramExpr[i]->datatype))
+				return false;
+			if (!evalConstExpr(cei, frame, expr->paramExpr[i].get(), args[i]))
+				return false;
+		}
+
+		return evalConstCall(cei, expr->left->symbol, args, value);
+	}
+	default:
+		return false;
+	}
+}
+
+ConstExecState execConstBody(ConstEvalInfo& cei, ConstCallFrame& frame, BodyRef body);
+
+ConstExecState execConstStatement(ConstEvalInfo& cei, ConstCallFrame& frame, StatementRef statement)
+{
+	uint64_t value;
+
+	switch (statement->type)
+	{
+	case Statement::Type::Return:
+		if (statement->subExpr && !evalConstExpr(cei, frame, statement->subExpr.get(), frame.retValue))
+			return ConstExecState::Unsupported;
+		return ConstExecState::Return;
+	case Statement::Type::Expression:
+		if (!evalConstExpr(cei, frame, (const Expression*)statement.get(), value))
+			return ConstExecState::Unsupported;
+		return ConstExecState::Normal;
+	case Statement::Type::If_Clause:
+		for (auto& condBody : statement->ifConditionalBodies)
+		{
+			if (!evalConstExpr(cei, frame, condBody.condition.get(), value))
+				return ConstExecState::Unsupported;
+			if (value != 0)
+				return execConstBody(cei, frame, condBody.body);
+		}
+		if (statement->elseBody)
+			return execConstBody(cei, frame, statement->elseBody);
+		return ConstExecState::Normal;
+	case Statement::Type::While_Loop:
+	case Statement::Type::Do_While_Loop:
+	{
+		bool isDoWhile = statement->type == Statement::Type::Do_While_Loop;
+		auto& condBody = isDoWhile ? statement->doWhileConditionalBody : statement->whileConditionalBody;
+		while (true)
+		{
+			if (!isDoWhile)
+			{
+				if (!evalConstExpr(cei, frame, condBody.condition.get(), value))
+					return ConstExecState::Unsupported;
+				if (value == 0)
+					break;
+			}
+
+			auto state = execConstBody(cei, frame, condBody.body);
+			if (state == ConstExecState::Break)
+				break;
+			if (state == ConstExecState::Return || state == ConstExecState::Unsupported)
+				return state;
+
+			if (isDoWhile)
+			{
+				if (!evalConstExpr(cei, frame, condBody.condition.get(), value))
+					return ConstExecState::Unsupported;
+				if (value == 0)
+					break;
+			}
+		}
+	}
+		return ConstExecState::Normal;
+	case Statement::Type::Continue:
+		return ConstExecState::Continue;
+	case Statement::Type::Break:
+		return ConstExecState::Break;
+	default: // Inline assembly, ...
+		return ConstExecState::Unsupported;
+	}
+}
+
+ConstExecState execConstBody(ConstEvalInfo& cei, ConstCallFrame& frame, BodyRef body)
+{
+	for (auto& statement : body->statements)
+	{
+		auto state = execConstStatement(cei, frame, statement);
+		if (state != ConstExecState::Normal)
+			return state;
+	}
+	return ConstExecState::Normal;
+}
+
+bool evalConstCall(ConstEvalInfo& cei, SymbolRef func, const std::vector<uint64_t>& args, uint64_t& result)
+{
+	if (!isDefined(func) || func->func.isBlueprint || !func->func.body)
+		return false;
+	if (!isVoid(func->func.retType) && !isConstEvaluable(cei, func->func.retType))
+		return false;
+	if (func->func.params.size() != args.size())
+		return false;
+
+	auto key = std::make_pair((const Symbol*)func.get(), args);
+	auto it = cei.callResults.find(key);
+	if (it != cei.callResults.end())
+	{
+		if (!it->second)
+			return false;
+		result = *it->second;
+		return true;
+	}
+
+	if (cei.callDepth >= CONST_EVAL_MAX_CALL_DEPTH)
+		return false;
+
+	ConstCallFrame frame;
+	for (uint64_t i = 0; i < args.size(); ++i)
+	{
+		auto& param = func->func.params[i];
+		if (!isConstEvaluable(cei, param->var.datatype))
+			return false;
+		frame.vars[param.get()] = truncateConst(args[i], param->var.datatype);
+	}
+
+	++cei.callDepth;
+	auto state = execConstBody(cei, frame, func->func.body);
+	--cei.callDepth;
+
+	std::optional<uint64_t> callResult;
+	if (state == ConstExecState::Return)
+		callResult = isVoid(func->func.retType) ? 0 : truncateConst(frame.retValue, func->func.retType);
+
+	// Running out of steps doesn't make the call itself unevaluable
+	if (callResult || cei.stepsLeft > 0)
+		cei.callResults[key] = callResult;
+
+	if (!callResult)
+		return false;
+	result = *callResult;
+	return true;
+}
+
+bool evalConstFunctionCall(ConstEvalInfo& cei, const Expression* callExpr, uint64_t& result)
+{
+	if (callExpr->isExtCall || callExpr->left->eType != Expression::ExprType::Symbol || !isFuncSpec(callExpr->left->symbol))
+		return false;
+	if (!isConstEvaluable(cei, callExpr->datatype))
+		return false;
+
+	std::vector<uint64_t> args;
+	for (auto& param : callExpr->paramExpr)
+	{
+		if (param->eType != Expression::ExprType::Literal || !isConstEvaluable(cei, param->datatype))
+			return false;
+		args.push_back(param->value.u64);
+	}
+
+	cei.stepsLeft = CONST_EVAL_STEP_BUDGET;
+	cei.callDepth = 0;
+	return evalConstCall(cei, callExpr->left->symbol, args, result);
+}
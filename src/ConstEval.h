@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <vector>
+#include <optional>
+
+#include "Program.h"
+
+// Literal values are stored zero-extended to 64 bits and truncated to the width of their datatype.
+// All evaluation functions mirror the semantics of the generated code.
+
+// Returns the width (in bits) of integer, bool and enum values.
+int getConstBitWidth(const Datatype& datatype);
+
+// Truncates the value to the width of the datatype.
+uint64_t truncateConst(uint64_t value, const Datatype& datatype);
+
+// Returns whether the datatype can be represented by a literal holding an integral value.
+bool isConstFoldable(const Datatype& datatype);
+
+// Evaluates the unary operator. Returns false if the operation cannot be evaluated at compile time.
+bool evalConstUnary(Expression::ExprType eType, const Datatype& datatype, uint64_t operand, uint64_t& result);
+
+// Evaluates the binary operator for operands of the specified datatype. Returns false if the operation cannot be evaluated at compile time.
+bool evalConstBinary(Expression::ExprType eType, const Datatype& operandType, uint64_t left, uint64_t right, uint64_t& result);
+
+// Evaluates the conversion of the value. Returns false if the conversion cannot be evaluated at compile time.
+bool evalConstConversion(const Datatype& oldType, const Datatype& newType, uint64_t value, uint64_t& result);
+
+struct ConstEvalInfo
+{
+	ProgramRef program;
+	std::map<std::pair<const Symbol*, std::vector<uint64_t>>, std::optional<uint64_t>> callResults; // (Function, arguments) -> result (if evaluable)
+	uint64_t stepsLeft = 0;
+	int callDepth = 0;
+};
+
+// Interprets the function call if the callee is free of side effects and all arguments are literals.
+// Returns false if the call cannot be evaluated at compile time (inline assembly, external functions, non-local variables, pointers, exhausted step budget, ...).
+bool evalConstFunctionCall(ConstEvalInfo& cei, const Expression* callExpr, uint64_t& result);
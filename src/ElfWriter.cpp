@@ -0,0 +1,183 @@
+#include "ElfWriter.h"
+
+#include <algorithm>
+
+#include "Errors/AssemblerError.h"
+
+#define ELF_SHN_LORESERVE 0xFF00 // Section indices from here on need extended numbering, which is not supported
+
+void writeLE(std::string& out, uint64_t value, int size)
+{
+	for (int i = 0; i < size; ++i)
+		out.push_back((char)((value >> (8 * i)) & 0xFF));
+}
+
+uint32_t addString(std::string& table, const std::string& str)
+{
+	uint32_t offset = table.size();
+	table += str;
+	table.push_back('\0');
+	return offset;
+}
+
+void writeSectionHeader(std::string& out, const ElfSectionHeader& header)
+{
+	writeLE(out, header.name, 4);
+	writeLE(out, header.type, 4);
+	writeLE(out, header.flags, 8);
+	writeLE(out, header.addr, 8);
+	writeLE(out, header.offset, 8);
+	writeLE(out, header.size, 8);
+	writeLE(out, header.link, 4);
+	writeLE(out, header.info, 4);
+	writeLE(out, header.align, 8);
+	writeLE(out, header.entSize, 8);
+}
+
+void writeElfHeader(std::string& out, uint16_t type, uint64_t entry, uint16_t nProgHeaders, uint64_t shOffset, uint16_t nSectionHeaders)
+{
+	out += "\x7F" "ELF";
+	writeLE(out, 2, 1); // ELFCLASS64
+	writeLE(out, 1, 1); // Little endian
+	writeLE(out, 1, 1); // EV_CURRENT
+	writeLE(out, 0, 1); // System V ABI
+	writeLE(out, 0, 8);
+	writeLE(out, type, 2);
+	writeLE(out, 62, 2); // EM_X86_64
+	writeLE(out, 1, 4);
+	writeLE(out, entry, 8);
+	writeLE(out, nProgHeaders ? ELF_HEADER_SIZE : 0, 8); // Program headers follow the ELF header
+	writeLE(out, shOffset, 8);
+	writeLE(out, 0, 4); // Flags
+	writeLE(out, ELF_HEADER_SIZE, 2);
+	writeLE(out, nProgHeaders ? ELF_PROGRAM_HEADER_SIZE : 0, 2);
+	writeLE(out, nProgHeaders, 2);
+	writeLE(out, ELF_SECTION_HEADER_SIZE, 2);
+	writeLE(out, nSectionHeaders, 2);
+	writeLE(out, nSectionHeaders - 1, 2); // .shstrtab is the last section
+}
+
+std::string writeElfObject(const ObjectFile& obj)
+{
+	// Every section needs another one for its relocations, plus the null section and the tables
+	if (obj.sections.size() * 2 + 4 >= ELF_SHN_LORESERVE)
+		THROW_ASSEMBLER_ERROR(0, "Too many sections for an ELF object file!");
+
+	std::vector<ElfSectionHeader> headers(1);
+	std::string shstrtab(1, '\0');
+	std::string strtab(1, '\0');
+
+	for (auto& section : obj.sections)
+	{
+		ElfSectionHeader header;
+		header.name = addString(shstrtab, section.name);
+		header.type = section.isNoBits ? ELF_SHT_NOBITS : ELF_SHT_PROGBITS;
+		header.flags = ELF_SHF_ALLOC | (section.isWritable ? ELF_SHF_WRITE : 0) | (section.isExecutable ? ELF_SHF_EXECINSTR : 0);
+		header.size = section.size;
+		header.align = section.align;
+		header.data.assign(section.data.begin(), section.data.end());
+		headers.push_back(header);
+	}
+
+	// Local symbols must precede the global ones
+	std::vector<int> symbolIndices(obj.symbols.size());
+	std::string symtab(ELF_SYMBOL_SIZE, '\0');
+	int nLocals = 1;
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		for (uint64_t i = 0; i < obj.symbols.size(); ++i)
+		{
+			auto& symbol = obj.symbols[i];
+			if (symbol.isGlobal != (pass == 1))
+				continue;
+			symbolIndices[i] = symtab.size() / ELF_SYMBOL_SIZE;
+			nLocals += pass == 0 ? 1 : 0;
+			writeLE(symtab, addString(strtab, symbol.name), 4);
+			writeLE(symtab, (symbol.isGlobal ? 1 : 0) << 4, 1); // Binding, type NOTYPE
+			writeLE(symtab, 0, 1);
+			writeLE(symtab, symbol.section + 1, 2); // SHN_UNDEF for undefined symbols
+			writeLE(symtab, symbol.value, 8);
+			writeLE(symtab, 0, 8);
+		}
+	}
+
+	int symtabIndex = headers.size() + std::count_if(obj.sections.begin(), obj.sections.end(), [](auto& s) { return !s.relocs.empty(); });
+	for (uint64_t i = 0; i < obj.sections.size(); ++i)
+	{
+		auto& section = obj.sections[i];
+		if (section.relocs.empty())
+			continue;
+
+		ElfSectionHeader header;
+		header.name = addString(shstrtab, ".rela" + section.name);
+		header.type = ELF_SHT_RELA;
+		header.flags = ELF_SHF_INFO_LINK;
+		header.link = symtabIndex;
+		header.info = i + 1;
+		header.align = 8;
+		header.entSize = ELF_RELA_SIZE;
+		for (auto& reloc : section.relocs)
+		{
+			writeLE(header.data, reloc.offset, 8);
+			writeLE(header.data, ((uint64_t)symbolIndices[reloc.symbol] << 32) | (uint64_t)reloc.type, 8);
+			writeLE(header.data, reloc.addend, 8);
+		}
+		header.size = header.data.size();
+		headers.push_back(header);
+	}
+
+	ElfSectionHeader symtabHeader;
+	symtabHeader.name = addString(shstrtab, ".symtab");
+	symtabHeader.type = ELF_SHT_SYMTAB;
+	symtabHeader.link = symtabIndex + 1;
+	symtabHeader.info = nLocals;
+	symtabHeader.align = 8;
+	symtabHeader.entSize = ELF_SYMBOL_SIZE;
+	symtabHeader.data = symtab;
+	symtabHeader.size = symtab.size();
+	headers.push_back(symtabHeader);
+
+	ElfSectionHeader strtabHeader;
+	strtabHeader.name = addString(shstrtab, ".strtab");
+	strtabHeader.type = ELF_SHT_STRTAB;
+	strtabHeader.align = 1;
+	strtabHeader.data = strtab;
+	strtabHeader.size = strtab.size();
+	headers.push_back(strtabHeader);
+
+	ElfSectionHeader shstrtabHeader;
+	shstrtabHeader.name = addString(shstrtab, ".shstrtab");
+	shstrtabHeader.type = ELF_SHT_STRTAB;
+	shstrtabHeader.align = 1;
+	shstrtabHeader.data = shstrtab;
+	shstrtabHeader.size = shstrtab.size();
+	headers.push_back(shstrtabHeader);
+
+	// Section contents follow the ELF header, the section header table comes last
+	std::string body;
+	uint64_t offset = ELF_HEADER_SIZE;
+	for (auto& header : headers)
+	{
+		if (header.type == ELF_SHT_NULL)
+			continue;
+		uint64_t align = std::max<uint64_t>(header.align, 1);
+		uint64_t padding = (align - offset % align) % align;
+		body.append(padding, '\0');
+		offset += padding;
+		header.offset = offset;
+		body += header.data;
+		offset += header.data.size();
+	}
+	uint64_t padding = (8 - offset % 8) % 8;
+	body.append(padding, '\0');
+	uint64_t shOffset = offset + padding;
+
+	std::string out;
+	writeElfHeader(out, ELF_TYPE_REL, 0, 0, shOffset, headers.size());
+
+	out += body;
+	for (auto& header : headers)
+		writeSectionHeader(out, header);
+
+	return out;
+}
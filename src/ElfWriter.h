@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+
+#include "ObjectFile.h"
+
+#define ELF_HEADER_SIZE 64
+#define ELF_PROGRAM_HEADER_SIZE 56
+#define ELF_SECTION_HEADER_SIZE 64
+#define ELF_SYMBOL_SIZE 24
+#define ELF_RELA_SIZE 24
+
+#define ELF_TYPE_REL 1
+#define ELF_TYPE_EXEC 2
+
+#define ELF_SHT_NULL 0
+#define ELF_SHT_PROGBITS 1
+#define ELF_SHT_SYMTAB 2
+#define ELF_SHT_STRTAB 3
+#define ELF_SHT_RELA 4
+#define ELF_SHT_NOBITS 8
+
+#define ELF_SHF_WRITE 0x1
+#define ELF_SHF_ALLOC 0x2
+#define ELF_SHF_EXECINSTR 0x4
+#define ELF_SHF_INFO_LINK 0x40
+
+struct ElfSectionHeader
+{
+	uint32_t name = 0;
+	uint32_t type = ELF_SHT_NULL;
+	uint64_t flags = 0;
+	uint64_t addr = 0;
+	uint64_t offset = 0;
+	uint64_t size = 0;
+	uint32_t link = 0;
+	uint32_t info = 0;
+	uint64_t align = 0;
+	uint64_t entSize = 0;
+	std::string data; // Contents written at 'offset'
+};
+
+// Appends the value in little endian byte order
+void writeLE(std::string& out, uint64_t value, int size);
+// Adds the string to the string table and returns its offset
+uint32_t addString(std::string& table, const std::string& str);
+// Writes the ELF header (x86-64), the section header string table must be the last section
+void writeElfHeader(std::string& out, uint16_t type, uint64_t entry, uint16_t nProgHeaders, uint64_t shOffset, uint16_t nSectionHeaders);
+void writeSectionHeader(std::string& out, const ElfSectionHeader& header);
+
+// Serializes the object into a relocatable ELF64 file (x86-64) that links with ld like the output of 'nasm -f elf64'.
+// Throws an AssemblerError if the object has too many sections to be indexed without extended section numbering.
+std::string writeElfObject(const ObjectFile& obj);
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "QinpError.h"
+
+// Thrown when the built-in assembler encounters code it cannot encode.
+// The driver then falls back to nasm.
+class AssemblerError : public QinpError
+{
+public:
+	AssemblerError(int line, const std::string& what, const std::string& srcFile, int srcLine)
+		: QinpError("Assembly line " + std::to_string(line) + ": " + what, srcFile, srcLine)
+	{}
+};
+
+#define MAKE_ASSEMBLER_ERROR(line, what) AssemblerError(line, what, __FILE__, __LINE__)
+#define THROW_ASSEMBLER_ERROR(line, what) throw MAKE_ASSEMBLER_ERROR(line, what)
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "QinpError.h"
+
+#include "Token.h"
+
+// Thrown when a function contains constructs the IR cannot represent (yet).
+// The function then gets generated by the legacy code generator instead.
+class IRGenError : public QinpError
+{
+public:
+	IRGenError(const Token::Position& pos, const std::string& what, const std::string& srcFile, int srcLine)
+		: QinpError(pos.file + ":" + std::to_string(pos.line) + ":" + std::to_string(pos.column) + ": " + what, srcFile, srcLine)
+	{}
+};
+
+#define MAKE_IR_GEN_ERROR(pos, what) IRGenError(pos, what, __FILE__, __LINE__)
+#define THROW_IR_GEN_ERROR(pos, what) throw MAKE_IR_GEN_ERROR(pos, what)
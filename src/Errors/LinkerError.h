@@ -0,0 +1,14 @@
+#pragma once
+
+#include "QinpError.h"
+
+class LinkerError : public QinpError
+{
+public:
+	LinkerError(const std::string& what, const std::string& srcFile, int srcLine)
+		: QinpError("Linker: " + what, srcFile, srcLine)
+	{}
+};
+
+#define MAKE_LINKER_ERROR(what) LinkerError(what, __FILE__, __LINE__)
+#define THROW_LINKER_ERROR(what) throw MAKE_LINKER_ERROR(what)
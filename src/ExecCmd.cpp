@@ -1,9 +1,14 @@
 #include "ExecCmd.h"
 
+#include <thread>
+
 #include "Errors/QinpError.h"
 
 #if defined QINP_PLATFORM_UNIX
 
+#include <csignal>
+#include <cerrno>
+
 #include <sys/wait.h>
 #include <unistd.h>
 
@@ -53,6 +58,111 @@ ExecCmdResult execCmd(const std::string& command, bool grabOutput)
 		return { -1, "" };
 }
 
+ExecCmdResult execCmdWithInput(const std::string& command, const std::function<void(const ExecCmdWriter&)>& produceInput)
+{
+	int link[2];
+	int outLink[2];
+
+	if (pipe(link) == -1)
+		THROW_QINP_ERROR("Pipe failed! ( CMD: '" + command + "' )");
+	if (pipe(outLink) == -1)
+	{
+		close(link[0]);
+		close(link[1]);
+		THROW_QINP_ERROR("Pipe failed! ( CMD: '" + command + "' )");
+	}
+
+	pid_t p = fork();
+
+	if (p == -1)
+	{
+		close(link[0]);
+		close(link[1]);
+		close(outLink[0]);
+		close(outLink[1]);
+		THROW_QINP_ERROR("Fork failed! ( CMD: '" + command + "' )");
+	}
+
+	if (p == 0)
+	{
+		dup2(link[0], STDIN_FILENO);
+		dup2(outLink[1], STDOUT_FILENO);
+		dup2(outLink[1], STDERR_FILENO);
+		close(link[0]);
+		close(link[1]);
+		close(outLink[0]);
+		close(outLink[1]);
+		execl("/bin/sh", "sh", "-c", command.c_str(), nullptr);
+		_exit(127);
+	}
+
+	close(link[0]);
+	close(outLink[1]);
+
+	// The output is read while the input is written, a command blocked on a full output pipe would never consume its input
+	std::string output;
+	std::thread reader([&]()
+		{
+			char buffer[4096];
+			while (true)
+			{
+				auto n = read(outLink[0], buffer, sizeof(buffer));
+				if (n == -1 && errno == EINTR)
+					continue;
+				if (n <= 0)
+					break;
+				output.append(buffer, n);
+			}
+		}
+	);
+
+	// A command exiting early must not kill the compiler, its exit code reports the error
+	auto prevHandler = signal(SIGPIPE, SIG_IGN);
+	bool isOpen = true;
+	auto writer = [&](const std::string& data)
+	{
+		for (size_t done = 0; isOpen && done < data.size();)
+		{
+			auto n = write(link[1], data.data() + done, data.size() - done);
+			if (n == -1 && errno == EINTR)
+				continue;
+			if (n == -1)
+				isOpen = false;
+			else
+				done += n;
+		}
+	};
+
+	int status;
+	try
+	{
+		produceInput(writer);
+	}
+	catch (...)
+	{
+		// The command sees the end of its input, the result does not matter anymore
+		close(link[1]);
+		signal(SIGPIPE, prevHandler);
+		waitpid(p, &status, 0);
+		reader.join();
+		close(outLink[0]);
+		throw;
+	}
+	close(link[1]);
+	signal(SIGPIPE, prevHandler);
+
+	bool waitFailed = waitpid(p, &status, 0) == -1;
+	reader.join();
+	close(outLink[0]);
+	if (waitFailed)
+		THROW_QINP_ERROR("Waitpid failed! ( CMD: '" + command + "' )");
+
+	if (WIFEXITED(status))
+		return { WEXITSTATUS(status), output };
+	else
+		return { -1, output };
+}
+
 #elif defined QINP_PLATFORM_WINDOWS
 
 #include <windows.h>
@@ -88,4 +198,101 @@ ExecCmdResult execCmd(const std::string& command, bool grabOutput)
 	THROW_QINP_ERROR("CreateProcess failed! ( CMD: '" + command + "' )");
 }
 
+ExecCmdResult execCmdWithInput(const std::string& command, const std::function<void(const ExecCmdWriter&)>& produceInput)
+{
+	SECURITY_ATTRIBUTES sa;
+	ZeroMemory(&sa, sizeof(sa));
+	sa.nLength = sizeof(sa);
+	sa.bInheritHandle = TRUE;
+
+	HANDLE hRead, hWrite;
+	if (!CreatePipe(&hRead, &hWrite, &sa, 0))
+		THROW_QINP_ERROR("CreatePipe failed! ( CMD: '" + command + "' )");
+	SetHandleInformation(hWrite, HANDLE_FLAG_INHERIT, 0);
+
+	HANDLE hOutRead, hOutWrite;
+	if (!CreatePipe(&hOutRead, &hOutWrite, &sa, 0))
+	{
+		CloseHandle(hRead);
+		CloseHandle(hWrite);
+		THROW_QINP_ERROR("CreatePipe failed! ( CMD: '" + command + "' )");
+	}
+	SetHandleInformation(hOutRead, HANDLE_FLAG_INHERIT, 0);
+
+	STARTUPINFO si;
+	ZeroMemory(&si, sizeof(si));
+	si.cb = sizeof(si);
+	si.dwFlags = STARTF_USESTDHANDLES;
+	si.hStdInput = hRead;
+	si.hStdOutput = hOutWrite;
+	si.hStdError = hOutWrite;
+	PROCESS_INFORMATION pi;
+	ZeroMemory(&pi, sizeof(pi));
+
+	if (!CreateProcessA(
+		NULL, (LPSTR)command.c_str(),
+		NULL, NULL,
+		TRUE, NULL,
+		NULL, NULL,
+		&si, &pi)
+	)
+	{
+		CloseHandle(hRead);
+		CloseHandle(hWrite);
+		CloseHandle(hOutRead);
+		CloseHandle(hOutWrite);
+		THROW_QINP_ERROR("CreateProcess failed! ( CMD: '" + command + "' )");
+	}
+	CloseHandle(hRead);
+	CloseHandle(hOutWrite);
+
+	// The output is read while the input is written, a command blocked on a full output pipe would never consume its input
+	std::string output;
+	std::thread reader([&]()
+		{
+			char buffer[4096];
+			DWORD nRead = 0;
+			while (ReadFile(hOutRead, buffer, sizeof(buffer), &nRead, NULL) && nRead > 0)
+				output.append(buffer, nRead);
+		}
+	);
+
+	bool isOpen = true;
+	auto writer = [&](const std::string& data)
+	{
+		DWORD nWritten = 0;
+		for (size_t done = 0; isOpen && done < data.size(); done += nWritten)
+			isOpen = WriteFile(hWrite, data.data() + done, (DWORD)(data.size() - done), &nWritten, NULL);
+	};
+
+	try
+	{
+		produceInput(writer);
+	}
+	catch (...)
+	{
+		// The command sees the end of its input, the result does not matter anymore
+		CloseHandle(hWrite);
+		WaitForSingleObject(pi.hProcess, INFINITE);
+		reader.join();
+		CloseHandle(hOutRead);
+		CloseHandle(pi.hThread);
+		CloseHandle(pi.hProcess);
+		throw;
+	}
+	CloseHandle(hWrite);
+
+	WaitForSingleObject(pi.hProcess, INFINITE);
+	reader.join();
+	CloseHandle(hOutRead);
+
+	DWORD dwExitCode = 0;
+	GetExitCodeProcess(pi.hProcess, &dwExitCode);
+
+	CloseHandle(pi.hThread);
+	CloseHandle(pi.hProcess);
+
+	return { dwExitCode, output };
+}
+
 #endif
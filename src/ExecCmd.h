@@ -1,7 +1,15 @@
 #pragma once
 
 #include <string>
+#include <functional>
 
 typedef std::pair<int, std::string> ExecCmdResult;
 
-ExecCmdResult execCmd(const std::string& command, bool grabOutput = true);
\ No newline at end of file
+typedef std::function<void(const std::string&)> ExecCmdWriter; // Appends data to the stdin of the running command
+
+ExecCmdResult execCmd(const std::string& command, bool grabOutput = true);
+
+// Runs the command while 'produceInput' streams data into its stdin through a pipe.
+// The command starts consuming the data before it has been produced completely.
+// Returns the exit code and the output (stdout and stderr) of the command.
+ExecCmdResult execCmdWithInput(const std::string& command, const std::function<void(const ExecCmdWriter&)>& produceInput);
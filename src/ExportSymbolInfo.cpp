@@ -80,6 +80,8 @@ void exportSymbolInfo(SymbolRef root, std::ostream& out)
 		out << ",\"isVariadic\": " << (root->func.isVariadic ? "true" : "false");
 		out << ",\"genFromBlueprint\": " << (root->func.genFromBlueprint ? "true" : "false");
 		out << ",\"isNoDiscard\": " << (root->func.isNoDiscard ? "true" : "false");
+		out << ",\"isInline\": " << (root->func.isInline ? "true" : "false");
+		out << ",\"isNoInline\": " << (root->func.isNoInline ? "true" : "false");
 		break;
 	case SymType::Pack:
 		out << ",\"size\": " << root->frame.size;
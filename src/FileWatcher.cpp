@@ -0,0 +1,117 @@
+#include "FileWatcher.h"
+
+#include "Errors/QinpError.h"
+
+#if defined QINP_PLATFORM_UNIX && defined __linux__
+
+#include <filesystem>
+#include <cerrno>
+
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+
+#define WATCH_DEBOUNCE_MS 50
+
+FileWatcher::FileWatcher()
+{
+	m_fd = inotify_init1(IN_CLOEXEC);
+	if (m_fd == -1)
+		THROW_QINP_ERROR("Failed to initialize inotify!");
+}
+
+FileWatcher::~FileWatcher()
+{
+	close(m_fd);
+}
+
+void FileWatcher::addFiles(const std::set<std::string>& files)
+{
+	// Editors often replace files instead of writing to them, so the directories get watched.
+	for (auto& file : files)
+	{
+		auto path = std::filesystem::path(file);
+		auto dir = path.parent_path().string();
+		auto it = m_dirWatches.find(dir);
+		if (it == m_dirWatches.end())
+		{
+			int wd = inotify_add_watch(
+				m_fd, dir.c_str(),
+				IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_ATTRIB
+			);
+			if (wd == -1)
+				continue;
+			it = m_dirWatches.insert({ dir, wd }).first;
+		}
+		m_watchedNames[it->second].insert(path.filename().string());
+	}
+}
+
+bool FileWatcher::readEvents(int timeoutMs, bool& changed)
+{
+	pollfd pfd = { m_fd, POLLIN, 0 };
+	int nReady = poll(&pfd, 1, timeoutMs);
+	if (nReady == -1 && errno != EINTR)
+		THROW_QINP_ERROR("Failed to wait for inotify events!");
+	if (nReady == 0)
+		return false;
+	if (nReady == -1)
+		return true;
+
+	alignas(inotify_event) char buffer[4096];
+	auto n = read(m_fd, buffer, sizeof(buffer));
+	if (n == -1 && errno == EINTR)
+		return true;
+	if (n <= 0)
+		THROW_QINP_ERROR("Failed to read inotify events!");
+
+	for (char* ptr = buffer; ptr < buffer + n;)
+	{
+		auto event = (const inotify_event*)ptr;
+		auto it = m_watchedNames.find(event->wd);
+		if (event->mask & IN_Q_OVERFLOW)
+			changed = true;
+		else if (event->len > 0 && it != m_watchedNames.end() && it->second.count(event->name))
+			changed = true;
+		ptr += sizeof(inotify_event) + event->len;
+	}
+	return true;
+}
+
+void FileWatcher::waitForChange()
+{
+	if (m_watchedNames.empty())
+		THROW_QINP_ERROR("None of the files can be watched!");
+
+	// Events queued up since the previous call are drained first
+	bool changed = false;
+	while (readEvents(0, changed))
+		;
+	while (!changed)
+		readEvents(-1, changed);
+
+	// Coalesce the burst of events caused by a single save
+	while (readEvents(WATCH_DEBOUNCE_MS, changed))
+		;
+}
+
+#else
+
+FileWatcher::FileWatcher()
+{
+	THROW_QINP_ERROR("Watch mode is not supported on this platform!");
+}
+
+FileWatcher::~FileWatcher()
+{
+}
+
+void FileWatcher::addFiles(const std::set<std::string>& files)
+{
+}
+
+void FileWatcher::waitForChange()
+{
+}
+
+#endif
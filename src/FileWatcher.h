@@ -0,0 +1,29 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+
+// Watches files (absolute paths) for modifications, replacements and removals.
+// Changes are recorded from the moment a file is added, so saves made while compiling or running the program are not missed.
+class FileWatcher
+{
+public:
+	FileWatcher();
+	~FileWatcher();
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	// Starts watching the files, files that are already watched are ignored
+	void addFiles(const std::set<std::string>& files);
+	// Blocks until any of the watched files changed since the previous call (returns right away if a change is pending)
+	void waitForChange();
+private:
+	// Reads the pending events, waits up to 'timeoutMs' (-1: infinitely) for the first one.
+	// Returns false if there were no events, 'changed' gets set if any of them concerns a watched file.
+	bool readEvents(int timeoutMs, bool& changed);
+private:
+	int m_fd = -1;
+	std::map<std::string, int> m_dirWatches; // Directory -> Watch descriptor
+	std::map<int, std::set<std::string>> m_watchedNames; // Watch descriptor -> Watched filenames in that directory
+};
@@ -0,0 +1,552 @@
+#include "GasTranslator.h"
+
+#include <set>
+#include <map>
+#include <vector>
+#include <cctype>
+#include <algorithm>
+
+#include "Errors/AssemblerError.h"
+
+#define GAS_TRANSLATOR_CHUNK_SIZE 65536 // Translated code is passed on in chunks of at least this many bytes
+
+struct GasTranslatorInfo
+{
+	int line = 0;
+	std::string lastLabel; // Base of local labels (starting with '.')
+	bool isDefaultRel = false;
+	std::string out;
+};
+
+static const std::set<std::string> x86SizeNames = { "byte", "word", "dword", "qword", "tword", "oword", "yword", "zword" };
+
+bool isGasIdentChar(char c)
+{
+	return isalnum(c) || c == '_' || c == '.';
+}
+
+bool isNasmIdentChar(char c)
+{
+	return isalnum(c) || c == '_' || c == '.' || c == '$' || c == '#' || c == '@' || c == '~' || c == '?';
+}
+
+bool isX86RegName(std::string name)
+{
+	for (auto& c : name)
+		c = tolower(c);
+
+	static const std::set<std::string> regs = {
+		"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+		"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+		"ax", "cx", "dx", "bx", "sp", "bp", "si", "di",
+		"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil", "ah", "ch", "dh", "bh",
+		"cs", "ds", "es", "fs", "gs", "ss", "rip",
+	};
+	if (regs.count(name))
+		return true;
+
+	auto isNumber = [](const std::string& str) { return !str.empty() && str.find_first_not_of("0123456789") == std::string::npos; };
+	if (name[0] == 'r' && name.size() >= 2)
+	{
+		auto num = name.substr(1);
+		if (!num.empty() && (num.back() == 'b' || num.back() == 'w' || num.back() == 'd'))
+			num.pop_back();
+		return isNumber(num) && std::stoi(num) >= 8 && std::stoi(num) <= 15;
+	}
+	for (auto prefix : { "xmm", "ymm", "zmm", "st", "mm", "cr", "dr", "k" })
+	{
+		auto len = std::string(prefix).size();
+		if (name.compare(0, len, prefix) == 0 && isNumber(name.substr(len)))
+			return true;
+	}
+	return false;
+}
+
+// Every character GNU as does not accept in symbol names (and '$' itself) is replaced by '$' followed by its hex code
+std::string escapeName(const std::string& name)
+{
+	static const char* hexDigits = "0123456789ABCDEF";
+	std::string result;
+	for (char c : name)
+	{
+		if (isGasIdentChar(c))
+		{
+			result.push_back(c);
+			continue;
+		}
+		result.push_back('$');
+		result.push_back(hexDigits[(uint8_t)c >> 4]);
+		result.push_back(hexDigits[(uint8_t)c & 0xF]);
+	}
+	return result;
+}
+
+std::string escapeSymbol(GasTranslatorInfo& gti, std::string name)
+{
+	if (!name.empty() && name[0] == '$')
+		name = name.substr(1); // NASM's escape for names that look like keywords
+	if (name.size() > 1 && name[0] == '.' && name[1] != '.')
+		name = gti.lastLabel + name;
+	return escapeName(name);
+}
+
+bool parseNasmNumber(const std::string& str, uint64_t& value)
+{
+	if (str.size() >= 3 && (str[0] == '\'' || str[0] == '"' || str[0] == '`') && str.back() == str[0])
+	{
+		if (str.size() > 10)
+			return false;
+		value = 0;
+		for (int i = str.size() - 2; i >= 1; --i)
+			value = (value << 8) | (uint8_t)str[i];
+		return true;
+	}
+
+	if (str.empty() || !isdigit(str[0]))
+		return false;
+
+	std::string digits;
+	for (char c : str)
+		if (c != '_')
+			digits.push_back(tolower(c));
+	int base = 10;
+	if (digits.size() > 2 && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'h'))
+		base = 16, digits = digits.substr(2);
+	else if (digits.size() > 2 && digits[0] == '0' && (digits[1] == 'b' || digits[1] == 'y'))
+		base = 2, digits = digits.substr(2);
+	else if (digits.size() > 2 && digits[0] == '0' && (digits[1] == 'o' || digits[1] == 'q'))
+		base = 8, digits = digits.substr(2);
+	else if (digits.back() == 'h')
+		base = 16, digits.pop_back();
+	else if (digits.back() == 'q' || digits.back() == 'o')
+		base = 8, digits.pop_back();
+	else if (digits.back() == 'b' || digits.back() == 'y')
+		base = 2, digits.pop_back();
+	else if (digits.back() == 'd')
+		digits.pop_back();
+
+	value = 0;
+	for (char c : digits)
+	{
+		int digit = isdigit(c) ? c - '0' : (isxdigit(c) ? c - 'a' + 10 : base);
+		if (digit >= base)
+			return false;
+		value = value * base + digit;
+	}
+	return !digits.empty();
+}
+
+// Translates the identifiers and numbers of an operand/expression, returns true if it references a symbol
+bool translateExpression(GasTranslatorInfo& gti, const std::string& expr, std::string& result)
+{
+	bool hasSymbol = false;
+	for (uint64_t i = 0; i < expr.size();)
+	{
+		char c = expr[i];
+		if (c == '\'' || c == '"' || c == '`')
+		{
+			auto end = expr.find(c, i + 1);
+			if (end == std::string::npos)
+				THROW_ASSEMBLER_ERROR(gti.line, "Unterminated character constant!");
+			uint64_t value;
+			if (!parseNasmNumber(expr.substr(i, end - i + 1), value))
+				THROW_ASSEMBLER_ERROR(gti.line, "Invalid character constant '" + expr.substr(i, end - i + 1) + "'!");
+			result += std::to_string(value);
+			i = end + 1;
+		}
+		else if (isdigit(c))
+		{
+			uint64_t begin = i;
+			while (i < expr.size() && isalnum(expr[i]))
+				++i;
+			uint64_t value;
+			if (!parseNasmNumber(expr.substr(begin, i - begin), value))
+				THROW_ASSEMBLER_ERROR(gti.line, "Invalid number '" + expr.substr(begin, i - begin) + "'!");
+			result += std::to_string(value);
+		}
+		else if (isNasmIdentChar(c))
+		{
+			uint64_t begin = i;
+			while (i < expr.size() && isNasmIdentChar(expr[i]))
+				++i;
+			auto word = expr.substr(begin, i - begin);
+			std::string lower = word;
+			for (auto& ch : lower)
+				ch = tolower(ch);
+
+			if (word == "$")
+				result += ".";
+			else if (word == "$$")
+				THROW_ASSEMBLER_ERROR(gti.line, "'$$' is not supported by the gas translation!");
+			else if (isX86RegName(word))
+				result += lower;
+			else if (x86SizeNames.count(lower))
+				result += lower + " PTR";
+			else if (lower == "rel" || lower == "abs" || lower == "short" || lower == "near" || lower == "strict")
+				; // GNU as picks the shortest encoding/addressing by itself
+			else
+			{
+				result += escapeSymbol(gti, word);
+				hasSymbol = true;
+			}
+		}
+		else
+		{
+			result.push_back(c);
+			++i;
+		}
+	}
+	return hasSymbol;
+}
+
+// Splits at commas outside of brackets/strings
+std::vector<std::string> splitNasmOperands(const std::string& str)
+{
+	std::vector<std::string> operands;
+	std::string curr;
+	int depth = 0;
+	char quote = 0;
+	for (char c : str)
+	{
+		if (quote)
+		{
+			if (c == quote)
+				quote = 0;
+		}
+		else if (c == '"' || c == '\'' || c == '`')
+			quote = c;
+		else if (c == '[')
+			++depth;
+		else if (c == ']')
+			--depth;
+		else if (c == ',' && depth == 0)
+		{
+			operands.push_back(curr);
+			curr.clear();
+			continue;
+		}
+		curr.push_back(c);
+	}
+	operands.push_back(curr);
+
+	for (auto& op : operands)
+	{
+		auto begin = op.find_first_not_of(" \t");
+		auto end = op.find_last_not_of(" \t");
+		op = begin == std::string::npos ? "" : op.substr(begin, end - begin + 1);
+	}
+	return operands;
+}
+
+std::string translateOperand(GasTranslatorInfo& gti, const std::string& mnemonic, const std::string& operand)
+{
+	auto bracket = operand.find('[');
+	if (bracket == std::string::npos)
+	{
+		// Size specifiers of immediates are implied by the other operand
+		auto expr = operand;
+		auto space = expr.find(' ');
+		std::string firstWord = expr.substr(0, space);
+		for (auto& c : firstWord)
+			c = tolower(c);
+		if (space != std::string::npos && x86SizeNames.count(firstWord))
+			expr = expr.substr(space + 1);
+
+		std::string result;
+		bool hasSymbol = translateExpression(gti, expr, result);
+		bool isBranch = mnemonic[0] == 'j' || mnemonic == "call" || mnemonic.compare(0, 4, "loop") == 0;
+		// Plain symbols are memory references in the intel syntax of GNU as
+		if (hasSymbol && !isBranch)
+			return "OFFSET " + result;
+		return result;
+	}
+
+	auto closing = operand.rfind(']');
+	if (closing == std::string::npos)
+		THROW_ASSEMBLER_ERROR(gti.line, "Invalid memory operand '" + operand + "'!");
+
+	std::string prefix;
+	translateExpression(gti, operand.substr(0, bracket), prefix);
+	auto inner = operand.substr(bracket + 1, closing - bracket - 1);
+
+	// [fs:x] -> fs:[x]
+	auto colon = inner.find(':');
+	if (colon != std::string::npos)
+	{
+		translateExpression(gti, inner.substr(0, colon), prefix);
+		prefix += ":";
+		inner = inner.substr(colon + 1);
+	}
+
+	std::string address;
+	bool hasSymbol = translateExpression(gti, inner, address);
+	bool hasReg = false;
+	for (uint64_t i = 0; i < address.size() && !hasReg;)
+	{
+		uint64_t begin = i;
+		while (i < address.size() && isNasmIdentChar(address[i]))
+			++i;
+		hasReg = i > begin && isX86RegName(address.substr(begin, i - begin));
+		i = std::max(i, begin + 1);
+	}
+	if (gti.isDefaultRel && hasSymbol && !hasReg && inner.find("abs") == std::string::npos)
+		address = "rip + " + address;
+
+	// Indirect jumps/calls need an explicit size
+	if (prefix.find("PTR") == std::string::npos && (mnemonic == "call" || mnemonic == "jmp"))
+		prefix = "QWORD PTR " + prefix;
+
+	return prefix + "[" + address + "]";
+}
+
+void translateData(GasTranslatorInfo& gti, const std::string& directive, const std::string& args)
+{
+	static const std::map<std::string, std::pair<std::string, int>> dataDirectives = {
+		{ "db", { ".byte", 1 } }, { "dw", { ".short", 2 } }, { "dd", { ".long", 4 } }, { "dq", { ".quad", 8 } },
+	};
+	auto& [gasDirective, size] = dataDirectives.at(directive);
+
+	// Consecutive values are put into one directive, strings into their own .ascii directive
+	std::vector<std::string> values;
+	auto flushValues = [&]() {
+		if (values.empty())
+			return;
+		gti.out += "  " + gasDirective + " ";
+		for (uint64_t i = 0; i < values.size(); ++i)
+			gti.out += (i == 0 ? "" : ",") + values[i];
+		gti.out += "\n";
+		values.clear();
+	};
+
+	for (auto& value : splitNasmOperands(args))
+	{
+		bool isString = value.size() >= 2 && (value[0] == '"' || value[0] == '\'' || value[0] == '`') && value.back() == value[0];
+		if (isString && (size == 1 || value.size() > (size_t)(2 + size)))
+		{
+			if (size != 1)
+				THROW_ASSEMBLER_ERROR(gti.line, "Strings are only supported with 'db' by the gas translation!");
+			if (value[0] == '`' && value.find('\\') != std::string::npos)
+				THROW_ASSEMBLER_ERROR(gti.line, "Escape sequences are not supported by the gas translation!");
+			if (value.size() == 2)
+				continue;
+
+			flushValues();
+			gti.out += "  .ascii \"";
+			for (uint64_t i = 1; i + 1 < value.size(); ++i)
+			{
+				uint8_t c = value[i];
+				if (c == '"' || c == '\\')
+					gti.out += std::string("\\") + (char)c;
+				else if (c < ' ' || c > '~')
+					gti.out += "\\" + std::to_string(c >> 6) + std::to_string((c >> 3) & 7) + std::to_string(c & 7);
+				else
+					gti.out += c;
+			}
+			gti.out += "\"\n";
+			continue;
+		}
+
+		std::string result;
+		translateExpression(gti, value, result);
+		values.push_back(result);
+	}
+	flushValues();
+}
+
+void translateSection(GasTranslatorInfo& gti, const std::string& args)
+{
+	std::vector<std::string> parts;
+	for (uint64_t begin = 0, end; begin < args.size(); begin = end + 1)
+	{
+		end = args.find_first_of(" \t", begin);
+		if (end == std::string::npos)
+			end = args.size();
+		if (end > begin)
+			parts.push_back(args.substr(begin, end - begin));
+	}
+	if (parts.empty())
+		THROW_ASSEMBLER_ERROR(gti.line, "Missing section name!");
+
+	gti.out += ".section " + escapeName(parts[0]); // Section names may contain the '#' of mangled names
+	if (parts.size() == 1)
+	{
+		gti.out += "\n";
+		return;
+	}
+
+	// GNU as needs all attributes at once, start with the defaults of NASM
+	auto& name = parts[0];
+	bool isExec = name.find(".text") == 0;
+	bool isNoBits = name.find(".bss") == 0;
+	bool isWrite = name.find(".data") == 0 || isNoBits;
+	bool isAlloc = true;
+	std::string align;
+	for (uint64_t i = 1; i < parts.size(); ++i)
+	{
+		auto& attr = parts[i];
+		if (attr.find("align=") == 0)
+			align = attr.substr(6);
+		else if (attr == "exec" || attr == "noexec")
+			isExec = attr == "exec";
+		else if (attr == "write" || attr == "nowrite")
+			isWrite = attr == "write";
+		else if (attr == "nobits" || attr == "progbits")
+			isNoBits = attr == "nobits";
+		else if (attr == "alloc" || attr == "noalloc")
+			isAlloc = attr == "alloc";
+		else
+			THROW_ASSEMBLER_ERROR(gti.line, "Unsupported section attribute '" + attr + "'!");
+	}
+	gti.out += std::string(", \"") + (isAlloc ? "a" : "") + (isWrite ? "w" : "") + (isExec ? "x" : "") + "\", " + (isNoBits ? "@nobits" : "@progbits") + "\n";
+	if (!align.empty())
+		gti.out += "  .balign " + align + "\n";
+}
+
+void translateLine(GasTranslatorInfo& gti, const std::string& text)
+{
+	// Split off the comment
+	std::string code = text;
+	std::string comment;
+	char quote = 0;
+	for (uint64_t i = 0; i < text.size(); ++i)
+	{
+		if (quote)
+		{
+			if (text[i] == quote)
+				quote = 0;
+		}
+		else if (text[i] == '"' || text[i] == '\'' || text[i] == '`')
+			quote = text[i];
+		else if (text[i] == ';')
+		{
+			code = text.substr(0, i);
+			comment = " #" + text.substr(i + 1);
+			break;
+		}
+	}
+
+	auto begin = code.find_first_not_of(" \t\r");
+	if (begin == std::string::npos)
+	{
+		if (!comment.empty())
+			gti.out += comment.substr(1) + "\n";
+		return;
+	}
+	code = code.substr(begin, code.find_last_not_of(" \t\r") - begin + 1);
+
+	uint64_t nameEnd = 0;
+	while (nameEnd < code.size() && isNasmIdentChar(code[nameEnd]))
+		++nameEnd;
+	if (nameEnd > 0 && nameEnd < code.size() && code[nameEnd] == ':')
+	{
+		auto name = code.substr(0, nameEnd);
+		auto escaped = escapeSymbol(gti, name);
+		if (name[0] != '.')
+			gti.lastLabel = name;
+		gti.out += escaped + ":\n";
+		begin = code.find_first_not_of(" \t", nameEnd + 1);
+		if (begin == std::string::npos)
+			return;
+		code = code.substr(begin);
+	}
+
+	auto space = code.find_first_of(" \t");
+	auto word = code.substr(0, space);
+	for (auto& c : word)
+		c = tolower(c);
+	std::string args;
+	if (space != std::string::npos)
+		args = code.substr(code.find_first_not_of(" \t", space));
+
+	if (word == "section" || word == "segment")
+		return translateSection(gti, args);
+	if (word == "global" || word == "extern")
+	{
+		for (auto& name : splitNasmOperands(args))
+			gti.out += std::string(word == "global" ? ".globl " : ".extern ") + escapeSymbol(gti, name.substr(0, name.find(':'))) + "\n";
+		return;
+	}
+	if (word == "bits")
+	{
+		gti.out += ".code" + args + "\n";
+		return;
+	}
+	if (word == "default")
+	{
+		gti.isDefaultRel = args == "rel";
+		return;
+	}
+	if (word == "align")
+	{
+		gti.out += "  .balign " + args + "\n";
+		return;
+	}
+	if (word == "db" || word == "dw" || word == "dd" || word == "dq")
+		return translateData(gti, word, args);
+
+	static const std::map<std::string, int> reserveSizes = { { "resb", 1 }, { "resw", 2 }, { "resd", 4 }, { "resq", 8 } };
+	auto itReserve = reserveSizes.find(word);
+	if (itReserve != reserveSizes.end())
+	{
+		std::string count;
+		translateExpression(gti, args, count);
+		gti.out += "  .zero " + std::to_string(itReserve->second) + "*(" + count + ")\n";
+		return;
+	}
+
+	if (word.empty() || !isalpha(word[0]) || word == "times" || word == "equ" || word == "incbin" || word == "struc" || word == "istruc")
+		THROW_ASSEMBLER_ERROR(gti.line, "'" + word + "' is not supported by the gas translation!");
+
+	// Instruction prefixes are kept as they are
+	static const std::set<std::string> prefixes = { "rep", "repe", "repz", "repne", "repnz", "lock" };
+	std::string prefix;
+	while (prefixes.count(word))
+	{
+		prefix += word + " ";
+		space = args.find_first_of(" \t");
+		word = args.substr(0, space);
+		for (auto& c : word)
+			c = tolower(c);
+		args = space == std::string::npos ? "" : args.substr(args.find_first_not_of(" \t", space));
+	}
+
+	gti.out += "  " + prefix + word;
+	if (!args.empty())
+	{
+		auto operands = splitNasmOperands(args);
+		for (uint64_t i = 0; i < operands.size(); ++i)
+			gti.out += (i == 0 ? " " : ", ") + translateOperand(gti, word, operands[i]);
+	}
+	gti.out += comment + "\n";
+}
+
+void translateToGas(const std::string& code, const std::function<void(const std::string&)>& write)
+{
+	GasTranslatorInfo gti;
+	gti.out = ".intel_syntax noprefix\n";
+
+	for (uint64_t begin = 0; begin < code.size();)
+	{
+		auto end = code.find('\n', begin);
+		if (end == std::string::npos)
+			end = code.size();
+		++gti.line;
+		translateLine(gti, code.substr(begin, end - begin));
+		begin = end + 1;
+
+		if (gti.out.size() >= GAS_TRANSLATOR_CHUNK_SIZE)
+		{
+			write(gti.out);
+			gti.out.clear();
+		}
+	}
+
+	write(gti.out);
+}
+
+std::string translateToGas(const std::string& code)
+{
+	std::string result;
+	translateToGas(code, [&](const std::string& chunk) { result += chunk; });
+	return result;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+#include <functional>
+
+// Translates the NASM code generated by genAsm (including inline assembly) into GNU as code (.intel_syntax noprefix).
+// Symbol names containing characters GNU as does not accept are escaped ('~' -> '$7E'), local labels are expanded,
+// data/reserve directives are replaced by their GNU as counterparts.
+// Throws an AssemblerError for NASM-only constructs (macros, 'times', 'equ', ...).
+std::string translateToGas(const std::string& code);
+
+// Same as above, but passes the translated code on in chunks while translating,
+// so e.g. the assembler can start working before the translation is complete.
+void translateToGas(const std::string& code, const std::function<void(const std::string&)>& write);
@@ -0,0 +1,374 @@
+#include "IR.h"
+
+#include <map>
+#include <cassert>
+#include <algorithm>
+
+int getIRTypeSize(IRType type)
+{
+	switch (type)
+	{
+	case IRType::Void: return 0;
+	case IRType::I8: return 1;
+	case IRType::I16: return 2;
+	case IRType::I32: return 4;
+	case IRType::I64: return 8;
+	}
+	assert(false && "Unknown IR type!");
+	return 0;
+}
+
+IRType getIRTypeFromSize(int size)
+{
+	switch (size)
+	{
+	case 0: return IRType::Void;
+	case 1: return IRType::I8;
+	case 2: return IRType::I16;
+	case 4: return IRType::I32;
+	case 8: return IRType::I64;
+	}
+	assert(false && "Invalid IR type size!");
+	return IRType::Void;
+}
+
+bool isTerminator(IROp op)
+{
+	return op == IROp::Jmp || op == IROp::Br || op == IROp::Ret || op == IROp::TailCall;
+}
+
+bool hasSideEffects(IROp op)
+{
+	switch (op)
+	{
+	case IROp::Store:
+	case IROp::Call:
+	case IROp::CallIndirect:
+	case IROp::UDiv: // Division by zero traps
+	case IROp::SDiv:
+	case IROp::URem:
+	case IROp::SRem:
+	case IROp::Jmp:
+	case IROp::Br:
+	case IROp::Ret:
+	case IROp::TailCall:
+		return true;
+	default:
+		return false;
+	}
+}
+
+std::vector<int> getSuccessors(const IRBlock& block)
+{
+	if (block.instrs.empty() || !isTerminator(block.instrs.back().op))
+		return {};
+	return block.instrs.back().targets;
+}
+
+std::vector<std::vector<int>> getPredecessors(const IRFunction& irFunc)
+{
+	std::vector<std::vector<int>> preds(irFunc.blocks.size());
+	for (auto& block : irFunc.blocks)
+		for (int succ : getSuccessors(block))
+			preds[succ].push_back(block.id);
+	return preds;
+}
+
+void removeUnreachableBlocks(IRFunction& irFunc)
+{
+	std::vector<bool> reachable(irFunc.blocks.size(), false);
+	std::vector<int> work = { 0 };
+	reachable[0] = true;
+	while (!work.empty())
+	{
+		int id = work.back();
+		work.pop_back();
+		for (int succ : getSuccessors(irFunc.blocks[id]))
+		{
+			if (reachable[succ])
+				continue;
+			reachable[succ] = true;
+			work.push_back(succ);
+		}
+	}
+
+	std::vector<int> newIDs(irFunc.blocks.size(), -1);
+	std::vector<IRBlock> blocks;
+	for (auto& block : irFunc.blocks)
+	{
+		if (!reachable[block.id])
+			continue;
+		newIDs[block.id] = blocks.size();
+		blocks.push_back(std::move(block));
+	}
+
+	for (auto& block : blocks)
+	{
+		block.id = newIDs[block.id];
+		for (auto& instr : block.instrs)
+		{
+			if (instr.op == IROp::Phi)
+			{
+				// Drop the incoming values of removed blocks
+				std::vector<int> args, targets;
+				for (uint64_t i = 0; i < instr.targets.size(); ++i)
+				{
+					if (newIDs[instr.targets[i]] == -1)
+						continue;
+					args.push_back(instr.args[i]);
+					targets.push_back(newIDs[instr.targets[i]]);
+				}
+				instr.args = args;
+				instr.targets = targets;
+			}
+			else
+			{
+				for (auto& target : instr.targets)
+					target = newIDs[target];
+			}
+		}
+	}
+
+	irFunc.blocks = std::move(blocks);
+}
+
+void removeDeadInstrs(IRFunction& irFunc)
+{
+	bool changed = true;
+	while (changed)
+	{
+		std::vector<int> useCounts(irFunc.valueTypes.size(), 0);
+		for (auto& block : irFunc.blocks)
+			for (auto& instr : block.instrs)
+				for (int arg : instr.args)
+					++useCounts[arg];
+
+		changed = false;
+		for (auto& block : irFunc.blocks)
+		{
+			auto isDead = [&](const IRInstr& instr)
+			{
+				return instr.result != -1 && useCounts[instr.result] == 0 && !hasSideEffects(instr.op);
+			};
+			auto it = std::remove_if(block.instrs.begin(), block.instrs.end(), isDead);
+			changed |= it != block.instrs.end();
+			block.instrs.erase(it, block.instrs.end());
+		}
+	}
+}
+
+void demoteTailCall(IRFunction& irFunc, IRBlock& block)
+{
+	auto& call = block.instrs.back();
+	call.op = IROp::Call;
+
+	IRInstr ret;
+	ret.op = IROp::Ret;
+	if (call.type != IRType::Void)
+	{
+		call.result = irFunc.valueTypes.size();
+		irFunc.valueTypes.push_back(call.type);
+		if (irFunc.retType != IRType::Void)
+			ret.args = { call.result };
+	}
+	block.instrs.push_back(ret);
+}
+
+void splitCriticalEdges(IRFunction& irFunc)
+{
+	uint64_t nBlocks = irFunc.blocks.size();
+	for (uint64_t i = 0; i < nBlocks; ++i)
+	{
+		auto succs = getSuccessors(irFunc.blocks[i]);
+		if (succs.size() < 2)
+			continue;
+
+		for (uint64_t j = 0; j < succs.size(); ++j)
+		{
+			int succ = succs[j];
+			auto& succInstrs = irFunc.blocks[succ].instrs;
+			if (succInstrs.empty() || succInstrs.front().op != IROp::Phi)
+				continue;
+
+			IRBlock edge;
+			edge.id = irFunc.blocks.size();
+			IRInstr jmp;
+			jmp.op = IROp::Jmp;
+			jmp.targets = { succ };
+			edge.instrs.push_back(jmp);
+
+			for (auto& instr : irFunc.blocks[succ].instrs)
+			{
+				if (instr.op != IROp::Phi)
+					break;
+				for (auto& target : instr.targets)
+					if (target == (int)i)
+						target = edge.id;
+			}
+
+			irFunc.blocks[i].instrs.back().targets[j] = edge.id;
+			irFunc.blocks.push_back(edge);
+		}
+	}
+}
+
+int getAddrArgCount(const IRInstr& instr)
+{
+	return (instr.addrBase == IRAddrBase::Value ? 1 : 0) + (instr.scale != 0 ? 1 : 0);
+}
+
+int getCondArgCount(const IRInstr& instr)
+{
+	if (instr.op != IROp::Cmp && !instr.isFusedCmp)
+		return 1;
+	return instr.isImmRhs ? 1 : 2;
+}
+
+std::string IRTypeToString(IRType type)
+{
+	switch (type)
+	{
+	case IRType::Void: return "void";
+	case IRType::I8: return "i8";
+	case IRType::I16: return "i16";
+	case IRType::I32: return "i32";
+	case IRType::I64: return "i64";
+	}
+	return "<unknown>";
+}
+
+std::string IROpToString(IROp op)
+{
+	static const std::map<IROp, std::string> names = {
+		{ IROp::None, "none" },
+		{ IROp::Const, "const" },
+		{ IROp::GlobalAddr, "globaladdr" },
+		{ IROp::FrameAddr, "frameaddr" },
+		{ IROp::Load, "load" },
+		{ IROp::Store, "store" },
+		{ IROp::Copy, "copy" },
+		{ IROp::Phi, "phi" },
+		{ IROp::Add, "add" },
+		{ IROp::Sub, "sub" },
+		{ IROp::Mul, "mul" },
+		{ IROp::UDiv, "udiv" },
+		{ IROp::SDiv, "sdiv" },
+		{ IROp::URem, "urem" },
+		{ IROp::SRem, "srem" },
+		{ IROp::And, "and" },
+		{ IROp::Or, "or" },
+		{ IROp::Xor, "xor" },
+		{ IROp::Shl, "shl" },
+		{ IROp::Shr, "shr" },
+		{ IROp::Neg, "neg" },
+		{ IROp::Not, "not" },
+		{ IROp::Cmp, "cmp" },
+		{ IROp::ZExt, "zext" },
+		{ IROp::SExt, "sext" },
+		{ IROp::Trunc, "trunc" },
+		{ IROp::Call, "call" },
+		{ IROp::CallIndirect, "callindirect" },
+		{ IROp::Select, "select" },
+		{ IROp::Jmp, "jmp" },
+		{ IROp::Br, "br" },
+		{ IROp::Ret, "ret" },
+		{ IROp::TailCall, "tailcall" },
+	};
+	auto it = names.find(op);
+	return it == names.end() ? "<unknown>" : it->second;
+}
+
+std::string IRCondToString(IRCond cond)
+{
+	switch (cond)
+	{
+	case IRCond::Eq: return "eq";
+	case IRCond::Ne: return "ne";
+	case IRCond::Lt: return "lt";
+	case IRCond::Le: return "le";
+	case IRCond::Gt: return "gt";
+	case IRCond::Ge: return "ge";
+	}
+	return "<unknown>";
+}
+
+void printIRInstr(std::ostream& out, const IRInstr& instr)
+{
+	out << "  ";
+	if (instr.result != -1)
+		out << "%" << instr.result << " = ";
+	out << IROpToString(instr.op);
+	if (instr.op == IROp::Cmp || instr.isFusedCmp)
+		out << " " << IRCondToString(instr.cond);
+	if (instr.type != IRType::Void)
+		out << " " << IRTypeToString(instr.type);
+
+	bool first = true;
+	auto sep = [&]() -> std::ostream& { out << (first ? " " : ", "); first = false; return out; };
+
+	switch (instr.op)
+	{
+	case IROp::Const:
+		sep() << instr.imm;
+		break;
+	case IROp::FrameAddr:
+		sep() << (instr.imm < 0 ? "-" : "+") << (instr.imm < 0 ? -instr.imm : instr.imm);
+		break;
+	case IROp::GlobalAddr:
+	case IROp::Call:
+	case IROp::TailCall:
+		sep() << instr.name;
+		break;
+	default:
+		break;
+	}
+
+	if ((instr.op == IROp::Load || instr.op == IROp::Store) && (instr.addrBase != IRAddrBase::Value || instr.scale != 0 || instr.imm != 0))
+	{
+		// [base + %index * scale + disp]
+		sep() << "[";
+		int arg = 0;
+		if (instr.addrBase == IRAddrBase::Value)
+			out << "%" << instr.args[arg++];
+		else
+			out << (instr.addrBase == IRAddrBase::Frame ? "frame" : instr.name);
+		if (instr.scale != 0)
+			out << " + %" << instr.args[arg++] << " * " << instr.scale;
+		if (instr.imm != 0)
+			out << (instr.imm < 0 ? " - " : " + ") << (instr.imm < 0 ? -instr.imm : instr.imm);
+		out << "]";
+		if (instr.op == IROp::Store)
+			sep() << "%" << instr.args.back();
+		out << "\n";
+		return;
+	}
+
+	if (instr.op == IROp::Phi)
+	{
+		for (uint64_t i = 0; i < instr.args.size(); ++i)
+			sep() << "[%" << instr.args[i] << ", bb" << instr.targets[i] << "]";
+		out << "\n";
+		return;
+	}
+
+	for (uint64_t i = 0; i < instr.args.size(); ++i)
+	{
+		sep() << "%" << instr.args[i];
+		if (instr.isImmRhs && i == 0)
+			sep() << instr.imm;
+	}
+	for (int target : instr.targets)
+		sep() << "bb" << target;
+	out << "\n";
+}
+
+void printIRFunction(std::ostream& out, const IRFunction& irFunc)
+{
+	out << "fn " << irFunc.name << " -> " << IRTypeToString(irFunc.retType) << " (frame " << irFunc.frameSize << "):\n";
+	for (auto& block : irFunc.blocks)
+	{
+		out << "bb" << block.id << ":\n";
+		for (auto& instr : block.instrs)
+			printIRInstr(out, instr);
+	}
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <set>
+#include <ostream>
+#include <cstdint>
+
+#include "Symbols.h"
+
+// Types only describe the width of a value, signedness is part of the operations.
+enum class IRType
+{
+	Void,
+	I8,
+	I16,
+	I32,
+	I64,
+};
+
+enum class IROp
+{
+	None,
+
+	Const, // imm
+	GlobalAddr, // name: Label of a global variable, function or string
+	FrameAddr, // imm: Offset relative to the frame base
+	Load, // args: address
+	Store, // args: address, value; type: Stored type
+	Copy, // args: value
+	Phi, // args: Incoming values; targets: Incoming blocks
+
+	Add,
+	Sub,
+	Mul,
+	UDiv,
+	SDiv,
+	URem,
+	SRem,
+	And,
+	Or,
+	Xor,
+	Shl,
+	Shr,
+	Neg,
+	Not,
+	Cmp, // cond; args: lhs, rhs; Result is 0 or 1 (I8)
+
+	ZExt, // args: value
+	SExt, // args: value
+	Trunc, // args: value
+
+	Call, // name: Label of the callee; args: parameters
+	CallIndirect, // args: callee address, parameters
+
+	Select, // args: condition, true value, false value; result: true value if condition != 0, false value otherwise
+
+	Jmp, // targets: block
+	Br, // args: condition; targets: block (condition != 0), block (condition == 0)
+	Ret, // args: [value]
+	TailCall, // name: Label of the callee; args: parameters; Returns the result of the callee from the function
+};
+
+// Comparisons are signed for all operand types, just like the legacy code generator does it.
+enum class IRCond
+{
+	Eq,
+	Ne,
+	Lt,
+	Le,
+	Gt,
+	Ge,
+};
+
+// Base of the address of Load/Store instructions
+enum class IRAddrBase
+{
+	Value, // The first argument
+	Frame, // The frame base (rbp)
+	Label, // The label in 'name'
+};
+
+struct IRInstr
+{
+	IROp op = IROp::None;
+	IRType type = IRType::Void; // Type of the result (Store: Stored type)
+	int result = -1; // Value ID of the result, -1 if there is none
+	std::vector<int> args; // Value IDs of the operands
+	std::vector<int> targets; // Block IDs
+	int64_t imm = 0;
+	std::string name;
+	IRCond cond = IRCond::Eq;
+
+	// Br/Select: The condition is the comparison of the leading arguments with 'cond' (instead of a condition value)
+	bool isFusedCmp = false;
+	// Binary operations, Cmp, fused Br/Select: The right operand is 'imm' (instead of the last argument)
+	bool isImmRhs = false;
+
+	// Address of Load/Store instructions: [base + index * scale + imm]
+	// The index argument follows the base argument (if any), the stored value is always the last argument.
+	IRAddrBase addrBase = IRAddrBase::Value;
+	int scale = 0; // 0 if there is no index
+};
+
+struct IRBlock
+{
+	int id = 0;
+	std::vector<IRInstr> instrs;
+};
+
+struct IRFunction
+{
+	std::string name; // Mangled name
+	SymbolRef func;
+	std::vector<IRBlock> blocks; // The first block is the entry block
+	std::vector<IRType> valueTypes; // Value ID -> type
+	int frameSize = 0; // Size of the local variables below the frame base
+	int retOffset = 16; // 0 if the value is returned in rax
+	int nRegParams = 0; // Number of parameters passed in registers (stored below the frame base by the prologue)
+	IRType retType = IRType::Void;
+	bool isRetSigned = false;
+	std::set<int> usedStringIDs;
+};
+typedef std::shared_ptr<IRFunction> IRFunctionRef;
+
+int getIRTypeSize(IRType type);
+IRType getIRTypeFromSize(int size);
+
+bool isTerminator(IROp op);
+bool hasSideEffects(IROp op);
+
+// Returns the IDs of the blocks the terminator of the block can jump to.
+std::vector<int> getSuccessors(const IRBlock& block);
+std::vector<std::vector<int>> getPredecessors(const IRFunction& irFunc);
+
+// Removes blocks that cannot be reached from the entry block and renumbers the remaining ones.
+void removeUnreachableBlocks(IRFunction& irFunc);
+
+// Removes instructions without side effects whose results are never used.
+void removeDeadInstrs(IRFunction& irFunc);
+
+// Replaces the tail call terminating the block by a call followed by a return of its result.
+void demoteTailCall(IRFunction& irFunc, IRBlock& block);
+
+// Inserts empty blocks on edges from blocks with multiple successors to blocks starting with phi instructions.
+void splitCriticalEdges(IRFunction& irFunc);
+
+// Returns the number of arguments forming the address of a Load/Store instruction
+int getAddrArgCount(const IRInstr& instr);
+// Returns the number of arguments forming the condition of a Cmp/Br/Select instruction
+int getCondArgCount(const IRInstr& instr);
+
+std::string IRTypeToString(IRType type);
+std::string IROpToString(IROp op);
+std::string IRCondToString(IRCond cond);
+
+void printIRFunction(std::ostream& out, const IRFunction& irFunc);
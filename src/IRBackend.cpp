@@ -0,0 +1,1350 @@
+#include "IRBackend.h"
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <functional>
+#include <map>
+#include <utility>
+
+#include "IRRegAlloc.h"
+#include "IRPromote.h"
+#include "Program.h"
+
+#define SCRATCH_REG IRReg::RAX
+#define SCRATCH_REG_2 IRReg::R11
+
+static const IRReg regParams[MAX_REG_PARAM_COUNT] = { IRReg::RDI, IRReg::RSI, IRReg::RDX, IRReg::RCX, IRReg::R8, IRReg::R9 };
+
+// Values get registers assigned by the linear scan allocator, spilled values and
+// saved callee-saved registers live below the local variables of the function.
+struct IRBackendInfo
+{
+	AsmBuffer* pOut;
+	IRFunction* irFunc;
+	IRRegAllocation alloc;
+	std::vector<std::pair<IRReg, int>> savedRegs; // Callee-saved register -> frame offset
+};
+
+std::string sizeSpec(IRType type)
+{
+	switch (type)
+	{
+	case IRType::I8: return "BYTE";
+	case IRType::I16: return "WORD";
+	case IRType::I32: return "DWORD";
+	case IRType::I64: return "QWORD";
+	default: break;
+	}
+	assert(false && "Invalid IR type!");
+	return "";
+}
+
+IRType valueType(IRBackendInfo& ibi, int value)
+{
+	return ibi.irFunc->valueTypes[value];
+}
+
+bool inReg(IRBackendInfo& ibi, int value)
+{
+	return ibi.alloc.valueRegs[value] != -1;
+}
+
+IRReg valueReg(IRBackendInfo& ibi, int value)
+{
+	return (IRReg)ibi.alloc.valueRegs[value];
+}
+
+int spillOffset(IRBackendInfo& ibi, int value)
+{
+	return ibi.irFunc->frameSize + 8 * (ibi.alloc.valueSpillSlots[value] + 1);
+}
+
+// Returns the register or memory operand of the value
+std::string loc(IRBackendInfo& ibi, int value, IRType type)
+{
+	if (inReg(ibi, value))
+		return IRRegName(valueReg(ibi, value), type);
+	return sizeSpec(type) + " [rbp - " + std::to_string(spillOffset(ibi, value)) + "]";
+}
+
+std::string loc(IRBackendInfo& ibi, int value)
+{
+	return loc(ibi, value, valueType(ibi, value));
+}
+
+std::string blockLabel(IRBackendInfo& ibi, int block)
+{
+	return ibi.irFunc->name + "#bb" + std::to_string(block);
+}
+
+void genMove(IRBackendInfo& ibi, const std::string& dest, const std::string& src)
+{
+	if (dest != src)
+		*ibi.pOut << "  mov " << dest << ", " << src << "\n";
+}
+
+// Returns the register the result of the instruction gets computed in
+IRReg resultReg(IRBackendInfo& ibi, const IRInstr& instr)
+{
+	return inReg(ibi, instr.result) ? valueReg(ibi, instr.result) : SCRATCH_REG;
+}
+
+// Moves the result from the register it was computed in to its location
+void storeResult(IRBackendInfo& ibi, const IRInstr& instr, IRReg reg)
+{
+	genMove(ibi, loc(ibi, instr.result), IRRegName(reg, instr.type));
+}
+
+// Returns a register holding the value (loads spilled values into the scratch register)
+IRReg valueInReg(IRBackendInfo& ibi, int value, IRReg scratch, IRType type)
+{
+	if (inReg(ibi, value))
+		return valueReg(ibi, value);
+	genMove(ibi, IRRegName(scratch, type), loc(ibi, value, type));
+	return scratch;
+}
+
+// Performs all moves as if they happened at the same time
+void genParallelMove(IRBackendInfo& ibi, std::vector<std::pair<std::string, std::string>> moves)
+{
+	auto isMem = [](const std::string& operand) { return operand.find('[') != std::string::npos; };
+	auto emitMove = [&](const std::string& dest, const std::string& src)
+	{
+		if (isMem(dest) && isMem(src))
+		{
+			genMove(ibi, IRRegName(SCRATCH_REG, IRType::I64), src);
+			genMove(ibi, dest, IRRegName(SCRATCH_REG, IRType::I64));
+		}
+		else
+		{
+			genMove(ibi, dest, src);
+		}
+	};
+
+	while (!moves.empty())
+	{
+		bool progress = false;
+		for (auto it = moves.begin(); it != moves.end(); ++it)
+		{
+			bool isRead = false;
+			for (auto& [dest, src] : moves)
+				isRead |= src == it->first;
+			if (isRead)
+				continue;
+
+			emitMove(it->first, it->second);
+			moves.erase(it);
+			progress = true;
+			break;
+		}
+
+		if (progress)
+			continue;
+
+		// Every destination is still read by another move (cycle), park one of them in the second scratch register
+		auto blocked = moves.front().first;
+		auto scratch = IRRegName(SCRATCH_REG_2, IRType::I64);
+		genMove(ibi, scratch, blocked);
+		for (auto& [dest, src] : moves)
+			if (src == blocked)
+				src = scratch;
+	}
+}
+
+// Copies the incoming values of the phi instructions in the successor block
+void genPhiCopies(IRBackendInfo& ibi, int fromBlock, int toBlock)
+{
+	std::vector<std::pair<std::string, std::string>> moves; // (Destination, source)
+	for (auto& instr : ibi.irFunc->blocks[toBlock].instrs)
+	{
+		if (instr.op != IROp::Phi)
+			break;
+		for (uint64_t i = 0; i < instr.targets.size(); ++i)
+		{
+			if (instr.targets[i] != fromBlock)
+				continue;
+			auto dest = loc(ibi, instr.result, IRType::I64);
+			auto src = loc(ibi, instr.args[i], IRType::I64);
+			if (dest != src)
+				moves.push_back({ dest, src });
+		}
+	}
+
+	genParallelMove(ibi, moves);
+}
+
+std::string condSuffix(IRCond cond)
+{
+	switch (cond)
+	{
+	case IRCond::Eq: return "e";
+	case IRCond::Ne: return "ne";
+	case IRCond::Lt: return "l";
+	case IRCond::Le: return "le";
+	case IRCond::Gt: return "g";
+	case IRCond::Ge: return "ge";
+	}
+	return "";
+}
+
+std::string invertCondSuffix(const std::string& suffix)
+{
+	static const std::map<std::string, std::string> inverted = {
+		{ "e", "ne" }, { "ne", "e" }, { "l", "ge" }, { "ge", "l" }, { "le", "g" }, { "g", "le" },
+	};
+	return inverted.at(suffix);
+}
+
+// Emits the comparison of a Cmp/Br/Select instruction and returns the condition code suffix that is set if the condition holds
+std::string genCondition(IRBackendInfo& ibi, const IRInstr& instr)
+{
+	auto& out = *ibi.pOut;
+
+	int lhs = instr.args[0];
+	if (instr.op != IROp::Cmp && !instr.isFusedCmp)
+	{
+		if (inReg(ibi, lhs))
+			out << "  test " << loc(ibi, lhs) << ", " << loc(ibi, lhs) << "\n";
+		else
+			out << "  cmp " << loc(ibi, lhs) << ", 0\n";
+		return "ne";
+	}
+
+	if (instr.isImmRhs)
+	{
+		if (instr.imm == 0 && inReg(ibi, lhs))
+			out << "  test " << loc(ibi, lhs) << ", " << loc(ibi, lhs) << "\n";
+		else
+			out << "  cmp " << loc(ibi, lhs) << ", " << instr.imm << "\n";
+	}
+	else if (inReg(ibi, lhs) || inReg(ibi, instr.args[1]))
+	{
+		out << "  cmp " << loc(ibi, lhs) << ", " << loc(ibi, instr.args[1]) << "\n";
+	}
+	else
+	{
+		IRType type = valueType(ibi, lhs);
+		genMove(ibi, IRRegName(SCRATCH_REG, type), loc(ibi, lhs));
+		out << "  cmp " << IRRegName(SCRATCH_REG, type) << ", " << loc(ibi, instr.args[1]) << "\n";
+	}
+	return condSuffix(instr.cond);
+}
+
+// cmov has no 8 bit form, so smaller values are selected in 32 bit registers
+void genSelect(IRBackendInfo& ibi, const IRInstr& instr)
+{
+	auto& out = *ibi.pOut;
+
+	std::string cc = genCondition(ibi, instr);
+	int trueVal = instr.args[instr.args.size() - 2];
+	int falseVal = instr.args.back();
+
+	IRReg reg = resultReg(ibi, instr);
+	if (inReg(ibi, trueVal) && valueReg(ibi, trueVal) == reg)
+	{
+		std::swap(trueVal, falseVal);
+		cc = invertCondSuffix(cc);
+	}
+
+	IRType cmovType = instr.type == IRType::I64 ? IRType::I64 : IRType::I32;
+	std::string src;
+	if (inReg(ibi, trueVal))
+		src = IRRegName(valueReg(ibi, trueVal), cmovType);
+	else if (cmovType == instr.type)
+		src = loc(ibi, trueVal);
+	else
+	{
+		out << "  movzx " << IRRegName(SCRATCH_REG_2, IRType::I32) << ", " << loc(ibi, trueVal) << "\n";
+		src = IRRegName(SCRATCH_REG_2, IRType::I32);
+	}
+
+	genMove(ibi, IRRegName(reg, instr.type), loc(ibi, falseVal));
+	out << "  cmov" << cc << " " << IRRegName(reg, cmovType) << ", " << src << "\n";
+	storeResult(ibi, instr, reg);
+}
+
+// Truncates the constant to the width of the type and sign-/zero-extends it back to 64 bit
+int64_t normalizeImm(int64_t imm, IRType type, bool isSigned)
+{
+	int bits = 8 * getIRTypeSize(type);
+	if (bits == 64)
+		return imm;
+	uint64_t value = (uint64_t)imm & ((1ull << bits) - 1);
+	if (isSigned && (value >> (bits - 1)))
+		value |= ~0ull << bits;
+	return value;
+}
+
+// Returns the immediate operand of the instruction as a value of its type
+int64_t immValue(const IRInstr& instr, bool isSigned)
+{
+	return normalizeImm(instr.imm, instr.type, isSigned);
+}
+
+bool isPowerOfTwo(uint64_t value)
+{
+	return value != 0 && (value & (value - 1)) == 0;
+}
+
+int floorLog2(uint64_t value)
+{
+	int result = 0;
+	while (value >>= 1)
+		++result;
+	return result;
+}
+
+// Emits 'mnemonic dest, imm', the immediate is moved to the second scratch register if it doesn't fit into 32 bit
+void genImmOp(IRBackendInfo& ibi, const std::string& mnemonic, const std::string& dest, int64_t imm)
+{
+	auto& out = *ibi.pOut;
+	if (imm >= INT_MIN && imm <= INT_MAX)
+	{
+		out << "  " << mnemonic << " " << dest << ", " << imm << "\n";
+		return;
+	}
+	out << "  mov " << IRRegName(SCRATCH_REG_2, IRType::I64) << ", " << imm << "\n";
+	out << "  " << mnemonic << " " << dest << ", " << IRRegName(SCRATCH_REG_2, IRType::I64) << "\n";
+}
+
+// Loads the value sign-/zero-extended to 64 bit into the register
+void genExtendedLoad(IRBackendInfo& ibi, IRReg reg, int value, bool isSigned)
+{
+	auto& out = *ibi.pOut;
+	IRType type = valueType(ibi, value);
+	if (type == IRType::I64)
+		genMove(ibi, IRRegName(reg, IRType::I64), loc(ibi, value));
+	else if (type == IRType::I32 && !isSigned)
+		out << "  mov " << IRRegName(reg, IRType::I32) << ", " << loc(ibi, value) << "\n"; // Clears the upper half
+	else
+		out << "  " << (isSigned ? (type == IRType::I32 ? "movsxd " : "movsx ") : "movzx ") << IRRegName(reg, isSigned ? IRType::I64 : IRType::I32) << ", " << loc(ibi, value) << "\n";
+}
+
+// Returns floor((hi * 2^64 + lo) / divisor), the quotient must fit into 64 bit (hi < divisor)
+uint64_t divideU128(uint64_t hi, uint64_t lo, uint64_t divisor)
+{
+	uint64_t quotient = 0;
+	for (int i = 0; i < 64; ++i)
+	{
+		bool carry = hi >> 63;
+		hi = (hi << 1) | (lo >> 63);
+		lo <<= 1;
+		quotient <<= 1;
+		if (carry || hi >= divisor)
+		{
+			hi -= divisor;
+			quotient |= 1;
+		}
+	}
+	return quotient;
+}
+
+// Finds the smallest 'shift' for which floor(n * magic / 2^(64 + shift)) == floor(n / divisor) holds for all n < 2^bits.
+// Returns false if the magic number doesn't fit into 64 bit.
+bool findUnsignedMagic(uint64_t divisor, int bits, uint64_t& magic, int& shift)
+{
+	for (shift = 0; shift < 64; ++shift)
+	{
+		uint64_t powerHi = (uint64_t)1 << shift; // 2^(64 + shift) == powerHi * 2^64
+		if (powerHi >= divisor)
+			return false;
+		uint64_t m = divideU128(powerHi, 0, divisor) + 1;
+		if (m == 0)
+			return false;
+		// The rounding error must stay below 1/divisor for all dividends.
+		// m * divisor - 2^(64 + shift) lies in [0, divisor), so it equals the low 64 bit of the product.
+		uint64_t error = m * divisor;
+		if (64 + shift - bits >= 64 || error <= (uint64_t)1 << (64 + shift - bits))
+		{
+			magic = m;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Signed magic number and shift for |divisor| >= 2 (Hacker's Delight, chapter 10)
+void findSignedMagic(int64_t divisor, int64_t& magic, int& shift)
+{
+	const uint64_t two63 = 1ull << 63;
+	uint64_t ad = divisor < 0 ? -(uint64_t)divisor : divisor;
+	uint64_t t = two63 + ((uint64_t)divisor >> 63);
+	uint64_t anc = t - 1 - t % ad;
+	uint64_t q1 = two63 / anc, r1 = two63 - q1 * anc;
+	uint64_t q2 = two63 / ad, r2 = two63 - q2 * ad;
+	uint64_t delta;
+	int p = 63;
+	do
+	{
+		++p;
+		q1 *= 2, r1 *= 2;
+		if (r1 >= anc)
+			++q1, r1 -= anc;
+		q2 *= 2, r2 *= 2;
+		if (r2 >= ad)
+			++q2, r2 -= ad;
+		delta = ad - r2;
+	} while (q1 < delta || (q1 == delta && r1 == 0));
+
+	magic = q2 + 1;
+	if (divisor < 0)
+		magic = -magic;
+	shift = p - 64;
+}
+
+// Division/remainder by a constant: shifts and masks for powers of two, multiplications with the reciprocal otherwise.
+// Narrower values get extended and divided as 64 bit values.
+void genConstDivision(IRBackendInfo& ibi, const IRInstr& instr)
+{
+	auto& out = *ibi.pOut;
+	bool isSigned = instr.op == IROp::SDiv || instr.op == IROp::SRem;
+	bool isRem = instr.op == IROp::URem || instr.op == IROp::SRem;
+	int bits = 8 * getIRTypeSize(instr.type);
+	int64_t divisor = immValue(instr, isSigned);
+	uint64_t absDivisor = divisor < 0 && isSigned ? -(uint64_t)divisor : divisor;
+	int dividend = instr.args[0];
+
+	genExtendedLoad(ibi, IRReg::RAX, dividend, isSigned);
+
+	if (!isSigned && isPowerOfTwo(absDivisor))
+	{
+		int k = floorLog2(absDivisor);
+		if (isRem)
+			genImmOp(ibi, "and", "rax", absDivisor - 1);
+		else if (k != 0)
+			out << "  shr rax, " << k << "\n";
+		storeResult(ibi, instr, IRReg::RAX);
+		return;
+	}
+
+	if (isSigned && isPowerOfTwo(absDivisor))
+	{
+		// Dividends get rounded towards zero by adding divisor - 1 to negative ones
+		int k = floorLog2(absDivisor);
+		out << "  mov rdx, rax\n";
+		if (k != 0)
+		{
+			if (k != 1)
+				out << "  sar rdx, 63\n";
+			out << "  shr rdx, " << 64 - k << "\n";
+			out << "  add rdx, rax\n";
+		}
+		if (isRem)
+		{
+			genImmOp(ibi, "and", "rdx", -(int64_t)absDivisor);
+			out << "  sub rax, rdx\n";
+			storeResult(ibi, instr, IRReg::RAX);
+			return;
+		}
+		if (k != 0)
+			out << "  sar rdx, " << k << "\n";
+		if (divisor < 0)
+			out << "  neg rdx\n";
+		storeResult(ibi, instr, IRReg::RDX);
+		return;
+	}
+
+	uint64_t magic;
+	int shift;
+	if (!isSigned && findUnsignedMagic(absDivisor, bits, magic, shift))
+	{
+		out << "  mov r11, " << magic << "\n";
+		out << "  mul r11\n";
+		if (shift != 0)
+			out << "  shr rdx, " << shift << "\n";
+	}
+	else if (!isSigned)
+	{
+		// The magic number needs 65 bit, its top bit gets added separately (only happens for 64 bit dividends)
+		int l = floorLog2(absDivisor - 1) + 1;
+		uint64_t m = divideU128(((uint64_t)2 << (l - 1)) - absDivisor, 0, absDivisor) + 1;
+		out << "  mov r11, " << m << "\n";
+		out << "  mul r11\n";
+		genMove(ibi, "rax", loc(ibi, dividend));
+		out << "  sub rax, rdx\n";
+		out << "  shr rax, 1\n";
+		out << "  add rdx, rax\n";
+		if (l != 1)
+			out << "  shr rdx, " << l - 1 << "\n";
+	}
+	else
+	{
+		int64_t signedMagic;
+		findSignedMagic(divisor, signedMagic, shift);
+		out << "  mov r11, " << signedMagic << "\n";
+		out << "  imul r11\n";
+		if (divisor > 0 && signedMagic < 0)
+		{
+			genExtendedLoad(ibi, IRReg::RAX, dividend, true);
+			out << "  add rdx, rax\n";
+		}
+		else if (divisor < 0 && signedMagic > 0)
+		{
+			genExtendedLoad(ibi, IRReg::RAX, dividend, true);
+			out << "  sub rdx, rax\n";
+		}
+		if (shift != 0)
+			out << "  sar rdx, " << shift << "\n";
+		// Round towards zero
+		out << "  mov rax, rdx\n";
+		out << "  shr rax, 63\n";
+		out << "  add rdx, rax\n";
+	}
+
+	if (isRem)
+	{
+		// n % d = n - n / d * d
+		genImmOp(ibi, "imul", "rdx", divisor);
+		genExtendedLoad(ibi, IRReg::RAX, dividend, isSigned);
+		out << "  sub rax, rdx\n";
+		storeResult(ibi, instr, IRReg::RAX);
+		return;
+	}
+	storeResult(ibi, instr, IRReg::RDX);
+}
+
+// Binary operation with an immediate right operand, multiplications get reduced to shifts and lea where possible
+void genImmArithmetic(IRBackendInfo& ibi, const IRInstr& instr)
+{
+	auto& out = *ibi.pOut;
+	IRReg reg = resultReg(ibi, instr);
+	int lhs = instr.args[0];
+
+	if (instr.op != IROp::Mul)
+	{
+		genMove(ibi, IRRegName(reg, instr.type), loc(ibi, lhs));
+		out << "  " << IROpToString(instr.op) << " " << IRRegName(reg, instr.type) << ", " << immValue(instr, true) << "\n";
+	}
+	else if (isPowerOfTwo(immValue(instr, false)))
+	{
+		genMove(ibi, IRRegName(reg, instr.type), loc(ibi, lhs));
+		int k = floorLog2(immValue(instr, false));
+		if (k != 0)
+			out << "  shl " << IRRegName(reg, instr.type) << ", " << k << "\n";
+	}
+	else if (immValue(instr, false) == 3 || immValue(instr, false) == 5 || immValue(instr, false) == 9)
+	{
+		// 32 bit destinations keep the upper half of the register cleared
+		auto src = IRRegName(valueInReg(ibi, lhs, reg, instr.type), IRType::I64);
+		out << "  lea " << IRRegName(reg, instr.type == IRType::I64 ? IRType::I64 : IRType::I32) << ", [" << src << " + " << src << "*" << immValue(instr, false) - 1 << "]\n";
+	}
+	else
+	{
+		// There are no 8 bit multiplications with immediates, the lower 8 bit of the 32 bit product are the same
+		IRType type = instr.type == IRType::I8 ? IRType::I32 : instr.type;
+		auto src = IRRegName(valueInReg(ibi, lhs, reg, instr.type), type);
+		out << "  imul " << IRRegName(reg, type) << ", " << src << ", " << immValue(instr, true) << "\n";
+	}
+	storeResult(ibi, instr, reg);
+}
+
+void genDivision(IRBackendInfo& ibi, const IRInstr& instr)
+{
+	auto& out = *ibi.pOut;
+	bool isSigned = instr.op == IROp::SDiv || instr.op == IROp::SRem;
+	bool isRem = instr.op == IROp::URem || instr.op == IROp::SRem;
+
+	// The allocator keeps the operands out of rdx
+	if (instr.isImmRhs)
+	{
+		genConstDivision(ibi, instr);
+		return;
+	}
+
+	genMove(ibi, IRRegName(IRReg::RAX, instr.type), loc(ibi, instr.args[0]));
+	if (instr.type == IRType::I8)
+	{
+		// 8 bit divisions divide ax and store the remainder in ah
+		out << (isSigned ? "  cbw\n" : "  movzx eax, al\n");
+		out << "  " << (isSigned ? "idiv " : "div ") << loc(ibi, instr.args[1]) << "\n";
+		if (isRem)
+			out << "  mov al, ah\n";
+		storeResult(ibi, instr, IRReg::RAX);
+		return;
+	}
+
+	// Signed dividends get sign extended into rdx
+	if (isSigned)
+		out << "  " << (instr.type == IRType::I16 ? "cwd" : (instr.type == IRType::I32 ? "cdq" : "cqo")) << "\n";
+	else
+		out << "  xor edx, edx\n";
+	out << "  " << (isSigned ? "idiv " : "div ") << loc(ibi, instr.args[1]) << "\n";
+	storeResult(ibi, instr, isRem ? IRReg::RDX : IRReg::RAX);
+}
+
+// Returns the memory operand of a load/store, spilled base/index values are loaded into the scratch registers
+std::string memOperand(IRBackendInfo& ibi, const IRInstr& instr, IRReg indexScratch)
+{
+	std::string addr;
+	int arg = 0;
+	switch (instr.addrBase)
+	{
+	case IRAddrBase::Value:
+		addr = IRRegName(valueInReg(ibi, instr.args[arg++], SCRATCH_REG, IRType::I64), IRType::I64);
+		break;
+	case IRAddrBase::Frame:
+		addr = "rbp";
+		break;
+	case IRAddrBase::Label:
+		addr = instr.name;
+		break;
+	}
+
+	if (instr.scale != 0)
+	{
+		addr += " + " + IRRegName(valueInReg(ibi, instr.args[arg++], indexScratch, IRType::I64), IRType::I64);
+		if (instr.scale != 1)
+			addr += "*" + std::to_string(instr.scale);
+	}
+
+	if (instr.imm != 0)
+		addr += (instr.imm < 0 ? " - " : " + ") + std::to_string(instr.imm < 0 ? -instr.imm : instr.imm);
+
+	return sizeSpec(instr.type) + " [" + addr + "]";
+}
+
+void genStore(IRBackendInfo& ibi, const IRInstr& instr)
+{
+	auto& out = *ibi.pOut;
+	int value = instr.args.back();
+
+	// Both scratch registers are needed for the address, compute it into the first one
+	bool needsIndexScratch = instr.scale != 0 && !inReg(ibi, instr.args[getAddrArgCount(instr) - 1]);
+	if (needsIndexScratch && !inReg(ibi, value))
+	{
+		int base = instr.addrBase == IRAddrBase::Value ? instr.args[0] : -1;
+		genMove(ibi, "rax", loc(ibi, instr.args[getAddrArgCount(instr) - 1], IRType::I64));
+		out << "  lea rax, [";
+		if (instr.addrBase == IRAddrBase::Frame)
+			out << "rbp + ";
+		else if (instr.addrBase == IRAddrBase::Label)
+			out << instr.name << " + ";
+		out << "rax";
+		if (instr.scale != 1)
+			out << "*" << instr.scale;
+		if (instr.imm != 0)
+			out << (instr.imm < 0 ? " - " : " + ") << (instr.imm < 0 ? -instr.imm : instr.imm);
+		out << "]\n";
+		if (base != -1)
+			out << "  add rax, " << loc(ibi, base, IRType::I64) << "\n";
+		genMove(ibi, IRRegName(SCRATCH_REG_2, instr.type), loc(ibi, value, instr.type));
+		out << "  mov " << sizeSpec(instr.type) << " [rax], " << IRRegName(SCRATCH_REG_2, instr.type) << "\n";
+		return;
+	}
+
+	// The reloads of spilled base/index values must be emitted before the store itself
+	auto mem = memOperand(ibi, instr, SCRATCH_REG_2);
+	IRReg valueReg = valueInReg(ibi, value, SCRATCH_REG_2, instr.type);
+	out << "  mov " << mem << ", " << IRRegName(valueReg, instr.type) << "\n";
+}
+
+// Calls always use the register calling convention (see usesRegCallConv)
+void genCall(IRBackendInfo& ibi, const IRInstr& instr)
+{
+	auto& out = *ibi.pOut;
+	int firstParam = instr.op == IROp::CallIndirect ? 1 : 0;
+	int nParams = instr.args.size() - firstParam;
+	int nRegParams = std::min(nParams, MAX_REG_PARAM_COUNT);
+
+	for (int i = nParams - 1; i >= nRegParams; --i)
+		out << "  push " << loc(ibi, instr.args[firstParam + i], IRType::I64) << "\n";
+
+	// The callee address may live in one of the parameter registers
+	if (firstParam == 1)
+		genMove(ibi, IRRegName(SCRATCH_REG, IRType::I64), loc(ibi, instr.args[0], IRType::I64));
+
+	std::vector<std::pair<std::string, std::string>> moves;
+	for (int i = 0; i < nRegParams; ++i)
+		moves.push_back({ IRRegName(regParams[i], IRType::I64), loc(ibi, instr.args[firstParam + i], IRType::I64) });
+	genParallelMove(ibi, moves);
+
+	if (firstParam == 1)
+		out << "  call " << IRRegName(SCRATCH_REG, IRType::I64) << "\n";
+	else
+		out << "  call " << instr.name << "\n";
+
+	if (instr.imm > 0)
+		out << "  add rsp, " << instr.imm << "\n";
+
+	if (instr.type != IRType::Void)
+		storeResult(ibi, instr, IRReg::RAX);
+}
+
+// Restores the callee-saved registers and the frame of the caller
+void genFrameRelease(IRBackendInfo& ibi)
+{
+	auto& out = *ibi.pOut;
+	for (auto& [reg, offset] : ibi.savedRegs)
+		out << "  mov " << IRRegName(reg, IRType::I64) << ", [rbp - " << offset << "]\n";
+	out << "  mov rsp, rbp\n";
+	out << "  pop rbp\n";
+}
+
+void genRet(IRBackendInfo& ibi, const IRInstr& instr)
+{
+	auto& out = *ibi.pOut;
+	if (!instr.args.empty())
+	{
+		// The return value is always stored with 8 bytes
+		int value = instr.args[0];
+		IRType type = valueType(ibi, value);
+		if (type == IRType::I64)
+			genMove(ibi, "rax", loc(ibi, value));
+		else if (ibi.irFunc->isRetSigned)
+			out << "  " << (type == IRType::I32 ? "movsxd" : "movsx") << " rax, " << loc(ibi, value) << "\n";
+		else if (type == IRType::I32)
+			out << "  mov eax, " << loc(ibi, value) << "\n";
+		else
+			out << "  movzx eax, " << loc(ibi, value) << "\n";
+		if (ibi.irFunc->retOffset != 0)
+			out << "  mov [rbp + " << ibi.irFunc->retOffset << "], rax\n";
+	}
+	genFrameRelease(ibi);
+	out << "  ret\n";
+}
+
+// The callee takes over the return address, so it returns directly to the caller of this function
+void genTailCall(IRBackendInfo& ibi, const IRInstr& instr)
+{
+	auto& out = *ibi.pOut;
+	std::vector<std::pair<std::string, std::string>> moves;
+	for (uint64_t i = 0; i < instr.args.size(); ++i)
+		moves.push_back({ IRRegName(regParams[i], IRType::I64), loc(ibi, instr.args[i], IRType::I64) });
+	genParallelMove(ibi, moves);
+
+	genFrameRelease(ibi);
+	out << "  jmp " << instr.name << "\n";
+}
+
+void genInstr(IRBackendInfo& ibi, const IRBlock& block, const IRInstr& instr, int nextBlock)
+{
+	auto& out = *ibi.pOut;
+
+	switch (instr.op)
+	{
+	case IROp::Const:
+		if (inReg(ibi, instr.result) && instr.imm == 0)
+		{
+			auto reg = IRRegName(valueReg(ibi, instr.result), IRType::I32);
+			out << "  xor " << reg << ", " << reg << "\n";
+		}
+		else if (inReg(ibi, instr.result) || instr.type != IRType::I64 || (instr.imm >= INT_MIN && instr.imm <= INT_MAX))
+		{
+			out << "  mov " << loc(ibi, instr.result) << ", " << instr.imm << "\n";
+		}
+		else
+		{
+			out << "  mov rax, " << instr.imm << "\n";
+			storeResult(ibi, instr, SCRATCH_REG);
+		}
+		break;
+	case IROp::GlobalAddr:
+	{
+		IRReg reg = resultReg(ibi, instr);
+		out << "  mov " << IRRegName(reg, IRType::I64) << ", " << instr.name << "\n";
+		storeResult(ibi, instr, reg);
+	}
+		break;
+	case IROp::FrameAddr:
+	{
+		IRReg reg = resultReg(ibi, instr);
+		out << "  lea " << IRRegName(reg, IRType::I64) << ", [rbp " << (instr.imm < 0 ? "- " : "+ ") << (instr.imm < 0 ? -instr.imm : instr.imm) << "]\n";
+		storeResult(ibi, instr, reg);
+	}
+		break;
+	case IROp::Load:
+	{
+		auto mem = memOperand(ibi, instr, SCRATCH_REG_2);
+		IRReg reg = resultReg(ibi, instr);
+		// Narrow loads are zero extended to avoid partial register writes
+		if (instr.type == IRType::I8 || instr.type == IRType::I16)
+			out << "  movzx " << IRRegName(reg, IRType::I32) << ", " << mem << "\n";
+		else
+			out << "  mov " << IRRegName(reg, instr.type) << ", " << mem << "\n";
+		storeResult(ibi, instr, reg);
+	}
+		break;
+	case IROp::Store:
+		genStore(ibi, instr);
+		break;
+	case IROp::Copy:
+	{
+		IRReg reg = valueInReg(ibi, instr.args[0], SCRATCH_REG, instr.type);
+		storeResult(ibi, instr, reg);
+	}
+		break;
+	case IROp::Phi:
+		// Copied by the predecessors
+		break;
+	case IROp::Add:
+	case IROp::Sub:
+	case IROp::And:
+	case IROp::Or:
+	case IROp::Xor:
+	case IROp::Mul:
+	{
+		if (instr.isImmRhs)
+		{
+			genImmArithmetic(ibi, instr);
+			break;
+		}
+
+		if (instr.op == IROp::Mul && instr.type == IRType::I8)
+		{
+			// There is no two operand form of 8 bit multiplications
+			genMove(ibi, "al", loc(ibi, instr.args[0]));
+			out << "  mul " << loc(ibi, instr.args[1]) << "\n";
+			storeResult(ibi, instr, IRReg::RAX);
+			break;
+		}
+
+		// The right operand must not be overwritten before it was read
+		int lhs = instr.args[0];
+		int rhs = instr.args[1];
+		IRReg reg = resultReg(ibi, instr);
+		if (lhs != rhs && inReg(ibi, rhs) && valueReg(ibi, rhs) == reg)
+		{
+			if (instr.op != IROp::Sub)
+				std::swap(lhs, rhs);
+			else
+				reg = SCRATCH_REG;
+		}
+
+		genMove(ibi, IRRegName(reg, instr.type), loc(ibi, lhs));
+		out << "  " << (instr.op == IROp::Mul ? "imul" : IROpToString(instr.op)) << " " << IRRegName(reg, instr.type) << ", " << loc(ibi, rhs) << "\n";
+		storeResult(ibi, instr, reg);
+	}
+		break;
+	case IROp::UDiv:
+	case IROp::SDiv:
+	case IROp::URem:
+	case IROp::SRem:
+		genDivision(ibi, instr);
+		break;
+	case IROp::Shl:
+	case IROp::Shr:
+		if (instr.isImmRhs)
+		{
+			IRReg reg = resultReg(ibi, instr);
+			genMove(ibi, IRRegName(reg, instr.type), loc(ibi, instr.args[0]));
+			out << "  " << (instr.op == IROp::Shl ? "shl " : "shr ") << IRRegName(reg, instr.type) << ", " << (instr.imm & 0xFF) << "\n";
+			storeResult(ibi, instr, reg);
+			break;
+		}
+		// The allocator keeps values that live across variable shifts out of rcx
+		genMove(ibi, IRRegName(SCRATCH_REG, instr.type), loc(ibi, instr.args[0]));
+		genMove(ibi, "cl", loc(ibi, instr.args[1], IRType::I8));
+		out << "  " << (instr.op == IROp::Shl ? "shl " : "shr ") << IRRegName(SCRATCH_REG, instr.type) << ", cl\n";
+		storeResult(ibi, instr, SCRATCH_REG);
+		break;
+	case IROp::Neg:
+	case IROp::Not:
+	{
+		IRReg reg = resultReg(ibi, instr);
+		genMove(ibi, IRRegName(reg, instr.type), loc(ibi, instr.args[0]));
+		out << "  " << (instr.op == IROp::Neg ? "neg " : "not ") << IRRegName(reg, instr.type) << "\n";
+		storeResult(ibi, instr, reg);
+	}
+		break;
+	case IROp::Cmp:
+	{
+		std::string cc = genCondition(ibi, instr);
+		out << "  set" << cc << " " << loc(ibi, instr.result) << "\n";
+	}
+		break;
+	case IROp::Select:
+		genSelect(ibi, instr);
+		break;
+	case IROp::ZExt:
+	{
+		IRReg reg = resultReg(ibi, instr);
+		// The upper bits of narrow values are undefined, so the move is needed even if both registers are the same
+		if (valueType(ibi, instr.args[0]) == IRType::I32)
+			out << "  mov " << IRRegName(reg, IRType::I32) << ", " << loc(ibi, instr.args[0]) << "\n"; // Implicitly clears the upper half
+		else
+			out << "  movzx " << IRRegName(reg, IRType::I32) << ", " << loc(ibi, instr.args[0]) << "\n";
+		storeResult(ibi, instr, reg);
+	}
+		break;
+	case IROp::SExt:
+	{
+		IRReg reg = resultReg(ibi, instr);
+		out << "  " << (valueType(ibi, instr.args[0]) == IRType::I32 ? "movsxd " : "movsx ") << IRRegName(reg, instr.type) << ", " << loc(ibi, instr.args[0]) << "\n";
+		storeResult(ibi, instr, reg);
+	}
+		break;
+	case IROp::Trunc:
+	{
+		// Only the lower bits are used by the narrow result, the move can be skipped
+		IRReg reg = resultReg(ibi, instr);
+		genMove(ibi, IRRegName(reg, instr.type), loc(ibi, instr.args[0], instr.type));
+		storeResult(ibi, instr, reg);
+	}
+		break;
+	case IROp::Call:
+	case IROp::CallIndirect:
+		genCall(ibi, instr);
+		break;
+	case IROp::Jmp:
+		genPhiCopies(ibi, block.id, instr.targets[0]);
+		if (instr.targets[0] != nextBlock)
+			out << "  jmp " << blockLabel(ibi, instr.targets[0]) << "\n";
+		break;
+	case IROp::Br:
+	{
+		// Successors with phi instructions have been split off, so no copies are needed here
+		std::string cc = genCondition(ibi, instr);
+		if (instr.targets[0] == nextBlock)
+		{
+			out << "  j" << invertCondSuffix(cc) << " " << blockLabel(ibi, instr.targets[1]) << "\n";
+		}
+		else
+		{
+			out << "  j" << cc << " " << blockLabel(ibi, instr.targets[0]) << "\n";
+			if (instr.targets[1] != nextBlock)
+				out << "  jmp " << blockLabel(ibi, instr.targets[1]) << "\n";
+		}
+	}
+		break;
+	case IROp::Ret:
+		genRet(ibi, instr);
+		break;
+	case IROp::TailCall:
+		genTailCall(ibi, instr);
+		break;
+	default:
+		assert(false && "Unhandled IR operation!");
+	}
+}
+
+// Returns true if the value is defined by a constant that fits into a 32 bit displacement
+bool getDisplacement(const std::vector<const IRInstr*>& defs, int value, int64_t& disp)
+{
+	auto def = defs[value];
+	if (!def || def->op != IROp::Const || def->imm < INT_MIN || def->imm > INT_MAX)
+		return false;
+	disp = def->imm;
+	return true;
+}
+
+bool fitsDisplacement(int64_t disp)
+{
+	return disp >= INT_MIN && disp <= INT_MAX;
+}
+
+// Folds frame/global addresses, constant offsets and scaled indices into the addresses of loads and stores.
+// Address computations that are not used anymore afterwards are removed.
+void foldAddresses(IRFunction& irFunc)
+{
+	int nValues = irFunc.valueTypes.size();
+	std::vector<const IRInstr*> defs(nValues, nullptr);
+	std::vector<int> useCounts(nValues, 0);
+	for (auto& block : irFunc.blocks)
+	{
+		for (auto& instr : block.instrs)
+		{
+			if (instr.result != -1)
+				defs[instr.result] = &instr;
+			for (int arg : instr.args)
+				++useCounts[arg];
+		}
+	}
+
+	auto isFoldable = [](IROp op)
+	{
+		return op == IROp::Const || op == IROp::FrameAddr || op == IROp::GlobalAddr || op == IROp::Add || op == IROp::Mul || op == IROp::Shl;
+	};
+
+	// Instructions without uses release their operands
+	std::function<void(int)> releaseUse = [&](int value)
+	{
+		if (--useCounts[value] != 0 || !defs[value] || !isFoldable(defs[value]->op))
+			return;
+		for (int arg : defs[value]->args)
+			releaseUse(arg);
+	};
+
+	// Returns true if the value is index * scale with a scale usable in addresses
+	auto getScaledIndex = [&](int value, int& index, int& scale) -> bool
+	{
+		auto def = defs[value];
+		int64_t factor;
+		if (!def || (def->op != IROp::Mul && def->op != IROp::Shl) || useCounts[value] != 1 || def->type != IRType::I64 || !getDisplacement(defs, def->args[1], factor))
+			return false;
+		if (def->op == IROp::Shl && factor >= 0 && factor <= 3)
+			factor = 1ll << factor;
+		else if (def->op != IROp::Mul || (factor != 1 && factor != 2 && factor != 4 && factor != 8))
+			return false;
+		index = def->args[0];
+		scale = factor;
+		return true;
+	};
+
+	for (auto& block : irFunc.blocks)
+	{
+		for (auto& instr : block.instrs)
+		{
+			if (instr.op != IROp::Load && instr.op != IROp::Store)
+				continue;
+
+			while (instr.addrBase == IRAddrBase::Value)
+			{
+				int addr = instr.args[0];
+				auto def = defs[addr];
+				if (!def)
+					break;
+
+				if (def->op == IROp::FrameAddr && fitsDisplacement(instr.imm + def->imm))
+				{
+					instr.addrBase = IRAddrBase::Frame;
+					instr.imm += def->imm;
+					instr.args.erase(instr.args.begin());
+				}
+				else if (def->op == IROp::GlobalAddr)
+				{
+					instr.addrBase = IRAddrBase::Label;
+					instr.name = def->name;
+					instr.args.erase(instr.args.begin());
+				}
+				else if (def->op == IROp::Add && def->type == IRType::I64 && useCounts[addr] == 1)
+				{
+					int lhs = def->args[0];
+					int rhs = def->args[1];
+					int64_t disp;
+					int index, scale;
+					if (getDisplacement(defs, rhs, disp) && fitsDisplacement(instr.imm + disp))
+					{
+						instr.args[0] = lhs;
+						instr.imm += disp;
+						++useCounts[lhs];
+					}
+					else if (instr.scale != 0)
+					{
+						break;
+					}
+					else
+					{
+						if (!getScaledIndex(rhs, index, scale))
+						{
+							if (getScaledIndex(lhs, index, scale))
+								std::swap(lhs, rhs);
+							else
+								index = rhs, scale = 1;
+						}
+						instr.args[0] = lhs;
+						instr.args.insert(instr.args.begin() + 1, index);
+						instr.scale = scale;
+						++useCounts[lhs];
+						++useCounts[index];
+					}
+				}
+				else
+				{
+					break;
+				}
+
+				releaseUse(addr);
+			}
+		}
+	}
+
+	for (auto& block : irFunc.blocks)
+	{
+		block.instrs.erase(
+			std::remove_if(
+				block.instrs.begin(), block.instrs.end(),
+				[&](const IRInstr& instr) { return instr.result != -1 && useCounts[instr.result] == 0 && isFoldable(instr.op); }
+			),
+			block.instrs.end()
+		);
+	}
+}
+
+#define MAX_SELECT_ARM_SIZE 3
+
+// Returns true if the instruction can be executed unconditionally
+bool isSpeculatable(const IRInstr& instr)
+{
+	switch (instr.op)
+	{
+	case IROp::Const:
+	case IROp::Copy:
+	case IROp::FrameAddr:
+	case IROp::GlobalAddr:
+	case IROp::Add:
+	case IROp::Sub:
+	case IROp::And:
+	case IROp::Or:
+	case IROp::Xor:
+	case IROp::Mul:
+	case IROp::Shl:
+	case IROp::Shr:
+	case IROp::Neg:
+	case IROp::Not:
+	case IROp::Cmp:
+	case IROp::ZExt:
+	case IROp::SExt:
+	case IROp::Trunc:
+	case IROp::Select:
+		return true;
+	case IROp::Load: // Loads from locals and globals cannot fault
+		return instr.addrBase != IRAddrBase::Value && instr.scale == 0;
+	default:
+		return false;
+	}
+}
+
+// Replaces branches that only choose between cheaply computed values with selects.
+// Handles diamonds (A -> T/F -> E) and triangles (A -> T -> E, A -> E) whose arms consist of a few speculatable instructions.
+// The join block gets merged into A, so nested conditionals collapse from the inside out.
+void formSelects(IRFunction& irFunc)
+{
+	// Returns true if the block is a cheap arm only reachable from a single block, 'join' receives its successor
+	auto isArm = [&](int id, const std::vector<std::vector<int>>& preds, int& join)
+	{
+		auto& instrs = irFunc.blocks[id].instrs;
+		if (id == 0 || preds[id].size() != 1 || instrs.back().op != IROp::Jmp || instrs.size() - 1 > MAX_SELECT_ARM_SIZE)
+			return false;
+		for (uint64_t i = 0; i + 1 < instrs.size(); ++i)
+			if (!isSpeculatable(instrs[i]))
+				return false;
+		join = instrs.back().targets[0];
+		return true;
+	};
+
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+		auto preds = getPredecessors(irFunc);
+		for (auto& block : irFunc.blocks)
+		{
+			auto& br = block.instrs.back();
+			if (br.op != IROp::Br || br.isFusedCmp || br.targets[0] == br.targets[1])
+				continue;
+
+			int trueBlock = br.targets[0];
+			int falseBlock = br.targets[1];
+			int trueJoin = -1, falseJoin = -1;
+			bool isTrueArm = isArm(trueBlock, preds, trueJoin);
+			bool isFalseArm = isArm(falseBlock, preds, falseJoin);
+
+			int join;
+			std::vector<int> arms;
+			if (isTrueArm && isFalseArm && trueJoin == falseJoin)
+				join = trueJoin, arms = { trueBlock, falseBlock };
+			else if (isTrueArm && trueJoin == falseBlock)
+				join = falseBlock, falseBlock = block.id, arms = { trueBlock };
+			else if (isFalseArm && falseJoin == trueBlock)
+				join = trueBlock, trueBlock = block.id, arms = { falseBlock };
+			else
+				continue;
+			if (preds[join].size() != 2 || join == block.id || join == 0)
+				continue;
+
+			int cond = br.args[0];
+			block.instrs.pop_back();
+			for (int arm : arms)
+			{
+				auto& armInstrs = irFunc.blocks[arm].instrs;
+				block.instrs.insert(block.instrs.end(), armInstrs.begin(), armInstrs.end() - 1);
+				armInstrs.erase(armInstrs.begin(), armInstrs.end() - 1);
+			}
+			auto& joinInstrs = irFunc.blocks[join].instrs;
+			for (auto& phi : joinInstrs)
+			{
+				if (phi.op != IROp::Phi)
+					break;
+				int trueVal = -1, falseVal = -1;
+				for (uint64_t i = 0; i < phi.args.size(); ++i)
+				{
+					if (phi.targets[i] == trueBlock)
+						trueVal = phi.args[i];
+					else if (phi.targets[i] == falseBlock)
+						falseVal = phi.args[i];
+				}
+				phi.op = IROp::Select;
+				phi.args = { cond, trueVal, falseVal };
+				phi.targets.clear();
+			}
+
+			// The join block is left unreachable (jumping to itself), phis of its successors now get their values from A
+			for (int succ : getSuccessors(irFunc.blocks[join]))
+				for (auto& phi : irFunc.blocks[succ].instrs)
+					if (phi.op == IROp::Phi)
+						std::replace(phi.targets.begin(), phi.targets.end(), join, block.id);
+			block.instrs.insert(block.instrs.end(), joinInstrs.begin(), joinInstrs.end());
+			IRInstr jmp;
+			jmp.op = IROp::Jmp;
+			jmp.targets = { join };
+			joinInstrs = { jmp };
+
+			changed = true;
+			break;
+		}
+		if (changed)
+			removeUnreachableBlocks(irFunc);
+	}
+}
+
+IRCond swapCondOperands(IRCond cond)
+{
+	switch (cond)
+	{
+	case IRCond::Lt: return IRCond::Gt;
+	case IRCond::Le: return IRCond::Ge;
+	case IRCond::Gt: return IRCond::Lt;
+	case IRCond::Ge: return IRCond::Le;
+	default: return cond;
+	}
+}
+
+// Moves comparisons only used by a branch/select into it, so the flags are used directly instead of a setcc result.
+void fuseCompares(IRFunction& irFunc)
+{
+	int nValues = irFunc.valueTypes.size();
+	std::vector<const IRInstr*> defs(nValues, nullptr);
+	std::vector<int> useCounts(nValues, 0);
+	for (auto& block : irFunc.blocks)
+	{
+		for (auto& instr : block.instrs)
+		{
+			if (instr.result != -1)
+				defs[instr.result] = &instr;
+			for (int arg : instr.args)
+				++useCounts[arg];
+		}
+	}
+
+	for (auto& block : irFunc.blocks)
+	{
+		for (auto& instr : block.instrs)
+		{
+			if (instr.op != IROp::Br && instr.op != IROp::Select)
+				continue;
+			// Zero extension keeps the condition (in)equal to zero
+			int cond = instr.args[0];
+			while (defs[cond] && defs[cond]->op == IROp::ZExt && useCounts[cond] == 1)
+				cond = defs[cond]->args[0];
+			auto def = defs[cond];
+			if (!def || def->op != IROp::Cmp || useCounts[cond] != 1)
+				continue;
+			instr.isFusedCmp = true;
+			instr.cond = def->cond;
+			instr.args.erase(instr.args.begin());
+			instr.args.insert(instr.args.begin(), def->args.begin(), def->args.end());
+		}
+	}
+}
+
+// Constant right operands of binary operations and comparisons become immediates.
+// Commutative operations and comparisons with a constant left operand get their operands swapped.
+void useImmediates(IRFunction& irFunc)
+{
+	int nValues = irFunc.valueTypes.size();
+	std::vector<const IRInstr*> defs(nValues, nullptr);
+	for (auto& block : irFunc.blocks)
+		for (auto& instr : block.instrs)
+			if (instr.result != -1)
+				defs[instr.result] = &instr;
+
+	// 64 bit operations only take sign extended 32 bit immediates
+	auto getImm = [&](int value, int64_t& imm)
+	{
+		auto def = defs[value];
+		if (!def || def->op != IROp::Const || (def->type == IRType::I64 && !fitsDisplacement(def->imm)))
+			return false;
+		imm = def->imm;
+		return true;
+	};
+
+	for (auto& block : irFunc.blocks)
+	{
+		for (auto& instr : block.instrs)
+		{
+			if (instr.op == IROp::UDiv || instr.op == IROp::SDiv || instr.op == IROp::URem || instr.op == IROp::SRem)
+			{
+				// Divisions by constants are lowered without div, the divisor doesn't have to fit into 32 bit
+				auto def = defs[instr.args[1]];
+				bool isSigned = instr.op == IROp::SDiv || instr.op == IROp::SRem;
+				if (!def || def->op != IROp::Const)
+					continue;
+				int64_t divisor = normalizeImm(def->imm, instr.type, isSigned);
+				if (divisor == 0 || (isSigned && divisor == INT64_MIN))
+					continue;
+				instr.args.pop_back();
+				instr.isImmRhs = true;
+				instr.imm = divisor;
+				continue;
+			}
+
+			bool isCmp = instr.op == IROp::Cmp || instr.isFusedCmp;
+			bool isCommutative = isCmp || instr.op == IROp::Add || instr.op == IROp::And || instr.op == IROp::Or || instr.op == IROp::Xor || instr.op == IROp::Mul;
+			if ((!isCommutative && instr.op != IROp::Sub && instr.op != IROp::Shl && instr.op != IROp::Shr) || instr.isImmRhs)
+				continue;
+
+			int64_t imm;
+			if (getImm(instr.args[1], imm))
+			{
+				instr.args.erase(instr.args.begin() + 1);
+			}
+			else if (isCommutative && getImm(instr.args[0], imm))
+			{
+				instr.args.erase(instr.args.begin());
+				if (isCmp)
+					instr.cond = swapCondOperands(instr.cond);
+			}
+			else
+			{
+				continue;
+			}
+			instr.isImmRhs = true;
+			instr.imm = imm;
+		}
+	}
+}
+
+void genIRFunctionAsm(AsmBuffer& out, IRFunction& irFunc)
+{
+	promoteLocals(irFunc);
+	foldAddresses(irFunc);
+	formSelects(irFunc);
+	fuseCompares(irFunc);
+	useImmediates(irFunc);
+	removeDeadInstrs(irFunc);
+	splitCriticalEdges(irFunc);
+
+	IRBackendInfo ibi;
+	ibi.pOut = &out;
+	ibi.irFunc = &irFunc;
+	ibi.alloc = allocateRegisters(irFunc);
+
+	int frameSize = irFunc.frameSize + 8 * ibi.alloc.nSpillSlots;
+	for (auto reg : ibi.alloc.usedCalleeSaved)
+	{
+		frameSize += 8;
+		ibi.savedRegs.push_back({ reg, frameSize });
+	}
+	frameSize = (frameSize + 15) / 16 * 16;
+
+	out << irFunc.name << ":\n";
+	out << "  push rbp\n";
+	out << "  mov rbp, rsp\n";
+	if (frameSize > 0)
+		out << "  sub rsp, " << frameSize << "\n";
+	for (auto& [reg, offset] : ibi.savedRegs)
+		out << "  mov [rbp - " << offset << "], " << IRRegName(reg, IRType::I64) << "\n";
+	for (int i = 0; i < irFunc.nRegParams; ++i)
+		out << "  mov [rbp - " << 8 * (i + 1) << "], " << IRRegName(regParams[i], IRType::I64) << "\n";
+
+	for (uint64_t i = 0; i < irFunc.blocks.size(); ++i)
+	{
+		auto& block = irFunc.blocks[i];
+		if (i != 0)
+			out << blockLabel(ibi, block.id) << ":\n";
+		int nextBlock = i + 1 < irFunc.blocks.size() ? irFunc.blocks[i + 1].id : -1;
+		for (auto& instr : block.instrs)
+			genInstr(ibi, block, instr, nextBlock);
+	}
+}
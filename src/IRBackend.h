@@ -0,0 +1,7 @@
+#pragma once
+
+#include "IR.h"
+#include "AsmBuffer.h"
+
+// Generates Nasm code for the IR function. The generated code uses the same calling convention as the legacy code generator.
+void genIRFunctionAsm(AsmBuffer& out, IRFunction& irFunc);
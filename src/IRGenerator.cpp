@@ -0,0 +1,931 @@
+#include "IRGenerator.h"
+
+#include <algorithm>
+
+#include "Errors/IRGenError.h"
+
+struct IRGenInfo
+{
+	ProgramRef program;
+	IRFunctionRef irFunc;
+	int currBlock = 0;
+	std::vector<std::pair<int, int>> loopTargets; // (Continue block, break block) of the enclosing loops
+};
+
+int newBlock(IRGenInfo& igi)
+{
+	IRBlock block;
+	block.id = igi.irFunc->blocks.size();
+	igi.irFunc->blocks.push_back(block);
+	return block.id;
+}
+
+int emit(IRGenInfo& igi, IRInstr instr)
+{
+	if (instr.type != IRType::Void && instr.op != IROp::Store)
+	{
+		instr.result = igi.irFunc->valueTypes.size();
+		igi.irFunc->valueTypes.push_back(instr.type);
+	}
+
+	igi.irFunc->blocks[igi.currBlock].instrs.push_back(instr);
+
+	// Code following a terminator is placed in a new (possibly unreachable) block
+	if (isTerminator(instr.op))
+		igi.currBlock = newBlock(igi);
+
+	return instr.result;
+}
+
+IRType valueType(IRGenInfo& igi, int value)
+{
+	return igi.irFunc->valueTypes[value];
+}
+
+int emitConst(IRGenInfo& igi, IRType type, uint64_t value)
+{
+	IRInstr instr;
+	instr.op = IROp::Const;
+	instr.type = type;
+	if (type != IRType::I64)
+		value &= (1ull << (getIRTypeSize(type) * 8)) - 1;
+	instr.imm = (int64_t)value;
+	return emit(igi, instr);
+}
+
+int emitGlobalAddr(IRGenInfo& igi, const std::string& name)
+{
+	IRInstr instr;
+	instr.op = IROp::GlobalAddr;
+	instr.type = IRType::I64;
+	instr.name = name;
+	return emit(igi, instr);
+}
+
+int emitFrameAddr(IRGenInfo& igi, int offset)
+{
+	IRInstr instr;
+	instr.op = IROp::FrameAddr;
+	instr.type = IRType::I64;
+	instr.imm = offset;
+	return emit(igi, instr);
+}
+
+int emitUnary(IRGenInfo& igi, IROp op, IRType type, int value)
+{
+	IRInstr instr;
+	instr.op = op;
+	instr.type = type;
+	instr.args = { value };
+	return emit(igi, instr);
+}
+
+int emitBinary(IRGenInfo& igi, IROp op, int left, int right)
+{
+	IRInstr instr;
+	instr.op = op;
+	instr.type = valueType(igi, left);
+	instr.args = { left, right };
+	return emit(igi, instr);
+}
+
+int emitCmp(IRGenInfo& igi, IRCond cond, int left, int right)
+{
+	IRInstr instr;
+	instr.op = IROp::Cmp;
+	instr.type = IRType::I8;
+	instr.cond = cond;
+	instr.args = { left, right };
+	return emit(igi, instr);
+}
+
+int emitLoad(IRGenInfo& igi, IRType type, int addr)
+{
+	return emitUnary(igi, IROp::Load, type, addr);
+}
+
+void emitStore(IRGenInfo& igi, IRType type, int addr, int value)
+{
+	IRInstr instr;
+	instr.op = IROp::Store;
+	instr.type = type;
+	instr.args = { addr, value };
+	emit(igi, instr);
+}
+
+void emitJmp(IRGenInfo& igi, int target)
+{
+	IRInstr instr;
+	instr.op = IROp::Jmp;
+	instr.targets = { target };
+	emit(igi, instr);
+}
+
+void emitBr(IRGenInfo& igi, int condition, int trueTarget, int falseTarget)
+{
+	IRInstr instr;
+	instr.op = IROp::Br;
+	instr.args = { condition };
+	instr.targets = { trueTarget, falseTarget };
+	emit(igi, instr);
+}
+
+int emitPhi(IRGenInfo& igi, IRType type, const std::vector<std::pair<int, int>>& incoming)
+{
+	IRInstr instr;
+	instr.op = IROp::Phi;
+	instr.type = type;
+	for (auto& [value, block] : incoming)
+	{
+		instr.args.push_back(value);
+		instr.targets.push_back(block);
+	}
+	return emit(igi, instr);
+}
+
+// Converts the value to the requested width
+int emitResize(IRGenInfo& igi, int value, IRType type, bool isSigned)
+{
+	int oldSize = getIRTypeSize(valueType(igi, value));
+	int newSize = getIRTypeSize(type);
+	if (oldSize == newSize)
+		return value;
+	if (oldSize > newSize)
+		return emitUnary(igi, IROp::Trunc, type, value);
+	return emitUnary(igi, isSigned ? IROp::SExt : IROp::ZExt, type, value);
+}
+
+IRType getIRType(IRGenInfo& igi, const Datatype& datatype, const Token::Position& pos)
+{
+	if (isVoid(datatype))
+		return IRType::Void;
+	if (isArray(datatype))
+		return IRType::I64; // Arrays are represented by their address
+	if (isOfType(datatype, DTType::Reference) || isPackType(igi.program, datatype))
+		THROW_IR_GEN_ERROR(pos, "Values of type '" + getReadableName(datatype) + "' are not supported by the IR!");
+
+	int size = getDatatypeSize(igi.program, datatype);
+	if (size != 1 && size != 2 && size != 4 && size != 8)
+		THROW_IR_GEN_ERROR(pos, "Values of type '" + getReadableName(datatype) + "' are not supported by the IR!");
+	return getIRTypeFromSize(size);
+}
+
+// Negated unsigned values are treated as signed by the legacy code generator
+bool isSignedValue(const Expression* expr)
+{
+	if (expr->eType == Expression::ExprType::Prefix_Minus)
+		return isInteger(expr->datatype);
+	if (expr->eType == Expression::ExprType::Prefix_Plus)
+		return isSignedValue(expr->left.get());
+	return isSignedInt(expr->datatype);
+}
+
+int lowerValue(IRGenInfo& igi, const Expression* expr);
+int lowerAddress(IRGenInfo& igi, const Expression* expr);
+
+// Lowers the condition and branches to the true/false block.
+// Logical operators branch directly to the targets instead of materializing their result.
+void lowerCondBranch(IRGenInfo& igi, const Expression* condition, int trueTarget, int falseTarget)
+{
+	switch (condition->eType)
+	{
+	case Expression::ExprType::Logical_AND:
+	{
+		int rightBlock = newBlock(igi);
+		lowerCondBranch(igi, condition->left.get(), rightBlock, falseTarget);
+		igi.currBlock = rightBlock;
+		lowerCondBranch(igi, condition->right.get(), trueTarget, falseTarget);
+	}
+		return;
+	case Expression::ExprType::Logical_OR:
+	{
+		int rightBlock = newBlock(igi);
+		lowerCondBranch(igi, condition->left.get(), trueTarget, rightBlock);
+		igi.currBlock = rightBlock;
+		lowerCondBranch(igi, condition->right.get(), trueTarget, falseTarget);
+	}
+		return;
+	case Expression::ExprType::Logical_NOT:
+		lowerCondBranch(igi, condition->left.get(), falseTarget, trueTarget);
+		return;
+	default:
+		break;
+	}
+
+	emitBr(igi, lowerValue(igi, condition), trueTarget, falseTarget);
+}
+
+bool getBinaryOp(Expression::ExprType eType, bool isSigned, IROp& op)
+{
+	switch (eType)
+	{
+	case Expression::ExprType::Assign_Sum:
+	case Expression::ExprType::Sum: op = IROp::Add; break;
+	case Expression::ExprType::Assign_Difference:
+	case Expression::ExprType::Difference: op = IROp::Sub; break;
+	case Expression::ExprType::Assign_Product:
+	case Expression::ExprType::Product: op = IROp::Mul; break;
+	case Expression::ExprType::Assign_Quotient:
+	case Expression::ExprType::Quotient: op = isSigned ? IROp::SDiv : IROp::UDiv; break;
+	case Expression::ExprType::Assign_Remainder:
+	case Expression::ExprType::Remainder: op = isSigned ? IROp::SRem : IROp::URem; break;
+	case Expression::ExprType::Assign_Bw_LeftShift:
+	case Expression::ExprType::Shift_Left: op = IROp::Shl; break;
+	case Expression::ExprType::Assign_Bw_RightShift:
+	case Expression::ExprType::Shift_Right: op = IROp::Shr; break;
+	case Expression::ExprType::Assign_Bw_AND:
+	case Expression::ExprType::Bitwise_AND: op = IROp::And; break;
+	case Expression::ExprType::Assign_Bw_XOR:
+	case Expression::ExprType::Bitwise_XOR: op = IROp::Xor; break;
+	case Expression::ExprType::Assign_Bw_OR:
+	case Expression::ExprType::Bitwise_OR: op = IROp::Or; break;
+	default:
+		return false;
+	}
+	return true;
+}
+
+bool getComparisonCond(Expression::ExprType eType, IRCond& cond)
+{
+	switch (eType)
+	{
+	case Expression::ExprType::Comparison_Equal: cond = IRCond::Eq; break;
+	case Expression::ExprType::Comparison_NotEqual: cond = IRCond::Ne; break;
+	case Expression::ExprType::Comparison_Less: cond = IRCond::Lt; break;
+	case Expression::ExprType::Comparison_LessEqual: cond = IRCond::Le; break;
+	case Expression::ExprType::Comparison_Greater: cond = IRCond::Gt; break;
+	case Expression::ExprType::Comparison_GreaterEqual: cond = IRCond::Ge; break;
+	default:
+		return false;
+	}
+	return true;
+}
+
+int emitBinaryChecked(IRGenInfo& igi, IROp op, int left, int right, const Token::Position& pos)
+{
+	// Shifts only use the low byte of the count
+	if (op != IROp::Shl && op != IROp::Shr && valueType(igi, left) != valueType(igi, right))
+		THROW_IR_GEN_ERROR(pos, "Operand width mismatch!");
+	return emitBinary(igi, op, left, right);
+}
+
+// Returns the step of increments/decrements of the datatype
+uint64_t getIncrementStep(IRGenInfo& igi, const Datatype& datatype)
+{
+	if (isPointer(datatype))
+		return getDatatypePointedToSize(igi.program, datatype);
+	return 1;
+}
+
+// Returns the address of the assigned variable
+int lowerAssign(IRGenInfo& igi, const Expression* expr)
+{
+	IRType type = getIRType(igi, expr->left->datatype, expr->pos);
+	if (isArray(expr->left->datatype))
+		THROW_IR_GEN_ERROR(expr->pos, "Array assignments are not supported by the IR!");
+
+	int right = lowerValue(igi, expr->right.get());
+	int addr = lowerAddress(igi, expr->left.get());
+
+	if (expr->eType == Expression::ExprType::Assign)
+	{
+		emitStore(igi, type, addr, right);
+		return addr;
+	}
+
+	IROp op;
+	if (!getBinaryOp(expr->eType, isSignedInt(expr->left->datatype), op))
+		THROW_IR_GEN_ERROR(expr->pos, "Unsupported assignment type!");
+
+	int old = emitLoad(igi, type, addr);
+	emitStore(igi, type, addr, emitBinaryChecked(igi, op, old, right, expr->pos));
+	return addr;
+}
+
+// Increments/decrements the variable and returns the old value
+int lowerIncDec(IRGenInfo& igi, const Expression* expr, int addr, bool increment)
+{
+	IRType type = getIRType(igi, expr->left->datatype, expr->pos);
+	int old = emitLoad(igi, type, addr);
+	int step = emitConst(igi, type, getIncrementStep(igi, expr->left->datatype));
+	emitStore(igi, type, addr, emitBinary(igi, increment ? IROp::Add : IROp::Sub, old, step));
+	return old;
+}
+
+int lowerConversion(IRGenInfo& igi, const Expression* expr)
+{
+	auto& oldType = expr->left->datatype;
+	auto& newType = expr->datatype;
+
+	int value = lowerValue(igi, expr->left.get());
+
+	if (isArray(oldType) && isPointer(newType))
+		return value;
+
+	IRType type = getIRType(igi, newType, expr->pos);
+
+	if (isNull(oldType))
+		return emitConst(igi, type, 0);
+
+	if (isBool(newType))
+		return emitCmp(igi, IRCond::Ne, value, emitConst(igi, valueType(igi, value), 0));
+
+	if (
+		(isUnsignedInt(oldType) && isInteger(newType)) ||
+		(isInteger(oldType) && (isPointer(newType) || isEnum(igi.program, newType))) ||
+		(isBool(oldType) && (isInteger(newType) || isPointer(newType) || isEnum(igi.program, newType))) ||
+		(isEnum(igi.program, oldType))
+		)
+		return emitResize(igi, value, type, false);
+
+	if (isSignedInt(oldType) && isInteger(newType))
+		return emitResize(igi, value, type, true);
+
+	if ((isPointer(oldType) || isFuncPtr(oldType)) && (isPointer(newType) || isFuncPtr(newType) || isInteger(newType) || isEnum(igi.program, newType)))
+		return emitResize(igi, value, type, false);
+
+	THROW_IR_GEN_ERROR(expr->pos, "Unsupported conversion from '" + getReadableName(oldType) + "' to '" + getReadableName(newType) + "'!");
+}
+
+int lowerLiteral(IRGenInfo& igi, const Expression* expr)
+{
+	if (isInteger(expr->datatype) || isEnum(igi.program, expr->datatype))
+		return emitConst(igi, getIRType(igi, expr->datatype, expr->pos), expr->value.u64);
+	if (isBool(expr->datatype))
+		return emitConst(igi, IRType::I8, (bool)expr->value.u64);
+	if (isNull(expr->datatype))
+		return emitConst(igi, IRType::I64, 0);
+	if (isArray(expr->datatype)) // String literal
+	{
+		igi.irFunc->usedStringIDs.insert(expr->value.u64);
+		return emitGlobalAddr(igi, getLiteralStringName(expr->value.u64));
+	}
+	THROW_IR_GEN_ERROR(expr->pos, "Unsupported literal type!");
+}
+
+int lowerCall(IRGenInfo& igi, const Expression* expr)
+{
+	if (expr->isExtCall)
+		THROW_IR_GEN_ERROR(expr->pos, "Calls to external functions are not supported by the IR!");
+
+	IRInstr instr;
+	instr.type = getIRType(igi, expr->datatype, expr->pos);
+	if (!expr->isRegCall)
+		THROW_IR_GEN_ERROR(expr->pos, "Calls using the stack calling convention are not supported by the IR!");
+	instr.imm = expr->paramSizeSum;
+
+	std::vector<int> params(expr->paramExpr.size());
+	for (int i = expr->paramExpr.size() - 1; i >= 0; --i)
+	{
+		auto& param = expr->paramExpr[i];
+		getIRType(igi, param->datatype, param->pos);
+		params[i] = lowerValue(igi, param.get());
+	}
+
+	if (expr->left->eType == Expression::ExprType::Symbol && isFuncSpec(expr->left->symbol))
+	{
+		instr.op = IROp::Call;
+		instr.name = getMangledName(expr->left->symbol);
+	}
+	else
+	{
+		instr.op = IROp::CallIndirect;
+		instr.args.push_back(lowerValue(igi, expr->left.get()));
+	}
+	instr.args.insert(instr.args.end(), params.begin(), params.end());
+
+	return emit(igi, instr);
+}
+
+// Evaluates both operands of a conditional operator/logical operator and merges the results
+int lowerSelect(IRGenInfo& igi, const Expression* expr, bool asAddress)
+{
+	int trueBlock = newBlock(igi);
+	int falseBlock = newBlock(igi);
+	int endBlock = newBlock(igi);
+
+	lowerCondBranch(igi, expr->left.get(), trueBlock, falseBlock);
+
+	igi.currBlock = trueBlock;
+	int trueValue = asAddress ? lowerAddress(igi, expr->right.get()) : lowerValue(igi, expr->right.get());
+	int trueEnd = igi.currBlock;
+	emitJmp(igi, endBlock);
+
+	igi.currBlock = falseBlock;
+	int falseValue = asAddress ? lowerAddress(igi, expr->farRight.get()) : lowerValue(igi, expr->farRight.get());
+	int falseEnd = igi.currBlock;
+	emitJmp(igi, endBlock);
+
+	if (valueType(igi, trueValue) != valueType(igi, falseValue))
+		THROW_IR_GEN_ERROR(expr->pos, "Operand width mismatch!");
+
+	igi.currBlock = endBlock;
+	return emitPhi(igi, valueType(igi, trueValue), { { trueValue, trueEnd }, { falseValue, falseEnd } });
+}
+
+// Logical operators evaluate to the left operand if it decides the result
+int lowerLogical(IRGenInfo& igi, const Expression* expr, bool isOr)
+{
+	int rightBlock = newBlock(igi);
+	int endBlock = newBlock(igi);
+
+	int left = lowerValue(igi, expr->left.get());
+	int leftEnd = igi.currBlock;
+	int cond = emitCmp(igi, isOr ? IRCond::Eq : IRCond::Ne, left, emitConst(igi, valueType(igi, left), isOr ? 1 : 0));
+	if (isOr)
+		emitBr(igi, cond, endBlock, rightBlock);
+	else
+		emitBr(igi, cond, rightBlock, endBlock);
+
+	igi.currBlock = rightBlock;
+	int right = lowerValue(igi, expr->right.get());
+	int rightEnd = igi.currBlock;
+	emitJmp(igi, endBlock);
+
+	if (valueType(igi, left) != valueType(igi, right))
+		THROW_IR_GEN_ERROR(expr->pos, "Operand width mismatch!");
+
+	igi.currBlock = endBlock;
+	return emitPhi(igi, valueType(igi, left), { { left, leftEnd }, { right, rightEnd } });
+}
+
+int lowerAddress(IRGenInfo& igi, const Expression* expr)
+{
+	switch (expr->eType)
+	{
+	case Expression::ExprType::Symbol:
+		if (isVarLabeled(expr->symbol))
+			return emitGlobalAddr(igi, getMangledName(expr->symbol));
+		if (isVarOffset(expr->symbol))
+			return emitFrameAddr(igi, expr->symbol->var.offset);
+		break;
+	case Expression::ExprType::Literal:
+		if (isArray(expr->datatype))
+			return lowerLiteral(igi, expr);
+		break;
+	case Expression::ExprType::Dereference:
+		return lowerValue(igi, expr->left.get());
+	case Expression::ExprType::Subscript:
+	{
+		int base = lowerValue(igi, expr->left.get());
+		int index = lowerValue(igi, expr->right.get());
+		if (valueType(igi, index) != IRType::I64)
+			THROW_IR_GEN_ERROR(expr->pos, "Subscript index must be 64 bits wide!");
+		int elemSize = getDatatypeSize(igi.program, expr->datatype);
+		if (elemSize != 1)
+			index = emitBinary(igi, IROp::Mul, index, emitConst(igi, IRType::I64, elemSize));
+		return emitBinary(igi, IROp::Add, base, index);
+	}
+	case Expression::ExprType::MemberAccess:
+	{
+		int base = lowerAddress(igi, expr->left.get());
+		int offset = expr->right->symbol->var.offset;
+		if (offset == 0)
+			return base;
+		return emitBinary(igi, IROp::Add, base, emitConst(igi, IRType::I64, offset));
+	}
+	case Expression::ExprType::Assign:
+	case Expression::ExprType::Assign_Sum:
+	case Expression::ExprType::Assign_Difference:
+	case Expression::ExprType::Assign_Product:
+	case Expression::ExprType::Assign_Quotient:
+	case Expression::ExprType::Assign_Remainder:
+	case Expression::ExprType::Assign_Bw_LeftShift:
+	case Expression::ExprType::Assign_Bw_RightShift:
+	case Expression::ExprType::Assign_Bw_AND:
+	case Expression::ExprType::Assign_Bw_XOR:
+	case Expression::ExprType::Assign_Bw_OR:
+		return lowerAssign(igi, expr);
+	case Expression::ExprType::Prefix_Increment:
+	case Expression::ExprType::Prefix_Decrement:
+	{
+		int addr = lowerAddress(igi, expr->left.get());
+		lowerIncDec(igi, expr, addr, expr->eType == Expression::ExprType::Prefix_Increment);
+		return addr;
+	}
+	case Expression::ExprType::Conditional_Op:
+		if (expr->right->isLValue && expr->farRight->isLValue)
+			return lowerSelect(igi, expr, true);
+		break;
+	default:
+		break;
+	}
+
+	THROW_IR_GEN_ERROR(expr->pos, "Cannot lower the address of '" + ExpressionTypeToString(expr->eType) + "' expressions!");
+}
+
+int lowerValue(IRGenInfo& igi, const Expression* expr)
+{
+	switch (expr->eType)
+	{
+	case Expression::ExprType::Literal:
+		return lowerLiteral(igi, expr);
+	case Expression::ExprType::Symbol:
+		if (isFuncSpec(expr->symbol) || isExtFunc(expr->symbol))
+			return emitGlobalAddr(igi, getMangledName(expr->symbol));
+		if (!isVariable(expr->symbol))
+			break;
+		// Fallthrough
+	case Expression::ExprType::Dereference:
+	case Expression::ExprType::Subscript:
+	case Expression::ExprType::MemberAccess:
+	case Expression::ExprType::Assign:
+	case Expression::ExprType::Assign_Sum:
+	case Expression::ExprType::Assign_Difference:
+	case Expression::ExprType::Assign_Product:
+	case Expression::ExprType::Assign_Quotient:
+	case Expression::ExprType::Assign_Remainder:
+	case Expression::ExprType::Assign_Bw_LeftShift:
+	case Expression::ExprType::Assign_Bw_RightShift:
+	case Expression::ExprType::Assign_Bw_AND:
+	case Expression::ExprType::Assign_Bw_XOR:
+	case Expression::ExprType::Assign_Bw_OR:
+	case Expression::ExprType::Prefix_Increment:
+	case Expression::ExprType::Prefix_Decrement:
+	{
+		IRType type = getIRType(igi, expr->datatype, expr->pos);
+		int addr = lowerAddress(igi, expr);
+		if (isArray(expr->datatype))
+			return addr;
+		return emitLoad(igi, type, addr);
+	}
+	case Expression::ExprType::Conversion:
+		return lowerConversion(igi, expr);
+	case Expression::ExprType::Conditional_Op:
+		return lowerSelect(igi, expr, false);
+	case Expression::ExprType::Logical_OR:
+		return lowerLogical(igi, expr, true);
+	case Expression::ExprType::Logical_AND:
+		return lowerLogical(igi, expr, false);
+	case Expression::ExprType::Sum:
+	case Expression::ExprType::Difference:
+	case Expression::ExprType::Product:
+	case Expression::ExprType::Quotient:
+	case Expression::ExprType::Remainder:
+	case Expression::ExprType::Shift_Left:
+	case Expression::ExprType::Shift_Right:
+	case Expression::ExprType::Bitwise_AND:
+	case Expression::ExprType::Bitwise_XOR:
+	case Expression::ExprType::Bitwise_OR:
+	{
+		getIRType(igi, expr->datatype, expr->pos);
+		IROp op;
+		getBinaryOp(expr->eType, isSignedValue(expr->left.get()), op);
+		int left = lowerValue(igi, expr->left.get());
+		int right = lowerValue(igi, expr->right.get());
+		return emitBinaryChecked(igi, op, left, right, expr->pos);
+	}
+	case Expression::ExprType::Comparison_Equal:
+	case Expression::ExprType::Comparison_NotEqual:
+	case Expression::ExprType::Comparison_Less:
+	case Expression::ExprType::Comparison_LessEqual:
+	case Expression::ExprType::Comparison_Greater:
+	case Expression::ExprType::Comparison_GreaterEqual:
+	{
+		IRCond cond;
+		getComparisonCond(expr->eType, cond);
+		int left = lowerValue(igi, expr->left.get());
+		int right = lowerValue(igi, expr->right.get());
+		if (valueType(igi, left) != valueType(igi, right))
+			THROW_IR_GEN_ERROR(expr->pos, "Operand width mismatch!");
+		return emitCmp(igi, cond, left, right);
+	}
+	case Expression::ExprType::Logical_NOT:
+	{
+		int value = lowerValue(igi, expr->left.get());
+		return emitCmp(igi, IRCond::Eq, value, emitConst(igi, valueType(igi, value), 0));
+	}
+	case Expression::ExprType::Bitwise_NOT:
+	case Expression::ExprType::Prefix_Minus:
+	{
+		IRType type = getIRType(igi, expr->datatype, expr->pos);
+		int value = lowerValue(igi, expr->left.get());
+		return emitUnary(igi, expr->eType == Expression::ExprType::Bitwise_NOT ? IROp::Not : IROp::Neg, type, value);
+	}
+	case Expression::ExprType::Prefix_Plus:
+		return lowerValue(igi, expr->left.get());
+	case Expression::ExprType::Suffix_Increment:
+	case Expression::ExprType::Suffix_Decrement:
+	{
+		int addr = lowerAddress(igi, expr->left.get());
+		return lowerIncDec(igi, expr, addr, expr->eType == Expression::ExprType::Suffix_Increment);
+	}
+	case Expression::ExprType::AddressOf:
+		return lowerAddress(igi, expr->left.get());
+	case Expression::ExprType::FunctionCall:
+		return lowerCall(igi, expr);
+	default:
+		break;
+	}
+
+	THROW_IR_GEN_ERROR(expr->pos, "Cannot lower '" + ExpressionTypeToString(expr->eType) + "' expressions!");
+}
+
+void lowerStatement(IRGenInfo& igi, StatementRef statement);
+
+// Turns a call directly followed by the return of its result (if any) into a tail call
+bool formTailCall(IRGenInfo& igi, const Expression* retExpr, int retValue)
+{
+	auto& instrs = igi.irFunc->blocks[igi.currBlock].instrs;
+	if (instrs.empty() || instrs.back().op != IROp::Call)
+		return false;
+
+	auto& call = instrs.back();
+	if (retExpr)
+	{
+		if (call.result != retValue || retExpr->eType != Expression::ExprType::FunctionCall)
+			return false;
+		// The callee must extend the return value to 64 bits the same way this function does
+		if (call.type != IRType::I64 && isSignedInt(retExpr->datatype) != igi.irFunc->isRetSigned)
+			return false;
+	}
+
+	call.op = IROp::TailCall;
+	call.result = -1;
+	igi.currBlock = newBlock(igi);
+	return true;
+}
+
+void lowerBody(IRGenInfo& igi, BodyRef body)
+{
+	for (auto& statement : body->statements)
+		lowerStatement(igi, statement);
+}
+
+void lowerStatement(IRGenInfo& igi, StatementRef statement)
+{
+	switch (statement->type)
+	{
+	case Statement::Type::Return:
+	{
+		IRInstr instr;
+		instr.op = IROp::Ret;
+		if (statement->subExpr)
+		{
+			int value = lowerValue(igi, statement->subExpr.get());
+			if (valueType(igi, value) != igi.irFunc->retType)
+				THROW_IR_GEN_ERROR(statement->pos, "Return value width mismatch!");
+			instr.args = { value };
+		}
+		if (!formTailCall(igi, statement->subExpr.get(), instr.args.empty() ? -1 : instr.args[0]))
+			emit(igi, instr);
+	}
+		break;
+	case Statement::Type::If_Clause:
+	{
+		int endBlock = newBlock(igi);
+		for (auto& condBody : statement->ifConditionalBodies)
+		{
+			int bodyBlock = newBlock(igi);
+			int nextBlock = newBlock(igi);
+			lowerCondBranch(igi, condBody.condition.get(), bodyBlock, nextBlock);
+
+			igi.currBlock = bodyBlock;
+			lowerBody(igi, condBody.body);
+			emitJmp(igi, endBlock);
+
+			igi.currBlock = nextBlock;
+		}
+		if (statement->elseBody)
+			lowerBody(igi, statement->elseBody);
+		emitJmp(igi, endBlock);
+		igi.currBlock = endBlock;
+	}
+		break;
+	case Statement::Type::While_Loop:
+	{
+		int condBlock = newBlock(igi);
+		int bodyBlock = newBlock(igi);
+		int endBlock = newBlock(igi);
+
+		emitJmp(igi, condBlock);
+		igi.currBlock = condBlock;
+		lowerCondBranch(igi, statement->whileConditionalBody.condition.get(), bodyBlock, endBlock);
+
+		igi.currBlock = bodyBlock;
+		igi.loopTargets.push_back({ condBlock, endBlock });
+		lowerBody(igi, statement->whileConditionalBody.body);
+		igi.loopTargets.pop_back();
+		emitJmp(igi, condBlock);
+
+		igi.currBlock = endBlock;
+	}
+		break;
+	case Statement::Type::Do_While_Loop:
+	{
+		int bodyBlock = newBlock(igi);
+		int condBlock = newBlock(igi);
+		int endBlock = newBlock(igi);
+
+		emitJmp(igi, bodyBlock);
+		igi.currBlock = bodyBlock;
+		igi.loopTargets.push_back({ condBlock, endBlock });
+		lowerBody(igi, statement->doWhileConditionalBody.body);
+		igi.loopTargets.pop_back();
+		emitJmp(igi, condBlock);
+
+		igi.currBlock = condBlock;
+		lowerCondBranch(igi, statement->doWhileConditionalBody.condition.get(), bodyBlock, endBlock);
+
+		igi.currBlock = endBlock;
+	}
+		break;
+	case Statement::Type::Continue:
+	case Statement::Type::Break:
+		if (igi.loopTargets.empty())
+			THROW_IR_GEN_ERROR(statement->pos, "Continue/break outside of a loop!");
+		emitJmp(igi, statement->type == Statement::Type::Continue ? igi.loopTargets.back().first : igi.loopTargets.back().second);
+		break;
+	case Statement::Type::Expression:
+	{
+		auto expr = (Expression*)statement.get();
+		// Discarded lvalues don't need to be loaded
+		switch (expr->eType)
+		{
+		case Expression::ExprType::Assign:
+		case Expression::ExprType::Assign_Sum:
+		case Expression::ExprType::Assign_Difference:
+		case Expression::ExprType::Assign_Product:
+		case Expression::ExprType::Assign_Quotient:
+		case Expression::ExprType::Assign_Remainder:
+		case Expression::ExprType::Assign_Bw_LeftShift:
+		case Expression::ExprType::Assign_Bw_RightShift:
+		case Expression::ExprType::Assign_Bw_AND:
+		case Expression::ExprType::Assign_Bw_XOR:
+		case Expression::ExprType::Assign_Bw_OR:
+		case Expression::ExprType::Prefix_Increment:
+		case Expression::ExprType::Prefix_Decrement:
+			lowerAddress(igi, expr);
+			break;
+		default:
+			lowerValue(igi, expr);
+			break;
+		}
+	}
+		break;
+	case Statement::Type::Assembly:
+		THROW_IR_GEN_ERROR(statement->pos, "Inline assembly is not supported by the IR!");
+	default:
+		THROW_IR_GEN_ERROR(statement->pos, "Unsupported statement type!");
+	}
+}
+
+// Returns true if the address of a local variable or parameter is used for anything else than loading/storing,
+// in which case it might still be accessed after the frame has been released or reused.
+bool frameEscapes(const IRFunction& irFunc)
+{
+	auto propagatesAddr = [](IROp op)
+	{
+		return op == IROp::Add || op == IROp::Sub || op == IROp::Copy || op == IROp::Phi || op == IROp::Select;
+	};
+
+	std::vector<bool> isFrameAddr(irFunc.valueTypes.size(), false);
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+		for (auto& block : irFunc.blocks)
+		{
+			for (auto& instr : block.instrs)
+			{
+				if (instr.result == -1 || isFrameAddr[instr.result])
+					continue;
+				bool derived = instr.op == IROp::FrameAddr;
+				if (propagatesAddr(instr.op))
+					for (int arg : instr.args)
+						derived |= isFrameAddr[arg];
+				isFrameAddr[instr.result] = derived;
+				changed |= derived;
+			}
+		}
+	}
+
+	for (auto& block : irFunc.blocks)
+	{
+		for (auto& instr : block.instrs)
+		{
+			if (propagatesAddr(instr.op))
+				continue;
+			bool isMemAccess = (instr.op == IROp::Load || instr.op == IROp::Store) && instr.addrBase == IRAddrBase::Value;
+			for (uint64_t i = isMemAccess ? 1 : 0; i < instr.args.size(); ++i)
+				if (isFrameAddr[instr.args[i]])
+					return true;
+		}
+	}
+	return false;
+}
+
+// Self-recursive tail calls become jumps to the start of the function, other tail calls are kept if the frame can be released
+// before the call. The callee must not take parameters on the stack, as there is no space reserved for them.
+void lowerTailCalls(IRFunction& irFunc)
+{
+	bool canRelease = irFunc.retOffset == 0 && !frameEscapes(irFunc);
+	bool hasSelfCalls = false;
+	for (auto& block : irFunc.blocks)
+	{
+		auto& call = block.instrs.back();
+		if (call.op != IROp::TailCall)
+			continue;
+		if (!canRelease || (call.name != irFunc.name && call.imm != 0))
+			demoteTailCall(irFunc, block);
+		else
+			hasSelfCalls |= call.name == irFunc.name;
+	}
+
+	if (!hasSelfCalls)
+		return;
+
+	// The loop header must not be the entry block, so a new one is placed in front of it
+	for (auto& block : irFunc.blocks)
+	{
+		++block.id;
+		for (auto& instr : block.instrs)
+			for (auto& target : instr.targets)
+				++target;
+	}
+	IRBlock entry;
+	IRInstr jmp;
+	jmp.op = IROp::Jmp;
+	jmp.targets = { 1 };
+	entry.instrs.push_back(jmp);
+	irFunc.blocks.insert(irFunc.blocks.begin(), entry);
+
+	auto& params = irFunc.func->func.params;
+	for (auto& block : irFunc.blocks)
+	{
+		auto call = block.instrs.back();
+		if (call.op != IROp::TailCall || call.name != irFunc.name)
+			continue;
+
+		// Overwrite the parameters and start over
+		block.instrs.pop_back();
+		for (uint64_t i = 0; i < params.size(); ++i)
+		{
+			IRInstr addr;
+			addr.op = IROp::FrameAddr;
+			addr.type = IRType::I64;
+			addr.imm = params[i]->var.offset;
+			addr.result = irFunc.valueTypes.size();
+			irFunc.valueTypes.push_back(IRType::I64);
+			block.instrs.push_back(addr);
+
+			IRInstr store;
+			store.op = IROp::Store;
+			store.type = irFunc.valueTypes[call.args[i]];
+			store.args = { addr.result, call.args[i] };
+			block.instrs.push_back(store);
+		}
+		block.instrs.push_back(jmp);
+	}
+}
+
+IRFunctionRef genIRFunction(ProgramRef program, SymbolRef func)
+{
+	IRGenInfo igi;
+	igi.program = program;
+	igi.irFunc = std::make_shared<IRFunction>();
+
+	auto& irFunc = *igi.irFunc;
+	irFunc.name = getMangledName(func);
+	irFunc.func = func;
+	irFunc.frameSize = func->frame.size;
+	irFunc.retOffset = func->func.isRegCall ? 0 : func->func.retOffset;
+	irFunc.nRegParams = getRegParamCount(func);
+	irFunc.retType = getIRType(igi, func->func.retType, func->pos.decl);
+	irFunc.isRetSigned = isSignedInt(func->func.retType);
+
+	igi.currBlock = newBlock(igi);
+	lowerBody(igi, func->func.body);
+
+	removeUnreachableBlocks(irFunc);
+
+	for (auto& block : irFunc.blocks)
+		if (block.instrs.empty() || !isTerminator(block.instrs.back().op))
+			THROW_IR_GEN_ERROR(func->pos.decl, "Function '" + irFunc.name + "' does not end with a terminator!");
+
+	lowerTailCalls(irFunc);
+
+	return igi.irFunc;
+}
+
+void dumpIR(std::ostream& out, ProgramRef program)
+{
+	std::for_each(
+		program->symbols->begin(),
+		program->symbols->end(),
+		[&](SymbolRef sym) {
+			if (!isFuncSpec(sym) || !isDefined(sym) || !isReachable(sym))
+				return;
+
+			try
+			{
+				printIRFunction(out, *genIRFunction(program, sym));
+			}
+			catch (const IRGenError& err)
+			{
+				out << "; " << getMangledName(sym) << ": not lowered: " << err.what() << "\n";
+			}
+			out << "\n";
+		}
+	);
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <ostream>
+
+#include "IR.h"
+#include "Program.h"
+
+// Lowers the function into the IR. Throws an IRGenError if the function uses constructs the IR does not support.
+IRFunctionRef genIRFunction(ProgramRef program, SymbolRef func);
+
+// Writes the IR of all reachable functions, functions that cannot be lowered are listed with the reason.
+void dumpIR(std::ostream& out, ProgramRef program);
@@ -0,0 +1,284 @@
+#include "IRInliner.h"
+
+#include <map>
+#include <algorithm>
+#include <set>
+#include <string>
+
+#define INLINE_SIZE_LIMIT 16 // Max. number of instructions of functions without the 'inline' attribute
+#define INLINE_HINT_SIZE_LIMIT 256 // Max. number of instructions of functions marked with 'inline'
+#define INLINE_CALLER_SIZE_LIMIT 2048 // Larger callers only get functions marked with 'inline' inlined
+
+struct InlinerInfo
+{
+	std::map<std::string, IRFunction*> functions; // Mangled name -> function
+	std::map<std::string, std::set<std::string>> callees; // Mangled name -> Called functions
+	std::set<std::string> recursive; // Functions that are part of a call cycle
+	std::set<std::string> visited;
+	std::vector<IRFunction*> order; // Callees before callers
+
+	// Strongly connected components of the call graph (Tarjan)
+	std::map<std::string, std::pair<int, int>> sccIndices; // Mangled name -> Index, Lowest reachable index
+	std::vector<std::string> sccStack;
+	std::set<std::string> onSccStack;
+};
+
+int getInstrCount(const IRFunction& irFunc)
+{
+	int count = 0;
+	for (auto& block : irFunc.blocks)
+		count += block.instrs.size();
+	return count;
+}
+
+std::set<std::string> getCallees(const IRFunction& irFunc)
+{
+	std::set<std::string> callees;
+	for (auto& block : irFunc.blocks)
+		for (auto& instr : block.instrs)
+			if (instr.op == IROp::Call || instr.op == IROp::TailCall)
+				callees.insert(instr.name);
+	return callees;
+}
+
+// Marks all functions that are part of a call cycle (including direct recursion) as recursive
+void findRecursive(InlinerInfo& ili, const std::string& name)
+{
+	int index = ili.sccIndices.size();
+	ili.sccIndices[name] = { index, index };
+	ili.sccStack.push_back(name);
+	ili.onSccStack.insert(name);
+
+	for (auto& callee : ili.callees[name])
+	{
+		if (ili.functions.find(callee) == ili.functions.end())
+			continue;
+
+		auto it = ili.sccIndices.find(callee);
+		if (it == ili.sccIndices.end())
+		{
+			findRecursive(ili, callee);
+			auto& low = ili.sccIndices[name].second;
+			low = std::min(low, ili.sccIndices[callee].second);
+		}
+		else if (ili.onSccStack.count(callee))
+		{
+			auto& low = ili.sccIndices[name].second;
+			low = std::min(low, it->second.first);
+		}
+	}
+
+	if (ili.sccIndices[name].second != index)
+		return;
+
+	// 'name' is the root of a component, every component with more than one function is a cycle
+	bool isCycle = ili.sccStack.back() != name || ili.callees[name].count(name);
+	std::string member;
+	do
+	{
+		member = ili.sccStack.back();
+		ili.sccStack.pop_back();
+		ili.onSccStack.erase(member);
+		if (isCycle)
+			ili.recursive.insert(member);
+	} while (member != name);
+}
+
+void visitCallees(InlinerInfo& ili, IRFunction* irFunc)
+{
+	if (!ili.visited.insert(irFunc->name).second)
+		return;
+
+	for (auto& callee : ili.callees[irFunc->name])
+	{
+		auto it = ili.functions.find(callee);
+		if (it != ili.functions.end())
+			visitCallees(ili, it->second);
+	}
+	ili.order.push_back(irFunc);
+}
+
+bool shouldInline(InlinerInfo& ili, const IRFunction& caller, const IRInstr& call, const IRFunction*& pCallee)
+{
+	auto it = ili.functions.find(call.name);
+	if (it == ili.functions.end())
+		return false;
+	pCallee = it->second;
+
+	auto& callee = *pCallee;
+	if (callee.func->func.isNoInline || ili.recursive.find(callee.name) != ili.recursive.end())
+		return false;
+	// The parameters must be stored where the prologue of the callee would have stored them
+	if (callee.retOffset != 0 || callee.nRegParams != (int)callee.func->func.params.size() || callee.retType != call.type)
+		return false;
+
+	if (callee.func->func.isInline)
+		return getInstrCount(callee) <= INLINE_HINT_SIZE_LIMIT;
+	return getInstrCount(callee) <= INLINE_SIZE_LIMIT && getInstrCount(caller) < INLINE_CALLER_SIZE_LIMIT;
+}
+
+// Replaces the call by the body of the callee. The blocks of the callee are placed behind the block containing the call,
+// followed by a new block containing the instructions after the call.
+void inlineCall(IRFunction& caller, int blockID, int instrIndex, IRFunction callee)
+{
+	// Tail calls of the callee return to the caller
+	for (auto& block : callee.blocks)
+		if (block.instrs.back().op == IROp::TailCall)
+			demoteTailCall(callee, block);
+
+	IRInstr call = caller.blocks[blockID].instrs[instrIndex];
+	int firstBodyID = blockID + 1;
+	int nNewBlocks = callee.blocks.size() + 1;
+	int contID = blockID + nNewBlocks;
+
+	for (auto& block : caller.blocks)
+	{
+		if (block.id > blockID)
+			block.id += nNewBlocks;
+		for (auto& instr : block.instrs)
+		{
+			for (auto& target : instr.targets)
+			{
+				if (target > blockID)
+					target += nNewBlocks;
+				else if (target == blockID && instr.op == IROp::Phi)
+					target = contID; // The terminator moves into the continuation block
+			}
+		}
+	}
+
+	// The frame of the callee is placed below the local variables of the caller
+	int frameOffset = -(caller.frameSize + 7) / 8 * 8;
+	caller.frameSize = -frameOffset + callee.frameSize;
+
+	int valueOffset = caller.valueTypes.size();
+	caller.valueTypes.insert(caller.valueTypes.end(), callee.valueTypes.begin(), callee.valueTypes.end());
+	caller.usedStringIDs.insert(callee.usedStringIDs.begin(), callee.usedStringIDs.end());
+
+	std::vector<IRBlock> newBlocks = callee.blocks;
+	std::vector<int> retValues;
+	std::vector<int> retBlocks;
+	for (auto& block : newBlocks)
+	{
+		block.id += firstBodyID;
+		for (auto& instr : block.instrs)
+		{
+			if (instr.result != -1)
+				instr.result += valueOffset;
+			for (auto& arg : instr.args)
+				arg += valueOffset;
+			for (auto& target : instr.targets)
+				target += firstBodyID;
+
+			bool isFrameAccess = (instr.op == IROp::Load || instr.op == IROp::Store) && instr.addrBase == IRAddrBase::Frame;
+			if (instr.op == IROp::FrameAddr || isFrameAccess)
+				instr.imm += frameOffset;
+
+			if (instr.op == IROp::Ret)
+			{
+				if (!instr.args.empty())
+				{
+					retValues.push_back(instr.args[0]);
+					retBlocks.push_back(block.id);
+				}
+				instr = IRInstr();
+				instr.op = IROp::Jmp;
+				instr.targets = { contID };
+			}
+		}
+	}
+
+	auto& callBlock = caller.blocks[blockID];
+	IRBlock cont;
+	cont.id = contID;
+	if (call.result != -1 && !retValues.empty())
+	{
+		IRInstr merge;
+		merge.op = retValues.size() == 1 ? IROp::Copy : IROp::Phi;
+		merge.type = call.type;
+		merge.result = call.result;
+		merge.args = retValues;
+		if (merge.op == IROp::Phi)
+			merge.targets = retBlocks;
+		cont.instrs.push_back(merge);
+	}
+	cont.instrs.insert(cont.instrs.end(), callBlock.instrs.begin() + instrIndex + 1, callBlock.instrs.end());
+	callBlock.instrs.resize(instrIndex);
+
+	// Store the parameters where the prologue of the callee would have stored them
+	auto& params = callee.func->func.params;
+	for (uint64_t i = 0; i < params.size(); ++i)
+	{
+		IRInstr store;
+		store.op = IROp::Store;
+		store.type = caller.valueTypes[call.args[i]];
+		store.addrBase = IRAddrBase::Frame;
+		store.imm = params[i]->var.offset + frameOffset;
+		store.args = { call.args[i] };
+		callBlock.instrs.push_back(store);
+	}
+
+	IRInstr jmp;
+	jmp.op = IROp::Jmp;
+	jmp.targets = { firstBodyID };
+	callBlock.instrs.push_back(jmp);
+
+	newBlocks.push_back(cont);
+	caller.blocks.insert(caller.blocks.begin() + firstBodyID, newBlocks.begin(), newBlocks.end());
+}
+
+void inlineCallsInto(InlinerInfo& ili, IRFunction& caller, InlineStats& stats)
+{
+	bool inlined = false;
+	for (uint64_t b = 0; b < caller.blocks.size(); ++b)
+	{
+		for (uint64_t i = 0; i < caller.blocks[b].instrs.size(); ++i)
+		{
+			auto& instr = caller.blocks[b].instrs[i];
+			const IRFunction* pCallee = nullptr;
+			bool isCall = instr.op == IROp::Call || instr.op == IROp::TailCall;
+			if (!isCall || !shouldInline(ili, caller, instr, pCallee))
+				continue;
+
+			if (instr.op == IROp::TailCall)
+				demoteTailCall(caller, caller.blocks[b]);
+			inlineCall(caller, b, i, *pCallee);
+			++stats.nInlinedCalls;
+			inlined = true;
+
+			// Continue with the instructions after the call (the body of the callee has already been processed)
+			b += pCallee->blocks.size();
+			break;
+		}
+	}
+
+	// Callees that never return leave the continuation block unreachable
+	if (inlined)
+		removeUnreachableBlocks(caller);
+}
+
+void inlineCalls(std::vector<IRFunctionRef>& functions, InlineStats& stats)
+{
+	InlinerInfo ili;
+	for (auto& irFunc : functions)
+	{
+		ili.functions[irFunc->name] = irFunc.get();
+		stats.nInstrsBefore += getInstrCount(*irFunc);
+	}
+
+	for (auto& irFunc : functions)
+		ili.callees[irFunc->name] = getCallees(*irFunc);
+
+	for (auto& irFunc : functions)
+		if (ili.sccIndices.find(irFunc->name) == ili.sccIndices.end())
+			findRecursive(ili, irFunc->name);
+
+	for (auto& irFunc : functions)
+		visitCallees(ili, irFunc.get());
+
+	for (auto irFunc : ili.order)
+		inlineCallsInto(ili, *irFunc, stats);
+
+	for (auto& irFunc : functions)
+		stats.nInstrsAfter += getInstrCount(*irFunc);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <vector>
+
+#include "IR.h"
+
+struct InlineStats
+{
+	int nInlinedCalls = 0;
+	int nInstrsBefore = 0; // Number of IR instructions of all functions before inlining
+	int nInstrsAfter = 0; // Number of IR instructions of all functions after inlining
+};
+
+// Replaces calls to small non-recursive functions by the body of the called function.
+// Functions marked with 'inline' get a larger size limit, functions marked with 'noinline' are never inlined.
+// The callees are processed before their callers, so calls inside of inlined bodies have already been inlined.
+void inlineCalls(std::vector<IRFunctionRef>& functions, InlineStats& stats);
@@ -0,0 +1,311 @@
+#include "IRPromote.h"
+
+#include <map>
+#include <set>
+#include <algorithm>
+
+struct PromoteInfo
+{
+	IRFunction* irFunc = nullptr;
+	std::vector<std::vector<int>> preds; // Block -> Predecessors (without duplicates)
+	std::map<int64_t, IRType> slots; // Frame offset -> Type of the promoted slot
+	std::vector<std::map<int64_t, int>> exitDefs; // Block -> (Frame offset -> Last value stored in the block)
+	std::vector<std::map<int64_t, int>> entryDefs; // Block -> (Frame offset -> Value of the slot at the start of the block)
+	std::vector<std::vector<IRInstr>> phis; // Block -> Phis to insert at the start of the block
+	std::vector<IRInstr> entryLoads; // Loads of the values the slots hold on function entry (parameters, uninitialized variables)
+	std::map<int, int> replacements; // Value -> Value replacing it
+};
+
+// Returns true if the instruction loads/stores a whole frame slot, either relative to the frame base or through a FrameAddr value
+bool getFrameSlot(const std::vector<const IRInstr*>& defs, const IRInstr& instr, int64_t& offset)
+{
+	if ((instr.op != IROp::Load && instr.op != IROp::Store) || instr.scale != 0)
+		return false;
+	if (instr.addrBase == IRAddrBase::Frame)
+	{
+		offset = instr.imm;
+		return true;
+	}
+
+	auto def = instr.addrBase == IRAddrBase::Value ? defs[instr.args[0]] : nullptr;
+	if (!def || def->op != IROp::FrameAddr)
+		return false;
+	offset = def->imm + instr.imm;
+	return true;
+}
+
+int newValue(PromoteInfo& pi, IRType type)
+{
+	pi.irFunc->valueTypes.push_back(type);
+	return pi.irFunc->valueTypes.size() - 1;
+}
+
+int readSlotAtEntry(PromoteInfo& pi, int block, int64_t offset);
+
+int readSlotAtExit(PromoteInfo& pi, int block, int64_t offset)
+{
+	auto it = pi.exitDefs[block].find(offset);
+	if (it != pi.exitDefs[block].end())
+		return it->second;
+	return readSlotAtEntry(pi, block, offset);
+}
+
+int readSlotAtEntry(PromoteInfo& pi, int block, int64_t offset)
+{
+	auto it = pi.entryDefs[block].find(offset);
+	if (it != pi.entryDefs[block].end())
+		return it->second;
+
+	IRType type = pi.slots[offset];
+	auto& preds = pi.preds[block];
+	if (block == 0)
+	{
+		IRInstr load;
+		load.op = IROp::Load;
+		load.type = type;
+		load.result = newValue(pi, type);
+		load.addrBase = IRAddrBase::Frame;
+		load.imm = offset;
+		pi.entryLoads.push_back(load);
+		return pi.entryDefs[block][offset] = load.result;
+	}
+
+	if (preds.size() == 1)
+		return pi.entryDefs[block][offset] = readSlotAtExit(pi, preds[0], offset);
+
+	// The phi is registered before reading the incoming values, so loops end at the phi
+	IRInstr phi;
+	phi.op = IROp::Phi;
+	phi.type = type;
+	phi.result = newValue(pi, type);
+	pi.entryDefs[block][offset] = phi.result;
+	for (int pred : preds)
+	{
+		phi.args.push_back(readSlotAtExit(pi, pred, offset));
+		phi.targets.push_back(pred);
+	}
+	pi.phis[block].push_back(phi);
+	return phi.result;
+}
+
+int resolveValue(const std::map<int, int>& replacements, int value)
+{
+	for (auto it = replacements.find(value); it != replacements.end(); it = replacements.find(value))
+		value = it->second;
+	return value;
+}
+
+void applyReplacements(PromoteInfo& pi)
+{
+	for (auto& block : pi.irFunc->blocks)
+		for (auto& instr : block.instrs)
+			for (auto& arg : instr.args)
+				arg = resolveValue(pi.replacements, arg);
+	pi.replacements.clear();
+}
+
+// Removes phis whose incoming values are all the same (apart from the phi itself) and phis that are only used by other phis
+void removeRedundantPhis(PromoteInfo& pi)
+{
+	auto& blocks = pi.irFunc->blocks;
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+		for (auto& block : blocks)
+		{
+			for (auto& instr : block.instrs)
+			{
+				if (instr.op != IROp::Phi)
+					break;
+
+				int same = -1;
+				bool isTrivial = true;
+				for (int arg : instr.args)
+				{
+					if (arg == instr.result || arg == same)
+						continue;
+					if (same != -1)
+						isTrivial = false;
+					same = arg;
+				}
+				if (!isTrivial || same == -1)
+					continue;
+
+				pi.replacements[instr.result] = same;
+				instr.op = IROp::None;
+				changed = true;
+			}
+		}
+
+		applyReplacements(pi);
+		for (auto& block : blocks)
+			block.instrs.erase(
+				std::remove_if(block.instrs.begin(), block.instrs.end(), [](const IRInstr& instr) { return instr.op == IROp::None; }),
+				block.instrs.end()
+			);
+	}
+
+	std::vector<bool> isUsed(pi.irFunc->valueTypes.size(), false);
+	std::vector<const IRInstr*> phiDefs(pi.irFunc->valueTypes.size(), nullptr);
+	std::vector<int> work;
+	for (auto& block : blocks)
+	{
+		for (auto& instr : block.instrs)
+		{
+			if (instr.op == IROp::Phi)
+			{
+				phiDefs[instr.result] = &instr;
+				continue;
+			}
+			for (int arg : instr.args)
+				work.push_back(arg);
+		}
+	}
+	while (!work.empty())
+	{
+		int value = work.back();
+		work.pop_back();
+		if (isUsed[value])
+			continue;
+		isUsed[value] = true;
+		if (phiDefs[value])
+			work.insert(work.end(), phiDefs[value]->args.begin(), phiDefs[value]->args.end());
+	}
+
+	for (auto& block : blocks)
+		block.instrs.erase(
+			std::remove_if(block.instrs.begin(), block.instrs.end(), [&](const IRInstr& instr) { return instr.op == IROp::Phi && !isUsed[instr.result]; }),
+			block.instrs.end()
+		);
+}
+
+int promoteLocals(IRFunction& irFunc)
+{
+	PromoteInfo pi;
+	pi.irFunc = &irFunc;
+	pi.preds = getPredecessors(irFunc);
+	for (auto& preds : pi.preds)
+		preds.erase(std::unique(preds.begin(), preds.end()), preds.end());
+
+	// The values of the slots on function entry are loaded in front of the first instruction
+	if (!pi.preds[0].empty())
+		return 0;
+
+	std::vector<const IRInstr*> defs(irFunc.valueTypes.size(), nullptr);
+	for (auto& block : irFunc.blocks)
+		for (auto& instr : block.instrs)
+			if (instr.result != -1)
+				defs[instr.result] = &instr;
+
+	// Slots are accessed with a single type and their address is not used for anything else.
+	// Stored values have the type of the slot, so forwarding them keeps the width (Trunc/ZExt do the normalization).
+	std::map<int64_t, IRType> types;
+	std::set<int64_t> escaping;
+	std::set<int64_t> written;
+	bool hasCalls = false;
+	for (auto& block : irFunc.blocks)
+	{
+		for (auto& instr : block.instrs)
+		{
+			hasCalls |= instr.op == IROp::Call || instr.op == IROp::CallIndirect;
+
+			int64_t offset;
+			bool isSlotAccess = getFrameSlot(defs, instr, offset);
+			if (isSlotAccess)
+			{
+				if (instr.op == IROp::Store)
+					written.insert(offset);
+				auto it = types.insert({ offset, instr.type }).first;
+				bool isMismatch = it->second != instr.type || (instr.op == IROp::Store && irFunc.valueTypes[instr.args.back()] != instr.type);
+				if (isMismatch)
+					escaping.insert(offset);
+			}
+
+			for (uint64_t i = 0; i < instr.args.size(); ++i)
+			{
+				auto def = defs[instr.args[i]];
+				bool isAddrArg = isSlotAccess && instr.addrBase == IRAddrBase::Value && i == 0;
+				if (def && def->op == IROp::FrameAddr && !isAddrArg)
+					escaping.insert(def->imm);
+			}
+		}
+	}
+
+	// Parameters that are never assigned are kept in the frame by functions with calls, where the values would occupy callee-saved registers
+	if (hasCalls)
+		for (auto& [offset, type] : types)
+			if (written.find(offset) == written.end())
+				escaping.insert(offset);
+
+	// Overlapping slots (variables of different scopes sharing frame space with different types) stay in memory
+	for (auto& [offset, type] : types)
+		if (escaping.find(offset) == escaping.end())
+			pi.slots[offset] = type;
+	for (auto it = pi.slots.begin(); it != pi.slots.end() && std::next(it) != pi.slots.end(); ++it)
+	{
+		auto next = std::next(it);
+		if (it->first + getIRTypeSize(it->second) > next->first)
+		{
+			escaping.insert(it->first);
+			escaping.insert(next->first);
+		}
+	}
+	for (auto offset : escaping)
+		pi.slots.erase(offset);
+	if (pi.slots.empty())
+		return 0;
+
+	int nBlocks = irFunc.blocks.size();
+	pi.exitDefs.resize(nBlocks);
+	pi.entryDefs.resize(nBlocks);
+	pi.phis.resize(nBlocks);
+
+	for (auto& block : irFunc.blocks)
+	{
+		for (auto& instr : block.instrs)
+		{
+			int64_t offset;
+			if (instr.op == IROp::Store && getFrameSlot(defs, instr, offset) && pi.slots.count(offset))
+				pi.exitDefs[block.id][offset] = instr.args.back();
+		}
+	}
+
+	// Loads are replaced by the last value stored to the slot, stores are removed
+	for (auto& block : irFunc.blocks)
+	{
+		std::map<int64_t, int> currDefs;
+		for (auto& instr : block.instrs)
+		{
+			int64_t offset;
+			if (!getFrameSlot(defs, instr, offset) || !pi.slots.count(offset))
+				continue;
+
+			if (instr.op == IROp::Store)
+			{
+				currDefs[offset] = instr.args.back();
+			}
+			else
+			{
+				auto it = currDefs.find(offset);
+				pi.replacements[instr.result] = it != currDefs.end() ? it->second : readSlotAtEntry(pi, block.id, offset);
+			}
+			instr.op = IROp::None;
+		}
+	}
+
+	for (auto& block : irFunc.blocks)
+	{
+		block.instrs.erase(
+			std::remove_if(block.instrs.begin(), block.instrs.end(), [](const IRInstr& instr) { return instr.op == IROp::None; }),
+			block.instrs.end()
+		);
+		block.instrs.insert(block.instrs.begin(), pi.phis[block.id].begin(), pi.phis[block.id].end());
+	}
+	irFunc.blocks[0].instrs.insert(irFunc.blocks[0].instrs.begin(), pi.entryLoads.begin(), pi.entryLoads.end());
+
+	applyReplacements(pi);
+	removeRedundantPhis(pi);
+
+	return pi.slots.size();
+}
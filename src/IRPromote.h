@@ -0,0 +1,9 @@
+#pragma once
+
+#include "IR.h"
+
+// Keeps local variables and parameters in SSA values instead of the stack frame. Only frame slots whose address is used
+// for nothing else than loads/stores of a single type are promoted (the address of the others might be stored, passed on, ...).
+// Phis are inserted where control flow merges, slots that are read before being written are loaded once on function entry.
+// Returns the number of promoted slots.
+int promoteLocals(IRFunction& irFunc);
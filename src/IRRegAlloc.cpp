@@ -0,0 +1,304 @@
+#include "IRRegAlloc.h"
+
+#include <algorithm>
+#include <cassert>
+
+struct LiveInterval
+{
+	int value = -1;
+	int start = -1;
+	int end = -1;
+	bool crossesCall = false;
+	bool forbidRCX = false; // Live across shifts (count register)
+	bool forbidRDX = false; // Live across/used by divisions (remainder register)
+};
+
+bool isCalleeSaved(IRReg reg)
+{
+	switch (reg)
+	{
+	case IRReg::RBX:
+	case IRReg::R12:
+	case IRReg::R13:
+	case IRReg::R14:
+	case IRReg::R15:
+		return true;
+	default:
+		return false;
+	}
+}
+
+const std::string& IRRegName(IRReg reg, IRType type)
+{
+	static const std::string names[][4] = {
+		{ "rax", "eax", "ax", "al" },
+		{ "rbx", "ebx", "bx", "bl" },
+		{ "rcx", "ecx", "cx", "cl" },
+		{ "rdx", "edx", "dx", "dl" },
+		{ "rsi", "esi", "si", "sil" },
+		{ "rdi", "edi", "di", "dil" },
+		{ "r8", "r8d", "r8w", "r8b" },
+		{ "r9", "r9d", "r9w", "r9b" },
+		{ "r10", "r10d", "r10w", "r10b" },
+		{ "r11", "r11d", "r11w", "r11b" },
+		{ "r12", "r12d", "r12w", "r12b" },
+		{ "r13", "r13d", "r13w", "r13b" },
+		{ "r14", "r14d", "r14w", "r14b" },
+		{ "r15", "r15d", "r15w", "r15b" },
+	};
+
+	int index = 0;
+	switch (type)
+	{
+	case IRType::I64: index = 0; break;
+	case IRType::I32: index = 1; break;
+	case IRType::I16: index = 2; break;
+	case IRType::I8: index = 3; break;
+	default:
+		assert(false && "Invalid IR type!");
+	}
+	return names[(int)reg][index];
+}
+
+// Computes the live interval (without holes) of every value.
+// Instructions are numbered in layout order, phi arguments are used at the end of the incoming block.
+std::vector<LiveInterval> buildLiveIntervals(const IRFunction& irFunc)
+{
+	int nBlocks = irFunc.blocks.size();
+	int nValues = irFunc.valueTypes.size();
+
+	std::vector<int> blockFrom(nBlocks), blockTo(nBlocks);
+	std::vector<std::set<int>> uses(nBlocks), defs(nBlocks);
+	std::vector<std::vector<std::pair<int, int>>> phiUses(nBlocks); // Block -> (value, position) used by phis of successors
+	std::vector<int> callPositions, shiftPositions, divPositions;
+
+	int pos = 0;
+	for (int b = 0; b < nBlocks; ++b)
+	{
+		auto& block = irFunc.blocks[b];
+		assert(block.id == b && "Blocks must be numbered in layout order!");
+		blockFrom[b] = pos;
+		for (auto& instr : block.instrs)
+		{
+			if (instr.op != IROp::Phi)
+				for (int arg : instr.args)
+					if (defs[b].find(arg) == defs[b].end())
+						uses[b].insert(arg);
+			if (instr.result != -1)
+				defs[b].insert(instr.result);
+
+			switch (instr.op)
+			{
+			case IROp::Call:
+			case IROp::CallIndirect:
+				callPositions.push_back(pos);
+				break;
+			case IROp::Shl:
+			case IROp::Shr:
+				if (!instr.isImmRhs)
+					shiftPositions.push_back(pos);
+				break;
+			case IROp::UDiv:
+			case IROp::SDiv:
+			case IROp::URem:
+			case IROp::SRem:
+				divPositions.push_back(pos);
+				break;
+			default:
+				break;
+			}
+
+			pos += 2;
+		}
+		blockTo[b] = pos - 2;
+	}
+
+	for (auto& block : irFunc.blocks)
+		for (auto& instr : block.instrs)
+			if (instr.op == IROp::Phi)
+				for (uint64_t i = 0; i < instr.args.size(); ++i)
+					phiUses[instr.targets[i]].push_back({ instr.args[i], blockTo[instr.targets[i]] });
+
+	// Liveness (backwards dataflow)
+	std::vector<std::set<int>> liveIn(nBlocks), liveOut(nBlocks);
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+		for (int b = nBlocks - 1; b >= 0; --b)
+		{
+			std::set<int> out;
+			for (auto& [value, usePos] : phiUses[b])
+				out.insert(value);
+			for (int succ : getSuccessors(irFunc.blocks[b]))
+				out.insert(liveIn[succ].begin(), liveIn[succ].end());
+
+			std::set<int> in = uses[b];
+			for (int value : out)
+				if (defs[b].find(value) == defs[b].end())
+					in.insert(value);
+
+			if (in != liveIn[b] || out != liveOut[b])
+			{
+				liveIn[b] = std::move(in);
+				liveOut[b] = std::move(out);
+				changed = true;
+			}
+		}
+	}
+
+	std::vector<LiveInterval> intervals(nValues);
+	auto extend = [&](int value, int position)
+	{
+		auto& interval = intervals[value];
+		interval.value = value;
+		if (interval.start == -1 || position < interval.start)
+			interval.start = position;
+		if (interval.end == -1 || position > interval.end)
+			interval.end = position;
+	};
+
+	pos = 0;
+	for (int b = 0; b < nBlocks; ++b)
+	{
+		for (int value : liveIn[b])
+			extend(value, blockFrom[b]);
+		for (int value : liveOut[b])
+			extend(value, blockTo[b]);
+		for (auto& [value, usePos] : phiUses[b])
+			extend(value, usePos);
+
+		for (auto& instr : irFunc.blocks[b].instrs)
+		{
+			// All phis of a block are defined at the same time
+			if (instr.op == IROp::Phi)
+				extend(instr.result, blockFrom[b]);
+			else if (instr.result != -1)
+				extend(instr.result, pos);
+
+			if (instr.op != IROp::Phi)
+				for (int arg : instr.args)
+					extend(arg, pos);
+
+			pos += 2;
+		}
+	}
+
+	auto anyBetween = [](const std::vector<int>& positions, int from, int to) -> bool
+	{
+		auto it = std::upper_bound(positions.begin(), positions.end(), from);
+		return it != positions.end() && *it < to;
+	};
+
+	for (auto& interval : intervals)
+	{
+		if (interval.value == -1)
+			continue;
+		interval.crossesCall = anyBetween(callPositions, interval.start, interval.end);
+		interval.forbidRCX = anyBetween(shiftPositions, interval.start, interval.end);
+		interval.forbidRDX = anyBetween(divPositions, interval.start, interval.end + 1);
+	}
+
+	return intervals;
+}
+
+bool isRegAllowed(const LiveInterval& interval, IRReg reg)
+{
+	if (interval.crossesCall && !isCalleeSaved(reg))
+		return false;
+	if (interval.forbidRCX && reg == IRReg::RCX)
+		return false;
+	if (interval.forbidRDX && reg == IRReg::RDX)
+		return false;
+	return true;
+}
+
+IRRegAllocation allocateRegisters(const IRFunction& irFunc)
+{
+	// Caller-saved registers come first, they don't need to be saved in the prologue
+	static const std::vector<IRReg> allocatable = {
+		IRReg::RCX, IRReg::RDX, IRReg::RSI, IRReg::RDI, IRReg::R8, IRReg::R9, IRReg::R10,
+		IRReg::RBX, IRReg::R12, IRReg::R13, IRReg::R14, IRReg::R15,
+	};
+
+	IRRegAllocation alloc;
+	alloc.valueRegs.resize(irFunc.valueTypes.size(), -1);
+	alloc.valueSpillSlots.resize(irFunc.valueTypes.size(), -1);
+
+	auto intervals = buildLiveIntervals(irFunc);
+	std::vector<const LiveInterval*> sorted;
+	for (auto& interval : intervals)
+		if (interval.value != -1)
+			sorted.push_back(&interval);
+	std::sort(
+		sorted.begin(), sorted.end(),
+		[](const LiveInterval* a, const LiveInterval* b) { return a->start < b->start || (a->start == b->start && a->value < b->value); }
+	);
+
+	auto spill = [&](int value)
+	{
+		alloc.valueRegs[value] = -1;
+		alloc.valueSpillSlots[value] = alloc.nSpillSlots++;
+	};
+
+	std::vector<const LiveInterval*> active;
+	std::set<IRReg> freeRegs(allocatable.begin(), allocatable.end());
+
+	for (auto pInterval : sorted)
+	{
+		// Expire intervals that ended before the current one starts.
+		// An interval ending at the definition of the current one can pass its register on
+		// (operands are read before the result is written).
+		for (auto it = active.begin(); it != active.end();)
+		{
+			auto pActive = *it;
+			if (pActive->end < pInterval->start || (pActive->end == pInterval->start && pActive->start < pInterval->start))
+			{
+				freeRegs.insert((IRReg)alloc.valueRegs[pActive->value]);
+				it = active.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+
+		int chosen = -1;
+		for (auto reg : allocatable)
+		{
+			if (freeRegs.find(reg) != freeRegs.end() && isRegAllowed(*pInterval, reg))
+			{
+				chosen = (int)reg;
+				break;
+			}
+		}
+
+		if (chosen == -1)
+		{
+			// Spill the interval that lives the longest (if its register can be used by the current one)
+			const LiveInterval* pVictim = nullptr;
+			for (auto pActive : active)
+				if (isRegAllowed(*pInterval, (IRReg)alloc.valueRegs[pActive->value]) && (!pVictim || pActive->end > pVictim->end))
+					pVictim = pActive;
+
+			if (!pVictim || pVictim->end <= pInterval->end)
+			{
+				spill(pInterval->value);
+				continue;
+			}
+
+			chosen = alloc.valueRegs[pVictim->value];
+			spill(pVictim->value);
+			active.erase(std::find(active.begin(), active.end(), pVictim));
+			freeRegs.insert((IRReg)chosen);
+		}
+
+		freeRegs.erase((IRReg)chosen);
+		alloc.valueRegs[pInterval->value] = chosen;
+		active.push_back(pInterval);
+		if (isCalleeSaved((IRReg)chosen))
+			alloc.usedCalleeSaved.insert((IRReg)chosen);
+	}
+
+	return alloc;
+}
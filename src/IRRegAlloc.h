@@ -0,0 +1,45 @@
+#pragma once
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "IR.h"
+
+// The 14 general purpose registers (rsp and rbp are reserved for the stack frame)
+enum class IRReg
+{
+	RAX,
+	RBX,
+	RCX,
+	RDX,
+	RSI,
+	RDI,
+	R8,
+	R9,
+	R10,
+	R11,
+	R12,
+	R13,
+	R14,
+	R15,
+};
+
+// rax and r11 are never allocated, the backend uses them as scratch registers.
+// rbx and r12-r15 are callee-saved, all other registers are clobbered by calls.
+bool isCalleeSaved(IRReg reg);
+
+const std::string& IRRegName(IRReg reg, IRType type);
+
+struct IRRegAllocation
+{
+	std::vector<int> valueRegs; // Value ID -> register (-1 if the value got spilled)
+	std::vector<int> valueSpillSlots; // Value ID -> spill slot index (-1 if the value lives in a register)
+	int nSpillSlots = 0;
+	std::set<IRReg> usedCalleeSaved;
+};
+
+// Assigns registers to the values of the function using linear scan over the live ranges.
+// Values that are live across calls only get callee-saved registers, values that don't fit are spilled.
+// The block layout must not change afterwards.
+IRRegAllocation allocateRegisters(const IRFunction& irFunc);
@@ -1,11 +1,19 @@
 #include "NasmGenerator.h"
 
+#include <map>
 #include <stack>
-#include <sstream>
+#include <climits>
 #include <cassert>
 #include <algorithm>
 
+#include "Peephole.h"
+#include "AsmBuffer.h"
+#include "ParallelFor.h"
+#include "ConstEval.h"
+#include "IRBackend.h"
+#include "IRGenerator.h"
 #include "Errors/NasmGenError.h"
+#include "Errors/IRGenError.h"
 
 #define LABEL_ID_CONTINUE		0
 #define LABEL_ID_BREAK			1
@@ -18,6 +26,8 @@
 #define LABEL_ID_IF_END			0
 #define LABEL_ID_IF_NEXT		1
 
+#define INLINE_MEMCPY_MAX_SIZE	64 // Larger pack copies use 'rep movsb'
+
 struct CellInfo
 {
 	enum class State
@@ -36,36 +46,30 @@ typedef CellInfo::State CellState;
 struct NasmGenInfo
 {
 	ProgramRef program;
-	std::stringstream ss;
+	AsmBuffer ss;
 	std::stack<CellInfo> stackCells; // Used to keep track of pushed values and to know when to destroy xvalues
 	CellInfo primReg;
 	CellInfo secReg;
 	
 	std::vector<std::string> labelStack; // Used for control flow statements
+	std::string labelPrefix = "__#"; // Functions get their own label namespace, so they can be generated independently
+	int labelID = 0;
 
 	std::stack<int> loopLabelMarks;
 
 	std::set<int> usedStringIDs;
 
-	bool generateComments;
+	NasmGenOptions opts;
 };
 
-std::string hexString(uint64_t val)
+std::string makeUniqueLabel(NasmGenInfo& ngi, const std::string& name)
 {
-	std::stringstream ss;
-	ss << "0x" << std::hex << val;
-	return ss.str();
-}
-
-std::string makeUniqueLabel(const std::string& name)
-{
-	static int labelID = 0;
-	return "__#" + std::to_string(labelID++) + "_" + name;
+	return ngi.labelPrefix + std::to_string(ngi.labelID++) + "_" + name;
 }
 
 void pushLabel(NasmGenInfo& ngi, const std::string& name)
 {
-	ngi.labelStack.push_back(makeUniqueLabel(name));
+	ngi.labelStack.push_back(makeUniqueLabel(ngi, name));
 }
 
 const std::string& getLabel(NasmGenInfo& ngi, int index)
@@ -85,7 +89,7 @@ void replaceLabel(NasmGenInfo& ngi, const std::string& name, int index)
 {
 	assert(index < ngi.labelStack.size() && "Replace label index out of range!");
 
-	ngi.labelStack[ngi.labelStack.size() - 1 - index] = makeUniqueLabel(name);
+	ngi.labelStack[ngi.labelStack.size() - 1 - index] = makeUniqueLabel(ngi, name);
 }
 
 void placeLabel(NasmGenInfo& ngi, int index)
@@ -125,36 +129,44 @@ std::string basePtrOffset(int offset)
 {
 	bool isNeg = offset < 0;
 	if (isNeg) offset = -offset;
-	return std::string("[rbp ") + (isNeg ? "- " : "+ ") + hexString(offset) + "]";
+	std::string str = isNeg ? "[rbp - " : "[rbp + ";
+	str += hexString(offset);
+	str += ']';
+	return str;
 }
 
-std::string regName(char baseChar, int size)
+const std::string& regName(char baseChar, int size)
 {
-	std::stringstream ss;
-	switch (size)
+	static const std::string names[][4] = {
+		{ "al", "ax", "eax", "rax" },
+		{ "bl", "bx", "ebx", "rbx" },
+		{ "cl", "cx", "ecx", "rcx" },
+		{ "dl", "dx", "edx", "rdx" },
+	};
+	static const std::string invalid;
+
+	int sizeIndex = size == 1 ? 0 : size == 2 ? 1 : size == 4 ? 2 : size == 8 ? 3 : -1;
+	if (baseChar < 'a' || baseChar > 'd' || sizeIndex == -1)
 	{
-	case 1: ss << baseChar << "l"; break;
-	case 2: ss << baseChar << "x"; break;
-	case 4: ss << "e" << baseChar << "x"; break;
-	case 8: ss << "r" << baseChar << "x"; break;
-		assert("Invalid register size!" && false);
+		assert("Invalid register!" && false);
+		return invalid;
 	}
-	return ss.str();
+	return names[baseChar - 'a'][sizeIndex];
 }
 
-std::string primRegName(int size)
+const std::string& primRegName(int size)
 {
 	return regName('a', size);
 }
-std::string primRegName(NasmGenInfo& ngi)
+const std::string& primRegName(NasmGenInfo& ngi)
 {
 	return primRegName(getDatatypeSize(ngi.program, ngi.primReg.datatype, true));
 }
-std::string secRegName(int size)
+const std::string& secRegName(int size)
 {
 	return regName('c', size);
 }
-std::string secRegName(NasmGenInfo& ngi)
+const std::string& secRegName(NasmGenInfo& ngi)
 {
 	return secRegName(getDatatypeSize(ngi.program, ngi.secReg.datatype, true));
 }
@@ -349,35 +361,69 @@ void generateComparison(NasmGenInfo& ngi, const Expression* expr)
 	ngi.ss << "  cmp " << primRegUsage(ngi) << ", " << secRegUsage(ngi) << "\n";
 }
 
+// Divides the primary by the secondary register and returns the name of the register holding the remainder.
+// The dividend gets sign-/zero-extended into the upper half (ah/dx/edx/rdx) first.
+std::string generateDivision(NasmGenInfo& ngi)
+{
+	int size = getDatatypeSize(ngi.program, ngi.primReg.datatype);
+	bool isSigned = isSignedInt(ngi.primReg.datatype);
+	std::string remainderName = size == 1 ? "ah" : regName('d', size);
+
+	if (size == 1)
+		ngi.ss << (isSigned ? "  cbw\n" : "  movzx ax, al\n");
+	else if (!isSigned)
+		ngi.ss << "  xor " << remainderName << ", " << remainderName << "\n";
+	else
+		ngi.ss << "  " << (size == 2 ? "cwd" : (size == 4 ? "cdq" : "cqo")) << "\n";
+
+	ngi.ss << "  " << instrPrefix(ngi.primReg.datatype) << "div " << secRegUsage(ngi) << "\n";
+	return remainderName;
+}
+
+// Pack copies have a size known at compile time, so they are expanded inline instead of calling std.memcpy (-O1 and above).
+// Like the call it replaces, the copy may clobber rcx, rdx, rsi, rdi and xmm0.
 void genMemcpy(NasmGenInfo& ngi, const std::string& destReg, const std::string& srcReg, int size)
 {
-	auto func = getSymbol(
-		getSymbol(ngi.program->symbols, "memcpy"),
-		getSignatureNoRet(
-			{
-				Datatype(DTType::Pointer, Datatype("void")), 
-				Datatype(DTType::Pointer, Datatype("void")),
-				Datatype("u64")
-			}
-		),
-		true
-	);
-	func->func.isReachable = true;
+	// std.memcpy is only part of the program if it is imported and used, so -O0 copies with 'rep movsb' as well
+	if (size > INLINE_MEMCPY_MAX_SIZE || ngi.opts.optLevel < 1)
+	{
+		ngi.ss << "  mov rdi, " << destReg << "\n";
+		ngi.ss << "  mov rsi, " << srcReg << "\n";
+		ngi.ss << "  mov rcx, " << size << "\n";
+		ngi.ss << "  rep movsb\n";
+		return;
+	}
 
-	ngi.ss << "  push " << size << "\n";
-	ngi.ss << "  push " << srcReg << "\n";
-	ngi.ss << "  push " << destReg << "\n";
-	ngi.ss << "  call " << getMangledName(func) << "\n";
-	ngi.ss << "  add rsp, " << 3 * 8 << "\n";
+	auto addr = [](const std::string& reg, int offset)
+	{
+		return "[" + reg + (offset > 0 ? " + " + std::to_string(offset) : "") + "]";
+	};
+
+	int offset = 0;
+	for (; size - offset >= 16; offset += 16)
+	{
+		ngi.ss << "  movups xmm0, " << addr(srcReg, offset) << "\n";
+		ngi.ss << "  movups " << addr(destReg, offset) << ", xmm0\n";
+	}
+	for (int chunk = 8; chunk > 0; chunk /= 2)
+	{
+		for (; size - offset >= chunk; offset += chunk)
+		{
+			ngi.ss << "  mov " << regName('d', chunk) << ", " << addr(srcReg, offset) << "\n";
+			ngi.ss << "  mov " << addr(destReg, offset) << ", " << regName('d', chunk) << "\n";
+		}
+	}
 }
 
 #define DISABLE_EXPR_FOR_PACKS(ngi, expr) \
 	assert(!isPackType(ngi.program, expr->datatype) && "Invalid expression for pack type!")
 
+static const char* regParamNames[MAX_REG_PARAM_COUNT] = { "rdi", "rsi", "rdx", "rcx", "r8", "r9" };
+
 void genFuncCall(NasmGenInfo& ngi, const Expression* expr)
 {
 	bool isVoidFunc = dtEqual(expr->datatype, Datatype{ "void" });
-	if (!isVoidFunc)
+	if (!isVoidFunc && !expr->isRegCall)
 	{
 		if (isPackType(ngi.program, expr->datatype))
 			pushXValue(ngi, expr->datatype);
@@ -407,13 +453,20 @@ void genFuncCall(NasmGenInfo& ngi, const Expression* expr)
 	auto exprType = Datatype(DTType::FuncPtr, getSignature(expr));
 	bool typesMatch = dtEqual(ngi.primReg.datatype, exprType, true);
 	assert(typesMatch && "Cannot call non-function!");
+
+	// The first parameters are on top of the stack
+	int nRegParams = getRegParamCount(expr);
+	for (int i = 0; i < nRegParams; ++i)
+		ngi.ss << "  pop " << regParamNames[i] << "\n";
+
 	ngi.ss << "  call " << primRegUsage(ngi) << "\n";
-	ngi.ss << "  add rsp, " << hexString(expr->paramSizeSum) << "\n";
+	if (expr->paramSizeSum > 0)
+		ngi.ss << "  add rsp, " << hexString(expr->paramSizeSum) << "\n";
 
 	ngi.primReg.datatype = expr->datatype;
 	ngi.primReg.state = CellState::rValue;
 
-	if (!isVoidFunc)
+	if (!isVoidFunc && !expr->isRegCall)
 	{
 		if (isPackType(ngi.program, ngi.primReg.datatype))
 		{
@@ -495,9 +548,9 @@ void genExpr(NasmGenInfo& ngi, const Expression* expr)
 			(isEnum(ngi.program, oldType))
 			)
 		{
-			if (oldSize == 4 && newSize == 8)
-				break;
-			if (oldSize < newSize)
+			if (oldSize == 4 && newSize == 8) // Writing the 32 bit register clears the upper half
+				ss << "  mov " << primRegName(4) << ", " << primRegName(4) << "\n";
+			else if (oldSize < newSize)
 				ss << "  movzx " << primRegName(newSize) << ", " << primRegName(oldSize) << "\n";
 			break;
 		}
@@ -604,10 +657,7 @@ void genExpr(NasmGenInfo& ngi, const Expression* expr)
 
 		bool pushed = primRegLToRVal(ngi, true);
 
-		auto remainderName = regName('d', getDatatypeSize(ngi.program, ngi.primReg.datatype));
-		ss << "  xor " << remainderName << ", " << remainderName << "\n";
-
-		ss << "  " << instrPrefix(ngi.primReg.datatype) << "div " << secRegUsage(ngi) << "\n";
+		generateDivision(ngi);
 
 		primRegRToLVal(ngi, pushed);
 
@@ -624,11 +674,7 @@ void genExpr(NasmGenInfo& ngi, const Expression* expr)
 
 		bool pushed = primRegLToRVal(ngi, true);
 
-		auto remainderName = regName('d', getDatatypeSize(ngi.program, ngi.primReg.datatype));
-
-		ss << "  xor " << remainderName << ", " << remainderName << "\n";
-
-		ss << "  " << instrPrefix(ngi.primReg.datatype) << "div " << secRegUsage(ngi) << "\n";
+		auto remainderName = generateDivision(ngi);
 		ss << "  mov " << primRegUsage(ngi) << ", " << remainderName << "\n";
 
 		primRegRToLVal(ngi, pushed);
@@ -888,10 +934,7 @@ void genExpr(NasmGenInfo& ngi, const Expression* expr)
 		primRegLToRVal(ngi);
 		secRegLToRVal(ngi);
 
-		auto remainderName = regName('d', getDatatypeSize(ngi.program, ngi.primReg.datatype));
-		ss << "  xor " << remainderName << ", " << remainderName << "\n";
-
-		ss << "  " << instrPrefix(ngi.primReg.datatype) << "div " << secRegUsage(ngi) << "\n";
+		generateDivision(ngi);
 		// Datatype doesn't change
 		// State already modified
 	}
@@ -903,11 +946,7 @@ void genExpr(NasmGenInfo& ngi, const Expression* expr)
 		primRegLToRVal(ngi);
 		secRegLToRVal(ngi);
 
-		auto remainderName = regName('d', getDatatypeSize(ngi.program, ngi.primReg.datatype));
-
-		ss << "  xor " << remainderName << ", " << remainderName << "\n";
-
-		ss << "  " << instrPrefix(ngi.primReg.datatype) << "div " << secRegUsage(ngi) << "\n";
+		auto remainderName = generateDivision(ngi);
 		ss << "  mov " << primRegUsage(ngi) << ", " << remainderName << "\n";
 		// Datatype doesn't change
 		// State already modified
@@ -1019,13 +1058,17 @@ void genExpr(NasmGenInfo& ngi, const Expression* expr)
 		genExpr(ngi, expr->right.get());
 		primRegLToRVal(ngi);
 		int dtSize = getDatatypeSize(ngi.program, expr->datatype);
-		if (dtSize != 1)
+		bool isScale = ngi.opts.optLevel >= 1 && (dtSize == 1 || dtSize == 2 || dtSize == 4 || dtSize == 8);
+		if (!isScale && dtSize != 1)
 		{
 			ss << "  mov " << secRegName(8) << ", " << dtSize << "\n";
 			ss << "  mul " << secRegName(8) << "\n";
 		}
 		popSecReg(ngi);
-		ss << "  add " << primRegUsage(ngi) << ", " << secRegUsage(ngi) << "\n";
+		if (isScale) // Element sizes of 1, 2, 4 and 8 bytes fit into the addressing mode
+			ss << "  lea " << primRegName(8) << ", [" << secRegName(8) << " + " << primRegName(8) << "*" << dtSize << "]\n";
+		else
+			ss << "  add " << primRegUsage(ngi) << ", " << secRegUsage(ngi) << "\n";
 		ngi.primReg.datatype = expr->datatype;
 		ngi.primReg.state = getCellState(ngi, ngi.primReg.datatype);
 		break;
@@ -1087,7 +1130,7 @@ void genExpr(NasmGenInfo& ngi, const Expression* expr)
 		if (isInteger(expr->datatype))
 			ss << hexString(expr->value.u64);
 		else if (isBool(expr->datatype))
-			ss << (bool)expr->value.u64;
+			ss << (expr->value.u64 ? "1" : "0");
 		else if (isNull(expr->datatype))
 			ss << "0";
 		else if (isEnum(ngi.program, expr->datatype))
@@ -1109,9 +1152,12 @@ void genExpr(NasmGenInfo& ngi, const Expression* expr)
 		}
 		else if (isVarOffset(expr->symbol))
 		{
-			ss << "  mov " << primRegName(8) << ", rbp\n";
-			ss << "  add " << primRegName(8) << ", " << hexString(expr->symbol->var.offset)
-				<< (ngi.generateComments ? " ; local '" + getMangledName(expr->symbol) + "'\n" : "\n");
+			if (ngi.opts.optLevel >= 1)
+				ss << "  lea " << primRegName(8) << ", " << basePtrOffset(expr->symbol->var.offset);
+			else
+				ss << "  mov " << primRegName(8) << ", rbp\n"
+					<< "  add " << primRegName(8) << ", " << hexString(expr->symbol->var.offset);
+			ss << (ngi.opts.generateComments ? " ; local '" + getMangledName(expr->symbol) + "'\n" : "\n");
 			ngi.primReg.datatype = expr->datatype;
 			ngi.primReg.state = getRValueIfArray(ngi.primReg.datatype);
 		}
@@ -1138,6 +1184,78 @@ void genExpr(NasmGenInfo& ngi, const Expression* expr)
 	}
 }
 
+// Evaluates the condition and jumps to the label if the result is 'jumpIfTrue'
+void genBoolJump(NasmGenInfo& ngi, const Expression* condition, const std::string& label, bool jumpIfTrue)
+{
+	genExpr(ngi, condition);
+	primRegLToRVal(ngi);
+	ngi.ss << "  cmp " << primRegUsage(ngi) << ", 0\n";
+	ngi.ss << "  " << (jumpIfTrue ? "jne " : "je ") << label << "\n";
+}
+
+// Jumps to the label if the condition evaluates to 'jumpIfTrue'.
+// Comparisons and logical operators jump directly instead of materializing the boolean result (-O1 and above).
+void genCondJump(NasmGenInfo& ngi, const Expression* condition, std::string label, bool jumpIfTrue)
+{
+	if (ngi.opts.optLevel < 1)
+	{
+		genBoolJump(ngi, condition, label, jumpIfTrue);
+		return;
+	}
+
+	static const std::map<Expression::ExprType, std::pair<std::string, std::string>> condCodes = {
+		{ Expression::ExprType::Comparison_Equal, { "e", "ne" } },
+		{ Expression::ExprType::Comparison_NotEqual, { "ne", "e" } },
+		{ Expression::ExprType::Comparison_Less, { "l", "ge" } },
+		{ Expression::ExprType::Comparison_LessEqual, { "le", "g" } },
+		{ Expression::ExprType::Comparison_Greater, { "g", "le" } },
+		{ Expression::ExprType::Comparison_GreaterEqual, { "ge", "l" } },
+	};
+
+	switch (condition->eType)
+	{
+	case Expression::ExprType::Logical_AND:
+	case Expression::ExprType::Logical_OR:
+	{
+		DISABLE_EXPR_FOR_PACKS(ngi, condition->left);
+		bool isOr = condition->eType == Expression::ExprType::Logical_OR;
+		if (isOr == jumpIfTrue)
+		{
+			genCondJump(ngi, condition->left.get(), label, jumpIfTrue);
+			genCondJump(ngi, condition->right.get(), label, jumpIfTrue);
+		}
+		else
+		{
+			pushLabel(ngi, isOr ? "LOGICAL_OR_SKIP" : "LOGICAL_AND_SKIP");
+			genCondJump(ngi, condition->left.get(), getLabel(ngi, 0), !jumpIfTrue);
+			genCondJump(ngi, condition->right.get(), label, jumpIfTrue);
+			placeLabel(ngi, 0);
+			popLabel(ngi);
+		}
+	}
+		return;
+	case Expression::ExprType::Logical_NOT:
+		DISABLE_EXPR_FOR_PACKS(ngi, condition->left);
+		genCondJump(ngi, condition->left.get(), label, !jumpIfTrue);
+		return;
+	default:
+		break;
+	}
+
+	auto it = condCodes.find(condition->eType);
+	if (it != condCodes.end())
+	{
+		DISABLE_EXPR_FOR_PACKS(ngi, condition->left);
+		generateComparison(ngi, condition);
+		ngi.primReg.datatype = { "bool" };
+		ngi.primReg.state = CellState::rValue;
+		ngi.ss << "  j" << (jumpIfTrue ? it->second.first : it->second.second) << " " << label << "\n";
+		return;
+	}
+
+	genBoolJump(ngi, condition, label, jumpIfTrue);
+}
+
 void genStatementAsm(NasmGenInfo& ngi, StatementRef statement);
 
 // Generates Nasm code for any code 'body'
@@ -1153,7 +1271,7 @@ void genStatementAsm(NasmGenInfo& ngi, StatementRef statement)
 {
 	auto& ss = ngi.ss;
 
-	if (ngi.generateComments)
+	if (ngi.opts.generateComments)
 	{
 		ss << "; " << getPosStr(statement->pos) << "  ->  ";
 
@@ -1188,7 +1306,8 @@ void genStatementAsm(NasmGenInfo& ngi, StatementRef statement)
 					else
 						ss << "  movzx rax, " << primRegName(retSize) << "\n";
 				}
-				ss << "  mov " << basePtrOffset(statement->funcRetOffset) << ", " << primRegName(8) << "\n";
+				if (statement->funcRetOffset != 0)
+					ss << "  mov " << basePtrOffset(statement->funcRetOffset) << ", " << primRegName(8) << "\n";
 			}
 		}
 		ss << "  mov rsp, rbp\n";
@@ -1216,11 +1335,7 @@ void genStatementAsm(NasmGenInfo& ngi, StatementRef statement)
 				replaceLabel(ngi, "IF_NEXT", LABEL_ID_IF_NEXT);
 			}
 
-			genExpr(ngi, condBody.condition.get());
-
-			primRegLToRVal(ngi);
-			ss << "  cmp " << primRegUsage(ngi) << ", 0\n";
-			ss << "  je " << getLabel(ngi, LABEL_ID_IF_NEXT) << "\n";
+			genCondJump(ngi, condBody.condition.get(), getLabel(ngi, LABEL_ID_IF_NEXT), false);
 
 			genBodyAsm(ngi, condBody.body);
 		}
@@ -1249,10 +1364,7 @@ void genStatementAsm(NasmGenInfo& ngi, StatementRef statement)
 		placeLabel(ngi, LABEL_ID_WHILE_BEGIN);
 		placeLabel(ngi, LABEL_ID_CONTINUE);
 
-		genExpr(ngi, statement->whileConditionalBody.condition.get());
-		primRegLToRVal(ngi);
-		ss << "  cmp " << primRegUsage(ngi) << ", 0\n";
-		ss << "  je " << getLabel(ngi, LABEL_ID_WHILE_END) << "\n";
+		genCondJump(ngi, statement->whileConditionalBody.condition.get(), getLabel(ngi, LABEL_ID_WHILE_END), false);
 
 		genBodyAsm(ngi, statement->whileConditionalBody.body);
 
@@ -1275,11 +1387,7 @@ void genStatementAsm(NasmGenInfo& ngi, StatementRef statement)
 
 		placeLabel(ngi, LABEL_ID_CONTINUE);
 		
-		genExpr(ngi, statement->doWhileConditionalBody.condition.get());
-
-		primRegLToRVal(ngi);
-		ss << "  cmp " << primRegUsage(ngi) << ", 0\n";
-		ss << "  jne " << getLabel(ngi, LABEL_ID_DO_WHILE_BEGIN) << "\n";
+		genCondJump(ngi, statement->doWhileConditionalBody.condition.get(), getLabel(ngi, LABEL_ID_DO_WHILE_BEGIN), true);
 
 		placeLabel(ngi, LABEL_ID_BREAK);
 		popLoopLabels(ngi);
@@ -1314,6 +1422,9 @@ void genFuncAsm(NasmGenInfo& ngi, const std::string& name, SymbolRef func)
 	if (func->frame.size > 0)
 		ngi.ss << "  sub rsp, " << hexString(func->frame.size) << "\n";
 
+	for (int i = 0; i < getRegParamCount(func); ++i)
+		ngi.ss << "  mov " << basePtrOffset(func->func.params[i]->var.offset) << ", " << regParamNames[i] << "\n";
+
 	genBodyAsm(ngi, func->func.body);
 }
 
@@ -1377,72 +1488,323 @@ void genEpilogue(NasmGenInfo& ngi)
 	}
 }
 
-void genFunctions(NasmGenInfo& ngi)
+// Appends the code of every function as a separate chunk
+void genFunctions(NasmGenInfo& ngi, InlineStats& inlineStats, std::vector<std::string>& chunks)
 {
+	std::vector<SymbolRef> funcs;
 	std::for_each(
 		ngi.program->symbols->begin(),
 		ngi.program->symbols->end(),
 		[&](SymbolRef sym) {
-			if (!isFuncSpec(sym) || !isDefined(sym))
-				return;
-			if (isReachable(sym))
-				genFuncAsm(ngi, getParent(sym)->name, sym);
+			if (isFuncSpec(sym) && isDefined(sym) && isReachable(sym))
+				funcs.push_back(sym);
 		}
 	);
+
+	// The listed functions are placed first (in the given order), the remaining ones keep the symbol order
+	if (!ngi.opts.funcOrder.empty())
+	{
+		std::map<std::string, int> ranks; // Mangled name -> Position in the list
+		for (int i = ngi.opts.funcOrder.size() - 1; i >= 0; --i)
+			ranks[ngi.opts.funcOrder[i]] = i;
+		auto getRank = [&](const SymbolRef& func) {
+			auto it = ranks.find(getMangledName(func));
+			return it == ranks.end() ? INT_MAX : it->second;
+		};
+		std::stable_sort(funcs.begin(), funcs.end(), [&](const SymbolRef& a, const SymbolRef& b) { return getRank(a) < getRank(b); });
+	}
+
+	// All functions are lowered before generating any code, so calls can be inlined across functions
+	std::vector<IRFunctionRef> irFuncs(funcs.size());
+	if (ngi.opts.optLevel >= 1)
+	{
+		parallelFor(funcs.size(), ngi.opts.nJobs, [&](uint64_t i) {
+			try
+			{
+				irFuncs[i] = genIRFunction(ngi.program, funcs[i]);
+			}
+			catch (const IRGenError&)
+			{
+				// Fall back to the legacy code generator
+			}
+		});
+
+		std::vector<IRFunctionRef> lowered;
+		for (auto& irFunc : irFuncs)
+			if (irFunc)
+				lowered.push_back(irFunc);
+		inlineCalls(lowered, inlineStats);
+	}
+
+	// Every function is generated into its own buffer, the buffers are kept in symbol order
+	uint64_t firstChunk = chunks.size();
+	chunks.resize(firstChunk + funcs.size());
+	std::vector<std::set<int>> usedStringIDs(funcs.size());
+	parallelFor(funcs.size(), ngi.opts.nJobs, [&](uint64_t i) {
+		std::string section;
+		if (ngi.program->platform == "linux")
+			section = "section .text." + getMangledName(funcs[i]) + " progbits alloc exec nowrite align=1\n";
+
+		if (irFuncs[i])
+		{
+			AsmBuffer out;
+			out << section;
+			genIRFunctionAsm(out, *irFuncs[i]);
+			chunks[firstChunk + i] = out.release();
+			usedStringIDs[i] = irFuncs[i]->usedStringIDs;
+			return;
+		}
+
+		NasmGenInfo fngi;
+		fngi.program = ngi.program;
+		fngi.opts = ngi.opts;
+		fngi.labelPrefix = getMangledName(funcs[i]) + "#";
+		fngi.ss << section;
+		genFuncAsm(fngi, getParent(funcs[i])->name, funcs[i]);
+		chunks[firstChunk + i] = fngi.ss.release();
+		usedStringIDs[i] = std::move(fngi.usedStringIDs);
+	});
+
+	for (auto& ids : usedStringIDs)
+		ngi.usedStringIDs.insert(ids.begin(), ids.end());
+}
+
+// Returns whether the variable is placed in the data section, zero initialized variables stay in the bss section
+bool hasStaticData(const SymbolRef sym)
+{
+	auto& init = sym->var.staticInit;
+	return init && (isArray(init->datatype) || (!isNull(init->datatype) && truncateConst(init->value.u64, init->datatype) != 0));
 }
 
 void genGlobals(NasmGenInfo& ngi)
 {
+	bool isLinux = ngi.program->platform == "linux";
+
 	// Global variables
 	ngi.ss << "section .bss\n";
 	ngi.ss << "  __#argc: resq 1\n";
 	ngi.ss << "  __#argv: resq 1\n";
 	ngi.ss << "  __#envp: resq 1\n";
 
+	std::vector<SymbolRef> dataVars;
 	std::for_each(
 		ngi.program->symbols->begin(),
 		ngi.program->symbols->end(),
 		[&](SymbolRef sym) {
 			if (!isVarLabeled(sym))
 				return;
+			if (hasStaticData(sym))
+			{
+				dataVars.push_back(sym);
+				return;
+			}
 
-			ngi.ss << "  " << getMangledName(sym) << ": resb " << getDatatypeSize(ngi.program, sym->var.datatype)
-				<< (ngi.generateComments ? "\t\t; " + getPosStr(sym->pos.decl) : "") << "\n";
+			int size = getDatatypeSize(ngi.program, sym->var.datatype);
+			if (isLinux)
+			{
+				int align = 1;
+				while (align < 8 && align * 2 <= size)
+					align *= 2;
+				ngi.ss << "section .bss." << getMangledName(sym) << " nobits alloc noexec write align=" << align << "\n";
+			}
+
+			ngi.ss << "  " << getMangledName(sym) << ": resb " << size
+				<< (ngi.opts.generateComments ? "\t\t; " + getPosStr(sym->pos.decl) : "") << "\n";
 		}
 	);
+
+	// Variables with constant initializers, const variables are read-only
+	std::stable_partition(dataVars.begin(), dataVars.end(), [](SymbolRef sym) { return !sym->var.datatype.isConst; });
+	for (uint64_t i = 0; i < dataVars.size(); ++i)
+	{
+		auto& sym = dataVars[i];
+		bool isConst = sym->var.datatype.isConst;
+		int size = getDatatypeSize(ngi.program, sym->var.datatype);
+		if (isLinux)
+			ngi.ss << "section " << (isConst ? ".rodata." : ".data.") << getMangledName(sym) << " progbits alloc noexec " << (isConst ? "nowrite" : "write") << " align=" << size << "\n";
+		else if (i == 0 || isConst != dataVars[i - 1]->var.datatype.isConst)
+			ngi.ss << (isConst ? "section .rdata align=" + std::to_string(ngi.opts.strAlign) : "section .data") << "\n";
+		if (!isLinux && size > 1)
+			ngi.ss << "  align " << size << "\n";
+
+		static const char* dataDirectives[] = { nullptr, "db", "dw", nullptr, "dd", nullptr, nullptr, nullptr, "dq" };
+		ngi.ss << "  " << getMangledName(sym) << ": " << dataDirectives[size] << " ";
+
+		auto& init = sym->var.staticInit;
+		if (isArray(init->datatype))
+		{
+			ngi.ss << getLiteralStringName(init->value.u64);
+			ngi.usedStringIDs.insert(init->value.u64);
+		}
+		else
+			ngi.ss << hexString(truncateConst(init->value.u64, init->datatype));
+
+		ngi.ss << (ngi.opts.generateComments ? "\t\t; " + getPosStr(sym->pos.decl) : "") << "\n";
+	}
+}
+
+// Printable characters are put in quotes, everything else is written as a number
+void genStringData(NasmGenInfo& ngi, std::string_view str, bool terminate)
+{
+	bool inQuotes = false;
+	for (uint64_t i = 0; i < str.size(); ++i)
+	{
+		char c = str[i];
+		bool isQuotable = c >= ' ' && c <= '~' && c != '"';
+		if (isQuotable != inQuotes)
+		{
+			if (inQuotes)
+				ngi.ss << '"';
+			if (i > 0)
+				ngi.ss << ", ";
+			if (isQuotable)
+				ngi.ss << '"';
+			inQuotes = isQuotable;
+		}
+		else if (!isQuotable && i > 0)
+			ngi.ss << ", ";
+
+		if (isQuotable)
+			ngi.ss << c;
+		else
+			ngi.ss << (int)(uint8_t)c;
+	}
+
+	if (inQuotes)
+		ngi.ss << '"';
+	if (terminate)
+		ngi.ss << (str.empty() ? "0" : ", 0");
+	ngi.ss << "\n";
 }
 
 void genStrings(NasmGenInfo& ngi)
 {
 	// C-Strings
-	ngi.ss << "section .data\n";
+	std::vector<std::pair<std::string, int>> strings; // Reversed string -> String ID
 	for (auto& [str, id] : ngi.program->strings)
+		if (ngi.usedStringIDs.find(id) != ngi.usedStringIDs.end())
+			strings.push_back({ std::string(str.rbegin(), str.rend()), id });
+	std::sort(strings.begin(), strings.end());
+
+	// A string that is the tail of another one is the prefix of the next string in reversed order,
+	// it is stored as part of the longest string ending with it
+	std::map<int, uint64_t> owners; // Owner ID -> Index of the owner in strings (ordered by ID to keep the output stable)
+	std::map<int, std::map<uint64_t, int>> tails; // Owner ID -> Offset of the tail -> String ID
+	int ownerID = -1;
+	for (uint64_t i = strings.size(); i-- > 0;)
 	{
-		if (ngi.usedStringIDs.find(id) == ngi.usedStringIDs.end())
-			continue;
-		ngi.ss << "  " << getLiteralStringName(id) << ": db "; // Generate unique name from string ID
-		for (char c : str) // Generate string literal
-			ngi.ss << (int)c << ",";
-		ngi.ss << "0\n";
+		auto& [reversed, id] = strings[i];
+		bool isTail = i + 1 < strings.size() && strings[i + 1].first.compare(0, reversed.size(), reversed) == 0;
+		if (!isTail)
+		{
+			ownerID = id;
+			owners[id] = i;
+		}
+		tails[ownerID][strings[owners[ownerID]].first.size() - reversed.size()] = id;
+	}
+
+	// win64 has no .rodata, nasm would treat it as a code section
+	bool isLinux = ngi.program->platform == "linux";
+	if (!isLinux)
+		ngi.ss << "section .rdata align=" << ngi.opts.strAlign << "\n";
+	for (auto& [ownerID, index] : owners)
+	{
+		auto& reversed = strings[index].first;
+		std::string owner(reversed.rbegin(), reversed.rend());
+		auto& offsets = tails[ownerID];
+
+		if (isLinux)
+			ngi.ss << "section .rodata." << getLiteralStringName(ownerID) << " progbits alloc noexec nowrite align=" << ngi.opts.strAlign << "\n";
+		else if (ngi.opts.strAlign > 1)
+			ngi.ss << "  align " << ngi.opts.strAlign << "\n";
+		for (auto it = offsets.begin(); it != offsets.end(); ++it)
+		{
+			auto next = std::next(it);
+			uint64_t end = next == offsets.end() ? owner.size() : next->first;
+			ngi.ss << "  " << getLiteralStringName(it->second) << ": db ";
+			genStringData(ngi, std::string_view(owner).substr(it->first, end - it->first), next == offsets.end());
+		}
 	}
 }
 
+// Removes the jump at the end of a chunk if it targets the label at the start of the next chunk (tail call to the next function).
+// Functions in sections of their own never start with their label, the linker may reorder or remove the sections.
+bool removeJumpToNextChunk(std::string& chunk, const std::string& next)
+{
+	auto pos = chunk.rfind("  jmp ");
+	if (pos == std::string::npos || chunk.find('\n', pos) != chunk.size() - 1)
+		return false;
+
+	auto label = chunk.substr(pos + 6, chunk.size() - pos - 7);
+	if (next.compare(0, label.size() + 2, label + ":\n") != 0)
+		return false;
+
+	chunk.erase(pos);
+	return true;
+}
+
 // Generates Nasm code for the entire program
-std::string genAsm(ProgramRef program, bool generateComments)
+std::string genAsm(ProgramRef program, const NasmGenOptions& opts, OptimizationStats* pStats)
 {
+	OptimizationStats stats;
+	if (!pStats)
+		pStats = &stats;
+
 	NasmGenInfo ngi;
 	ngi.program = program;
-	ngi.generateComments = generateComments;
+	ngi.opts = opts;
+
+	// The functions are generated concurrently, so the names must be cached before
+	cacheMangledNames(program);
 
 	genPrologue(ngi);
 	genBodyAsm(ngi, program->body);
 	genEpilogue(ngi);
-	genFunctions(ngi);
+
+	std::vector<std::string> chunks = { ngi.ss.release() };
+	genFunctions(ngi, pStats->inlining, chunks);
 	genGlobals(ngi);
 	genStrings(ngi);
+	chunks.push_back(ngi.ss.release());
 
 	if (!ngi.labelStack.empty())
 		THROW_NASM_GEN_ERROR(Token::Position(), "Unused label(s)!");
-	
-	return ngi.ss.str();
+
+	// The chunks are optimized independently, the rules never look past the end of a chunk
+	if (opts.optLevel >= 1)
+	{
+		std::map<std::string, int> regParamCounts;
+		std::for_each(
+			program->symbols->begin(),
+			program->symbols->end(),
+			[&](SymbolRef sym) {
+				if (isFuncSpec(sym) && isDefined(sym) && isReachable(sym))
+					regParamCounts[getMangledName(sym)] = getRegParamCount(sym);
+			}
+		);
+
+		std::vector<PeepholeStats> chunkStats(chunks.size());
+		parallelFor(chunks.size(), opts.nJobs, [&](uint64_t i) {
+			auto lines = parseAsmLines(chunks[i]);
+			optimizePeephole(lines, chunkStats[i], regParamCounts);
+			chunks[i] = serializeAsmLines(lines);
+		});
+
+		for (auto& ruleCounts : chunkStats)
+			for (auto& [rule, count] : ruleCounts)
+				pStats->peephole[rule] += count;
+
+		for (uint64_t i = 0; i + 1 < chunks.size(); ++i)
+			if (removeJumpToNextChunk(chunks[i], chunks[i + 1]))
+				++pStats->peephole["jump-to-next"];
+	}
+
+	uint64_t size = 0;
+	for (auto& chunk : chunks)
+		size += chunk.size();
+	std::string code;
+	code.reserve(size);
+	for (auto& chunk : chunks)
+		code += chunk;
+	return code;
 }
@@ -1,5 +1,30 @@
 #pragma once
 
 #include "Program.h"
+#include "Peephole.h"
+#include "IRInliner.h"
 
-std::string genAsm(const ProgramRef program, bool generateComments);
\ No newline at end of file
+struct OptimizationStats
+{
+	InlineStats inlining;
+	PeepholeStats peephole;
+};
+
+struct NasmGenOptions
+{
+	bool generateComments = false;
+	int optLevel = 1;
+	int nJobs = 1; // Number of threads generating functions
+	int strAlign = 1; // Alignment of the string literals (except for the ones sharing the tail of another one)
+	std::vector<std::string> funcOrder; // Mangled names of the functions to place first, e.g. the hot ones
+};
+
+// Functions are generated via the IR if the optimization level is at least 1 and the function can be lowered.
+// At optimization level 1 small functions are inlined into their callers, locals whose address is never taken are kept in registers
+// and the generated assembly is run through the peephole optimizer.
+// The statistics of both optimizations are added to the stats (if given).
+// The functions are lowered, generated and optimized by up to nJobs threads, the output does not depend on the number of threads.
+// String literals are placed in .rodata aligned to strAlign bytes, literals that are the tail of another one share its bytes.
+// On linux every function, global variable and string literal is placed in a section of its own (.text.<name>, .bss.<name>, .rodata.<name>),
+// so the linker can remove the unused ones (--gc-sections).
+std::string genAsm(const ProgramRef program, const NasmGenOptions& opts, OptimizationStats* pStats = nullptr);
\ No newline at end of file
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Values match the ELF relocation types of x86-64
+enum class RelocType
+{
+	Abs64 = 1, // R_X86_64_64
+	PC32 = 2, // R_X86_64_PC32
+	PLT32 = 4, // R_X86_64_PLT32
+	Abs32 = 10, // R_X86_64_32
+	Abs32S = 11, // R_X86_64_32S
+};
+
+struct ObjReloc
+{
+	uint64_t offset = 0; // Offset of the patched field in the section
+	RelocType type = RelocType::Abs64;
+	int symbol = 0; // Index into ObjectFile::symbols
+	int64_t addend = 0;
+};
+
+struct ObjSection
+{
+	std::string name;
+	std::vector<uint8_t> data; // Empty if 'isNoBits' is set
+	uint64_t size = 0;
+	uint64_t align = 1;
+	bool isWritable = false;
+	bool isExecutable = false;
+	bool isNoBits = false; // Only reserves memory (.bss)
+	std::vector<ObjReloc> relocs;
+};
+
+struct ObjSymbol
+{
+	std::string name;
+	int section = -1; // Index into ObjectFile::sections, -1 if the symbol is undefined
+	uint64_t value = 0; // Offset in the section
+	bool isGlobal = false;
+};
+
+// Relocatable object produced by the built-in assembler
+struct ObjectFile
+{
+	std::vector<ObjSection> sections;
+	std::vector<ObjSymbol> symbols;
+};
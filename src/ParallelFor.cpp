@@ -0,0 +1,38 @@
+#include "ParallelFor.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <exception>
+
+void parallelFor(uint64_t count, int nThreads, const std::function<void(uint64_t)>& func)
+{
+	std::vector<std::exception_ptr> errors(count);
+	std::atomic<uint64_t> next = 0;
+
+	auto worker = [&]()
+	{
+		for (uint64_t i; (i = next++) < count;)
+		{
+			try
+			{
+				func(i);
+			}
+			catch (...)
+			{
+				errors[i] = std::current_exception();
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (int i = 1; i < nThreads && (uint64_t)i < count; ++i)
+		threads.emplace_back(worker);
+	worker();
+	for (auto& thread : threads)
+		thread.join();
+
+	for (auto& error : errors)
+		if (error)
+			std::rethrow_exception(error);
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+// Calls func(i) for every i in [0, count) using up to nThreads threads (including the calling one).
+// The indices are handed out one by one, so expensive items don't hold up the rest.
+// If any call throws, the exception of the lowest index is rethrown after all threads finished.
+void parallelFor(uint64_t count, int nThreads, const std::function<void(uint64_t)>& func);
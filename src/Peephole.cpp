@@ -0,0 +1,841 @@
+#include "Peephole.h"
+
+#include <sstream>
+#include <cstdint>
+#include <cassert>
+
+#define REG_RAX 0
+#define REG_RBX 1
+#define REG_RCX 2
+#define REG_RDX 3
+#define REG_RSI 4
+#define REG_RDI 5
+#define REG_RBP 6
+#define REG_RSP 7
+#define REG_R8 8
+#define REG_R9 9
+#define REG_R12 12
+#define REG_R15 15
+
+#define REG_BIT(reg) (1u << (reg))
+#define FLAGS_BIT (1u << 16)
+
+// Registers/flags a path may still read after returning/calling
+#define LIVE_AT_RET (REG_BIT(REG_RAX) | REG_BIT(REG_RBX) | REG_BIT(REG_RBP) | REG_BIT(REG_RSP) | REG_BIT(12) | REG_BIT(13) | REG_BIT(14) | REG_BIT(15))
+#define READ_BY_CALL (REG_BIT(REG_RCX) | REG_BIT(REG_RDX) | REG_BIT(REG_RSI) | REG_BIT(REG_RDI) | REG_BIT(REG_R8) | REG_BIT(REG_R9) | REG_BIT(REG_RBP) | REG_BIT(REG_RSP))
+#define CLOBBERED_BY_CALL (REG_BIT(REG_RAX) | REG_BIT(REG_RCX) | REG_BIT(REG_RDX) | REG_BIT(REG_RSI) | REG_BIT(REG_RDI) | REG_BIT(REG_R8) | REG_BIT(REG_R9) | REG_BIT(10) | REG_BIT(11) | FLAGS_BIT)
+
+// Maximum number of instructions looked at when checking if a register is dead
+#define DEAD_SCAN_BUDGET 32
+
+typedef AsmLineList::iterator AsmIt;
+
+struct RegInfo
+{
+	int base = -1;
+	int size = 0;
+};
+
+struct InstrEffects
+{
+	bool isKnown = false;
+	unsigned reads = 0; // Registers (and flags) whose value is used, includes partially written registers
+	unsigned writes = 0; // Registers (and flags) that are completely overwritten
+};
+
+struct PeepholeInfo
+{
+	AsmLineList* pLines;
+	std::map<std::string, AsmIt> labels;
+	const std::map<std::string, int>* pRegParamCounts;
+};
+
+static const char* regNames[16][4] = {
+	{ "rax", "eax", "ax", "al" },
+	{ "rbx", "ebx", "bx", "bl" },
+	{ "rcx", "ecx", "cx", "cl" },
+	{ "rdx", "edx", "dx", "dl" },
+	{ "rsi", "esi", "si", "sil" },
+	{ "rdi", "edi", "di", "dil" },
+	{ "rbp", "ebp", "bp", "bpl" },
+	{ "rsp", "esp", "sp", "spl" },
+	{ "r8", "r8d", "r8w", "r8b" },
+	{ "r9", "r9d", "r9w", "r9b" },
+	{ "r10", "r10d", "r10w", "r10b" },
+	{ "r11", "r11d", "r11w", "r11b" },
+	{ "r12", "r12d", "r12w", "r12b" },
+	{ "r13", "r13d", "r13w", "r13b" },
+	{ "r14", "r14d", "r14w", "r14b" },
+	{ "r15", "r15d", "r15w", "r15b" },
+};
+
+static const std::map<std::string, std::string> invertedConds = {
+	{ "e", "ne" }, { "ne", "e" }, { "z", "nz" }, { "nz", "z" },
+	{ "l", "ge" }, { "ge", "l" }, { "le", "g" }, { "g", "le" },
+	{ "b", "ae" }, { "ae", "b" }, { "be", "a" }, { "a", "be" },
+	{ "s", "ns" }, { "ns", "s" }, { "o", "no" }, { "no", "o" },
+	{ "c", "nc" }, { "nc", "c" }, { "p", "np" }, { "np", "p" },
+};
+
+RegInfo getRegInfo(const std::string& name)
+{
+	static const std::map<std::string, RegInfo> regs = []()
+	{
+		std::map<std::string, RegInfo> regs;
+		static const int sizes[] = { 8, 4, 2, 1 };
+		for (int base = 0; base < 16; ++base)
+			for (int i = 0; i < 4; ++i)
+				regs[regNames[base][i]] = { base, sizes[i] };
+		regs["ah"] = { REG_RAX, 1 };
+		regs["bh"] = { REG_RBX, 1 };
+		regs["ch"] = { REG_RCX, 1 };
+		regs["dh"] = { REG_RDX, 1 };
+		return regs;
+	}();
+
+	auto it = regs.find(name);
+	if (it == regs.end())
+		return {};
+	return it->second;
+}
+
+bool isReg(const std::string& operand, int size = 0)
+{
+	auto info = getRegInfo(operand);
+	return info.base != -1 && (size == 0 || info.size == size) && operand.back() != 'h';
+}
+
+bool isMem(const std::string& operand)
+{
+	return operand.find('[') != std::string::npos;
+}
+
+bool parseImm(const std::string& operand, int64_t& value)
+{
+	if (operand.empty() || (!isdigit(operand[0]) && operand[0] != '-'))
+		return false;
+	try
+	{
+		std::size_t end = 0;
+		value = (int64_t)std::stoull(operand[0] == '-' ? operand.substr(1) : operand, &end, 0);
+		if (end != operand.size() - (operand[0] == '-' ? 1 : 0))
+			return false;
+		if (operand[0] == '-')
+			value = -value;
+	}
+	catch (...)
+	{
+		return false;
+	}
+	return true;
+}
+
+// Labels are everything else that is not a register, memory operand or number
+bool isSymbol(const std::string& operand)
+{
+	int64_t value;
+	return !operand.empty() && !isReg(operand) && !isMem(operand) && !parseImm(operand, value) && operand.find(' ') == std::string::npos;
+}
+
+// Registers mentioned anywhere in the operand
+unsigned getRegMask(const std::string& operand)
+{
+	unsigned mask = 0;
+	std::string word;
+	for (std::size_t i = 0; i <= operand.size(); ++i)
+	{
+		char c = i < operand.size() ? operand[i] : ' ';
+		if (isalnum(c))
+		{
+			word.push_back(c);
+			continue;
+		}
+		auto info = getRegInfo(word);
+		if (info.base != -1)
+			mask |= REG_BIT(info.base);
+		word.clear();
+	}
+	return mask;
+}
+
+// Returns the condition of a mnemonic starting with the prefix (e.g. 'sete' -> 'e'), or an empty string
+std::string getCond(const std::string& mnemonic, const std::string& prefix)
+{
+	if (mnemonic.find(prefix) != 0)
+		return "";
+	auto cond = mnemonic.substr(prefix.size());
+	return invertedConds.find(cond) != invertedConds.end() ? cond : "";
+}
+
+bool isJump(const AsmLine& line)
+{
+	return line.type == AsmLine::Type::Instruction && line.operands.size() == 1 && (line.mnemonic == "jmp" || !getCond(line.mnemonic, "j").empty());
+}
+
+InstrEffects getEffects(const AsmLine& line)
+{
+	InstrEffects eff;
+	if (line.type != AsmLine::Type::Instruction)
+		return eff;
+
+	auto& m = line.mnemonic;
+	auto& ops = line.operands;
+
+	auto writeDest = [&](const std::string& dest)
+	{
+		auto info = getRegInfo(dest);
+		if (info.base != -1 && info.size >= 4) // 32 bit writes clear the upper half
+			eff.writes |= REG_BIT(info.base);
+		else
+			eff.reads |= getRegMask(dest);
+	};
+
+	eff.isKnown = true;
+	if (ops.size() == 2 && (m == "mov" || m == "movzx" || m == "movsx" || m == "movsxd" || m == "lea"))
+	{
+		writeDest(ops[0]);
+		eff.reads |= getRegMask(ops[1]);
+	}
+	else if (ops.size() == 2 && (m == "add" || m == "sub" || m == "and" || m == "or" || m == "xor" || m == "imul" || m == "shl" || m == "shr" || m == "sar"))
+	{
+		eff.reads |= getRegMask(ops[0]) | getRegMask(ops[1]);
+		eff.writes |= FLAGS_BIT;
+	}
+	else if (ops.size() == 2 && (m == "cmp" || m == "test"))
+	{
+		eff.reads |= getRegMask(ops[0]) | getRegMask(ops[1]);
+		eff.writes |= FLAGS_BIT;
+	}
+	else if (ops.size() == 1 && (m == "inc" || m == "dec" || m == "neg"))
+	{
+		eff.reads |= getRegMask(ops[0]);
+		eff.writes |= FLAGS_BIT;
+	}
+	else if (ops.size() == 1 && m == "not")
+	{
+		eff.reads |= getRegMask(ops[0]);
+	}
+	else if (ops.size() == 1 && !getCond(m, "set").empty())
+	{
+		eff.reads |= getRegMask(ops[0]) | FLAGS_BIT;
+	}
+	else if (ops.size() == 2 && !getCond(m, "cmov").empty())
+	{
+		eff.reads |= getRegMask(ops[0]) | getRegMask(ops[1]) | FLAGS_BIT;
+	}
+	else if (ops.size() == 1 && m == "push")
+	{
+		eff.reads |= getRegMask(ops[0]) | REG_BIT(REG_RSP);
+	}
+	else if (ops.size() == 1 && m == "pop")
+	{
+		writeDest(ops[0]);
+		eff.reads |= REG_BIT(REG_RSP);
+	}
+	else
+	{
+		eff.isKnown = false;
+	}
+
+	return eff;
+}
+
+// Registers read by the function the label belongs to
+unsigned getTailCallReads(PeepholeInfo& phi, const std::string& label)
+{
+	static const int paramRegs[] = { REG_RDI, REG_RSI, REG_RDX, REG_RCX, REG_R8, REG_R9 };
+
+	auto it = phi.pRegParamCounts->find(label);
+	if (it == phi.pRegParamCounts->end())
+		return READ_BY_CALL;
+
+	unsigned reads = REG_BIT(REG_RBP) | REG_BIT(REG_RSP);
+	for (int i = 0; i < it->second && i < (int)(sizeof(paramRegs) / sizeof(paramRegs[0])); ++i)
+		reads |= REG_BIT(paramRegs[i]);
+	return reads;
+}
+
+// Returns true if none of the registers/flags in the mask are read before they are overwritten on all paths starting at the line
+bool isDead(PeepholeInfo& phi, AsmIt it, unsigned mask, int& budget)
+{
+	auto& lines = *phi.pLines;
+	while (mask != 0)
+	{
+		if (it == lines.end() || budget-- <= 0)
+			return false;
+
+		auto& line = *it;
+		if (line.type == AsmLine::Type::Comment || line.type == AsmLine::Type::Label)
+		{
+			++it;
+			continue;
+		}
+		if (line.type != AsmLine::Type::Instruction)
+			return false;
+
+		if (isJump(line))
+		{
+			bool isCond = line.mnemonic != "jmp";
+			if (isCond && (mask & FLAGS_BIT))
+				return false;
+			auto target = phi.labels.find(line.operands[0]);
+			if (target == phi.labels.end())
+			{
+				// Jumps out of the optimized code are tail calls, the callee returns to the caller
+				return !isCond && (mask & (getTailCallReads(phi, line.operands[0]) | LIVE_AT_RET)) == 0;
+			}
+			if (!isDead(phi, target->second, mask, budget))
+				return false;
+			if (!isCond)
+				return true;
+			++it;
+			continue;
+		}
+
+		if (line.mnemonic == "ret")
+			return (mask & LIVE_AT_RET) == 0;
+
+		if (line.mnemonic == "call" && line.operands.size() == 1)
+		{
+			if (mask & (READ_BY_CALL | getRegMask(line.operands[0])))
+				return false;
+			mask &= ~CLOBBERED_BY_CALL;
+			++it;
+			continue;
+		}
+
+		auto eff = getEffects(line);
+		if (!eff.isKnown || (eff.reads & mask))
+			return false;
+		mask &= ~eff.writes;
+		++it;
+	}
+	return true;
+}
+
+bool isDeadAfter(PeepholeInfo& phi, AsmIt it, unsigned mask)
+{
+	int budget = DEAD_SCAN_BUDGET;
+	return isDead(phi, std::next(it), mask, budget);
+}
+
+// Returns the next line that is not a comment
+AsmIt nextLine(PeepholeInfo& phi, AsmIt it)
+{
+	do
+		++it;
+	while (it != phi.pLines->end() && it->type == AsmLine::Type::Comment);
+	return it;
+}
+
+bool isInstr(PeepholeInfo& phi, AsmIt it, const std::string& mnemonic, int nOperands)
+{
+	return
+		it != phi.pLines->end() &&
+		it->type == AsmLine::Type::Instruction &&
+		it->mnemonic == mnemonic &&
+		(int)it->operands.size() == nOperands;
+}
+
+AsmLine makeInstr(const std::string& mnemonic, const std::vector<std::string>& operands)
+{
+	AsmLine line;
+	line.type = AsmLine::Type::Instruction;
+	line.mnemonic = mnemonic;
+	line.operands = operands;
+	return line;
+}
+
+// push R / pop R
+bool rulePushPopSame(PeepholeInfo& phi, AsmIt it)
+{
+	auto pop = nextLine(phi, it);
+	if (!isInstr(phi, it, "push", 1) || !isInstr(phi, pop, "pop", 1))
+		return false;
+	if (!isReg(it->operands[0], 8) || it->operands[0] != pop->operands[0])
+		return false;
+
+	phi.pLines->erase(pop);
+	phi.pLines->erase(it);
+	return true;
+}
+
+// push A / pop B  ->  mov B, A
+bool rulePushPopMove(PeepholeInfo& phi, AsmIt it)
+{
+	auto pop = nextLine(phi, it);
+	if (!isInstr(phi, it, "push", 1) || !isInstr(phi, pop, "pop", 1))
+		return false;
+	auto& src = it->operands[0];
+	auto& dest = pop->operands[0];
+	if (!isReg(src, 8) || !isReg(dest, 8) || src == "rsp" || dest == "rsp")
+		return false;
+
+	*it = makeInstr("mov", { dest, src });
+	phi.pLines->erase(pop);
+	return true;
+}
+
+// push R / <instruction not using R> / pop R  ->  <instruction>
+bool rulePushPopAround(PeepholeInfo& phi, AsmIt it)
+{
+	auto instr = nextLine(phi, it);
+	auto pop = instr == phi.pLines->end() ? instr : nextLine(phi, instr);
+	if (!isInstr(phi, it, "push", 1) || !isInstr(phi, pop, "pop", 1) || it->operands[0] != pop->operands[0])
+		return false;
+	auto info = getRegInfo(it->operands[0]);
+	if (!isReg(it->operands[0], 8) || info.base == REG_RSP)
+		return false;
+	if (instr->type != AsmLine::Type::Instruction || isJump(*instr) || instr->mnemonic == "push" || instr->mnemonic == "pop")
+		return false;
+	auto eff = getEffects(*instr);
+	if (!eff.isKnown || ((eff.reads | eff.writes) & (REG_BIT(info.base) | REG_BIT(REG_RSP))))
+		return false;
+
+	phi.pLines->erase(pop);
+	phi.pLines->erase(it);
+	return true;
+}
+
+// mov R, rbp / add R, imm  ->  lea R, [rbp +/- imm]
+bool ruleFrameAddress(PeepholeInfo& phi, AsmIt it)
+{
+	auto add = nextLine(phi, it);
+	if (!isInstr(phi, it, "mov", 2) || !isInstr(phi, add, "add", 2))
+		return false;
+	auto& reg = it->operands[0];
+	int64_t offset;
+	if (it->operands[1] != "rbp" || !isReg(reg, 8) || reg == "rsp" || add->operands[0] != reg || !parseImm(add->operands[1], offset))
+		return false;
+	if (offset < INT32_MIN || offset > INT32_MAX || !isDeadAfter(phi, add, FLAGS_BIT))
+		return false;
+
+	std::string addr = "[rbp " + std::string(offset < 0 ? "- " : "+ ") + std::to_string(offset < 0 ? -offset : offset) + "]";
+	*it = makeInstr("lea", { reg, addr });
+	phi.pLines->erase(add);
+	return true;
+}
+
+// lea R, [addr] / add R, imm  ->  lea R, [addr + imm]
+bool ruleAddressOffset(PeepholeInfo& phi, AsmIt it)
+{
+	auto add = nextLine(phi, it);
+	if (!isInstr(phi, it, "lea", 2) || (!isInstr(phi, add, "add", 2) && !isInstr(phi, add, "sub", 2)))
+		return false;
+	auto& reg = it->operands[0];
+	auto& addr = it->operands[1];
+	int64_t offset;
+	if (!isReg(reg, 8) || add->operands[0] != reg || addr.front() != '[' || addr.back() != ']' || !parseImm(add->operands[1], offset))
+		return false;
+	if (offset < INT32_MIN || offset > INT32_MAX || !isDeadAfter(phi, add, FLAGS_BIT))
+		return false;
+
+	bool isNeg = (offset < 0) != (add->mnemonic == "sub");
+	addr = addr.substr(0, addr.size() - 1) + (isNeg ? " - " : " + ") + std::to_string(offset < 0 ? -offset : offset) + "]";
+	phi.pLines->erase(add);
+	return true;
+}
+
+// lea R, [addr] / <instruction using [R]>  ->  <instruction using [addr]>
+// mov R, label / <instruction using [R]>  ->  <instruction using [label]>
+bool ruleAddressFold(PeepholeInfo& phi, AsmIt it)
+{
+	auto user = nextLine(phi, it);
+	if (user == phi.pLines->end() || user->type != AsmLine::Type::Instruction || it->type != AsmLine::Type::Instruction || it->operands.size() != 2)
+		return false;
+
+	auto& reg = it->operands[0];
+	std::string addr;
+	if (it->mnemonic == "lea" && isMem(it->operands[1]) && it->operands[1].front() == '[')
+		addr = it->operands[1];
+	else if (it->mnemonic == "mov" && isSymbol(it->operands[1]))
+		addr = "[" + it->operands[1] + "]";
+	else
+		return false;
+	auto info = getRegInfo(reg);
+	if (!isReg(reg, 8) || info.base == REG_RSP || info.base == REG_RBP)
+		return false;
+
+	// A single instruction using neither the register nor the address may be in between (e.g. popping the value to store)
+	auto userEff = getEffects(*user);
+	if (userEff.isKnown && !isJump(*user) && !((userEff.reads | userEff.writes) & (REG_BIT(info.base) | getRegMask(addr))))
+	{
+		user = nextLine(phi, user);
+		if (user == phi.pLines->end() || user->type != AsmLine::Type::Instruction)
+			return false;
+		userEff = getEffects(*user);
+	}
+
+	if (!userEff.isKnown || user->mnemonic == "lea" || user->mnemonic == "push" || user->mnemonic == "pop" || isJump(*user))
+		return false;
+
+	// The register may only appear as the memory operand of the user
+	std::string memOperand = "[" + reg + "]";
+	int memIndex = -1;
+	for (int i = 0; i < (int)user->operands.size(); ++i)
+	{
+		auto& op = user->operands[i];
+		auto pos = op.find(memOperand);
+		if (pos != std::string::npos && pos + memOperand.size() == op.size() && memIndex == -1)
+			memIndex = i;
+		else if (getRegMask(op) & REG_BIT(info.base))
+		{
+			// Allowed as the destination if the instruction overwrites it completely
+			if (i != 0 || !(userEff.writes & REG_BIT(info.base)))
+				return false;
+		}
+	}
+	if (memIndex == -1)
+		return false;
+	if (!(userEff.writes & REG_BIT(info.base)) && !isDeadAfter(phi, user, REG_BIT(info.base)))
+		return false;
+
+	auto& op = user->operands[memIndex];
+	op = op.substr(0, op.size() - memOperand.size()) + addr;
+	phi.pLines->erase(it);
+	return true;
+}
+
+// mov A, X / mov B, A  ->  mov B, X  (if A is not used afterwards)
+bool ruleMoveForward(PeepholeInfo& phi, AsmIt it)
+{
+	auto mov = nextLine(phi, it);
+	if (!isInstr(phi, it, "mov", 2) || !isInstr(phi, mov, "mov", 2))
+		return false;
+	auto& a = it->operands[0];
+	auto& b = mov->operands[0];
+	if (!isReg(a, 8) || !isReg(b, 8) || mov->operands[1] != a || a == b || a == "rsp" || b == "rsp" || a == "rbp" || b == "rbp")
+		return false;
+	if (!isDeadAfter(phi, mov, REG_BIT(getRegInfo(a).base)))
+		return false;
+
+	it->operands[0] = b;
+	phi.pLines->erase(mov);
+	return true;
+}
+
+// Register loads whose result is never read
+bool ruleDeadMove(PeepholeInfo& phi, AsmIt it)
+{
+	if (it->type != AsmLine::Type::Instruction || it->operands.size() != 2)
+		return false;
+	auto& m = it->mnemonic;
+	if (m != "mov" && m != "movzx" && m != "movsx" && m != "movsxd" && m != "lea")
+		return false;
+	auto info = getRegInfo(it->operands[0]);
+	if (info.base == -1 || info.size < 4 || info.base == REG_RSP || info.base == REG_RBP)
+		return false;
+	if (!isDeadAfter(phi, it, REG_BIT(info.base)))
+		return false;
+
+	phi.pLines->erase(it);
+	return true;
+}
+
+// mov R, R (64 bit moves only, 32 bit moves clear the upper half)
+bool ruleSelfMove(PeepholeInfo& phi, AsmIt it)
+{
+	if (!isInstr(phi, it, "mov", 2) || !isReg(it->operands[0], 8) || it->operands[0] != it->operands[1])
+		return false;
+
+	phi.pLines->erase(it);
+	return true;
+}
+
+// Jumps to the label directly following the jump
+bool ruleJumpToNext(PeepholeInfo& phi, AsmIt it)
+{
+	if (!isJump(*it))
+		return false;
+
+	for (auto next = nextLine(phi, it); next != phi.pLines->end() && next->type == AsmLine::Type::Label; next = nextLine(phi, next))
+	{
+		if (next->text == it->operands[0] + ":")
+		{
+			phi.pLines->erase(it);
+			return true;
+		}
+	}
+	return false;
+}
+
+// Returns the condition that is true if the byte register holding the result of setCC is equal to/not equal to the value
+std::string getBoolTestCond(const std::string& setCond, const AsmLine& test, const std::string& jumpCond)
+{
+	bool isZeroTest =
+		(test.mnemonic == "cmp" && test.operands[1] == "0") ||
+		(test.mnemonic == "test" && test.operands[0] == test.operands[1]);
+	bool isOneTest = test.mnemonic == "cmp" && test.operands[1] == "1";
+	if (!isZeroTest && !isOneTest)
+		return "";
+
+	bool jumpIfEqual = jumpCond == "e" || jumpCond == "z";
+	if (!jumpIfEqual && jumpCond != "ne" && jumpCond != "nz")
+		return "";
+
+	// Jump if the setCC result is 1
+	bool jumpIfSet = isZeroTest != jumpIfEqual;
+	return jumpIfSet ? setCond : invertedConds.at(setCond);
+}
+
+// setCC R / cmp R, 0 / je L  ->  jNCC L
+bool ruleSetccBranch(PeepholeInfo& phi, AsmIt it)
+{
+	auto test = nextLine(phi, it);
+	auto jump = test == phi.pLines->end() ? test : nextLine(phi, test);
+	if (it->type != AsmLine::Type::Instruction || it->operands.size() != 1 || !isReg(it->operands[0], 1))
+		return false;
+	auto setCond = getCond(it->mnemonic, "set");
+	if (setCond.empty() || test == phi.pLines->end() || test->type != AsmLine::Type::Instruction || test->operands.size() != 2 || test->operands[0] != it->operands[0])
+		return false;
+	if (jump == phi.pLines->end() || !isJump(*jump) || jump->mnemonic == "jmp")
+		return false;
+
+	auto cond = getBoolTestCond(setCond, *test, getCond(jump->mnemonic, "j"));
+	if (cond.empty())
+		return false;
+
+	// Neither the register nor the flags of the test may be used by the jump target or the following code
+	unsigned mask = REG_BIT(getRegInfo(it->operands[0]).base) | FLAGS_BIT;
+	auto target = phi.labels.find(jump->operands[0]);
+	int budget = DEAD_SCAN_BUDGET;
+	if (target == phi.labels.end() || !isDead(phi, target->second, mask, budget) || !isDeadAfter(phi, jump, mask))
+		return false;
+
+	jump->mnemonic = "j" + cond;
+	phi.pLines->erase(test);
+	phi.pLines->erase(it);
+	return true;
+}
+
+// setCC R / cmp R, 0 / sete R  ->  setNCC R
+bool ruleSetccNot(PeepholeInfo& phi, AsmIt it)
+{
+	auto test = nextLine(phi, it);
+	auto set = test == phi.pLines->end() ? test : nextLine(phi, test);
+	if (it->type != AsmLine::Type::Instruction || it->operands.size() != 1 || !isReg(it->operands[0], 1))
+		return false;
+	auto setCond = getCond(it->mnemonic, "set");
+	if (setCond.empty() || test == phi.pLines->end() || test->type != AsmLine::Type::Instruction || test->operands.size() != 2 || test->operands[0] != it->operands[0])
+		return false;
+	if (set == phi.pLines->end() || set->type != AsmLine::Type::Instruction || set->operands.size() != 1 || set->operands[0] != it->operands[0])
+		return false;
+
+	auto cond = getBoolTestCond(setCond, *test, getCond(set->mnemonic, "set"));
+	if (cond.empty() || !isDeadAfter(phi, set, FLAGS_BIT))
+		return false;
+
+	it->mnemonic = "set" + cond;
+	phi.pLines->erase(set);
+	phi.pLines->erase(test);
+	return true;
+}
+
+// mov R, 1 / mul R
+bool ruleMulOne(PeepholeInfo& phi, AsmIt it)
+{
+	auto mul = nextLine(phi, it);
+	int64_t value;
+	if (!isInstr(phi, it, "mov", 2) || !isInstr(phi, mul, "mul", 1) || !parseImm(it->operands[1], value) || value != 1)
+		return false;
+	auto& reg = it->operands[0];
+	if (!isReg(reg, 8) || mul->operands[0] != reg || reg == "rax" || reg == "rdx")
+		return false;
+	if (!isDeadAfter(phi, mul, REG_BIT(getRegInfo(reg).base) | REG_BIT(REG_RDX) | FLAGS_BIT))
+		return false;
+
+	phi.pLines->erase(mul);
+	phi.pLines->erase(it);
+	return true;
+}
+
+// add R, 0 / sub R, 0
+bool ruleAddZero(PeepholeInfo& phi, AsmIt it)
+{
+	int64_t value;
+	if (!isInstr(phi, it, "add", 2) && !isInstr(phi, it, "sub", 2))
+		return false;
+	if (!isReg(it->operands[0]) || !parseImm(it->operands[1], value) || value != 0)
+		return false;
+	if (getRegInfo(it->operands[0]).size == 4 || !isDeadAfter(phi, it, FLAGS_BIT)) // 32 bit operations clear the upper half
+		return false;
+
+	phi.pLines->erase(it);
+	return true;
+}
+
+typedef bool (*PeepholeRule)(PeepholeInfo& phi, AsmIt it);
+
+static const std::vector<std::pair<std::string, PeepholeRule>> peepholeRules = {
+	{ "push-pop-same", rulePushPopSame },
+	{ "push-pop-move", rulePushPopMove },
+	{ "push-pop-around", rulePushPopAround },
+	{ "frame-address", ruleFrameAddress },
+	{ "address-offset", ruleAddressOffset },
+	{ "address-fold", ruleAddressFold },
+	{ "move-forward", ruleMoveForward },
+	{ "dead-move", ruleDeadMove },
+	{ "self-move", ruleSelfMove },
+	{ "jump-to-next", ruleJumpToNext },
+	{ "setcc-branch", ruleSetccBranch },
+	{ "setcc-not", ruleSetccNot },
+	{ "mul-one", ruleMulOne },
+	{ "add-zero", ruleAddZero },
+};
+
+// Splits the operands at the top-level commas
+std::vector<std::string> splitOperands(const std::string& str)
+{
+	std::vector<std::string> operands;
+	std::string curr;
+	int depth = 0;
+	for (char c : str)
+	{
+		if (c == '[' || c == '(')
+			++depth;
+		else if (c == ']' || c == ')')
+			--depth;
+
+		if (c == ',' && depth == 0)
+		{
+			operands.push_back(curr);
+			curr.clear();
+			continue;
+		}
+		curr.push_back(c);
+	}
+	operands.push_back(curr);
+
+	for (auto& op : operands)
+	{
+		auto begin = op.find_first_not_of(' ');
+		auto end = op.find_last_not_of(' ');
+		op = begin == std::string::npos ? "" : op.substr(begin, end - begin + 1);
+	}
+	return operands;
+}
+
+AsmLine parseAsmLine(const std::string& text)
+{
+	AsmLine line;
+	line.text = text;
+
+	if (!text.empty() && text[0] == ';')
+	{
+		line.type = AsmLine::Type::Comment;
+		return line;
+	}
+
+	if (!text.empty() && text[0] != ' ' && text.back() == ':' && text.find(' ') == std::string::npos)
+	{
+		line.type = AsmLine::Type::Label;
+		return line;
+	}
+
+	if (text.find("  ") != 0)
+		return line;
+
+	auto code = text;
+	auto commentPos = text.find(';');
+	if (commentPos != std::string::npos)
+	{
+		code = text.substr(0, commentPos);
+		line.comment = text.substr(commentPos);
+	}
+	if (code.find_first_of("\"'`:") != std::string::npos)
+		return line;
+
+	auto begin = code.find_first_not_of(' ');
+	if (begin == std::string::npos)
+		return line;
+	auto end = code.find(' ', begin);
+	auto mnemonic = code.substr(begin, end - begin);
+	for (char c : mnemonic)
+		if (!islower(c) && !isdigit(c))
+			return line;
+
+	line.type = AsmLine::Type::Instruction;
+	line.mnemonic = mnemonic;
+	if (end != std::string::npos && code.find_first_not_of(' ', end) != std::string::npos)
+		line.operands = splitOperands(code.substr(end + 1));
+
+	for (auto& op : line.operands)
+		if (op.empty())
+			line.type = AsmLine::Type::Other;
+
+	return line;
+}
+
+AsmLineList parseAsmLines(const std::string& code)
+{
+	AsmLineList lines;
+	std::istringstream stream(code);
+	std::string text;
+	while (std::getline(stream, text))
+		lines.push_back(parseAsmLine(text));
+	return lines;
+}
+
+std::string serializeAsmLines(const AsmLineList& lines)
+{
+	std::string code;
+	for (auto& line : lines)
+	{
+		if (line.type != AsmLine::Type::Instruction)
+		{
+			code += line.text + "\n";
+			continue;
+		}
+
+		code += "  " + line.mnemonic;
+		for (std::size_t i = 0; i < line.operands.size(); ++i)
+			code += (i == 0 ? " " : ", ") + line.operands[i];
+		if (!line.comment.empty())
+			code += " " + line.comment;
+		code += "\n";
+	}
+	return code;
+}
+
+void optimizePeephole(AsmLineList& lines, PeepholeStats& stats, const std::map<std::string, int>& regParamCounts)
+{
+	PeepholeInfo phi;
+	phi.pLines = &lines;
+	phi.pRegParamCounts = &regParamCounts;
+	for (auto it = lines.begin(); it != lines.end(); ++it)
+		if (it->type == AsmLine::Type::Label)
+			phi.labels[it->text.substr(0, it->text.size() - 1)] = it;
+
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+		for (auto it = lines.begin(); it != lines.end();)
+		{
+			if (it->type != AsmLine::Type::Instruction)
+			{
+				++it;
+				continue;
+			}
+
+			// Rules only modify/erase lines starting at the iterator, continue right before the rewritten lines
+			auto prev = it == lines.begin() ? lines.end() : std::prev(it);
+			bool applied = false;
+			for (auto& [name, rule] : peepholeRules)
+			{
+				if (rule(phi, it))
+				{
+					++stats[name];
+					applied = true;
+					break;
+				}
+			}
+
+			if (!applied)
+				++it;
+			else
+				it = prev == lines.end() ? lines.begin() : std::next(prev);
+			changed |= applied;
+		}
+	}
+}
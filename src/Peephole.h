@@ -0,0 +1,33 @@
+#pragma once
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+struct AsmLine
+{
+	enum class Type
+	{
+		Instruction,
+		Label,
+		Comment,
+		Other, // Sections, data definitions, directives, ...
+	} type = Type::Other;
+	std::string text; // Original line (labels, comments & others)
+	std::string mnemonic;
+	std::vector<std::string> operands;
+	std::string comment; // Trailing comment of instructions
+};
+typedef std::list<AsmLine> AsmLineList;
+
+typedef std::map<std::string, int> PeepholeStats; // Rule name -> number of applications
+
+AsmLineList parseAsmLines(const std::string& code);
+std::string serializeAsmLines(const AsmLineList& lines);
+
+// Applies the rewrite rules until none of them matches anymore.
+// Instructions that are not known to the optimizer (calls, syscall, inline assembly, ...) are never touched
+// and treated as if they read every register. Unconditional jumps to labels that are not part of the lines are treated as tail calls,
+// the callee reads the parameter registers given by regParamCounts (function label -> number of register parameters) or all of them if unknown.
+void optimizePeephole(AsmLineList& lines, PeepholeStats& stats, const std::map<std::string, int>& regParamCounts = {});
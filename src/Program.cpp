@@ -1,5 +1,6 @@
 #include "Program.h"
 
+#include <algorithm>
 #include <cassert>
 
 #include "Errors/QinpError.h"
@@ -75,8 +76,10 @@ std::string getMangledName(const std::string& basename, int id, const Datatype&
 {
 	return basename + "#" + std::to_string(id) + "$" + getDatatypeStr(datatype);
 }
-std::string getMangledName(SymbolRef symbol)
+std::string getMangledName(const SymbolRef& symbol)
 {
+	if (!symbol->mangledName.empty())
+		return symbol->mangledName;
 	if (isVariable(symbol))
 		return getMangledName(symbol->name, symbol->var.id, symbol->var.datatype);
 	if (isExtFunc(symbol))
@@ -91,6 +94,13 @@ std::string getMangledName(SymbolRef symbol)
 	return "";
 }
 
+void cacheMangledNames(ProgramRef program)
+{
+	for (auto sym : *program->symbols)
+		if (isVariable(sym) || isExtFunc(sym) || isFuncSpec(sym) || isEnum(sym))
+			sym->mangledName = getMangledName(sym);
+}
+
 std::string getReadableName(const std::vector<ExpressionRef>& paramExpr)
 {
 	std::string paramStr;
@@ -229,6 +239,30 @@ int getDatatypePushSize(const ProgramRef program, const Datatype& datatype)
 	return (size + 7) & -8;
 }
 
+bool usesRegCallConv(const ProgramRef program, const Datatype& retType, const std::vector<Datatype>& paramTypes)
+{
+	if (isPackType(program, retType))
+		return false;
+	for (const auto& paramType : paramTypes)
+		if (isPackType(program, paramType) || getDatatypePushSize(program, paramType) != 8)
+			return false;
+	return true;
+}
+
+int getRegParamCount(const SymbolRef func)
+{
+	if (!func->func.isRegCall)
+		return 0;
+	return std::min((int)func->func.params.size(), MAX_REG_PARAM_COUNT);
+}
+
+int getRegParamCount(const Expression* callExpr)
+{
+	if (!callExpr->isRegCall)
+		return 0;
+	return std::min((int)callExpr->paramExpr.size(), MAX_REG_PARAM_COUNT);
+}
+
 int getDatatypePointedToSize(const ProgramRef program, Datatype datatype)
 {
 	if (!isPointer(datatype) && !isArray(datatype))
@@ -4,6 +4,7 @@
 #include <memory>
 #include <string>
 #include <map>
+#include <set>
 
 #include "Token.h"
 #include "Statement.h"
@@ -20,7 +21,10 @@ std::string getSignature(const Expression* callExpr);
 std::string getMangledName(const std::string& funcName, const Datatype& retType, const std::vector<Datatype>& paramTypes);
 std::string getMangledName(const std::string& funcName, const Expression* callExpr);
 std::string getMangledName(const std::string& varName, int id, const Datatype& datatype);
-std::string getMangledName(SymbolRef symbol);
+std::string getMangledName(const SymbolRef& symbol);
+// Stores the mangled name of every variable/function/enum in the symbol itself, so generating code doesn't rebuild them on every use.
+// The program must not be modified afterwards.
+void cacheMangledNames(ProgramRef program);
 
 std::string getReadableName(const std::vector<ExpressionRef>& paramExpr);
 std::string getReadableName(const std::vector<SymbolRef>& paramSym, const std::vector<Token>& bpMacroTokens, const std::vector<TokenListRef>& bpMacroTokenEmplacements, bool isVariadic);
@@ -39,6 +43,7 @@ struct Program
 	BodyRef body;
 	int staticLocalInitCount = 0;
 	std::vector<int> staticLocalInitIDs;
+	std::set<std::string> imports; // Absolute paths of all imported files
 
 	std::string platform;
 };
@@ -55,4 +60,14 @@ int getDatatypePushSize(const ProgramRef program, const Datatype& datatype);
 
 int getDatatypePointedToSize(const ProgramRef program, Datatype datatype);
 
+// Maximum number of parameters passed in registers (rdi, rsi, rdx, rcx, r8, r9)
+#define MAX_REG_PARAM_COUNT 6
+
+// Calls to functions without pack parameters or return values use the register calling convention:
+// The first parameters are passed in registers, the remaining ones are pushed onto the stack and the result is returned in rax.
+// All other calls pass every parameter and the return value on the stack.
+bool usesRegCallConv(const ProgramRef program, const Datatype& retType, const std::vector<Datatype>& paramTypes);
+int getRegParamCount(const SymbolRef func);
+int getRegParamCount(const Expression* callExpr);
+
 SymbolRef currSym(const ProgramRef program);
\ No newline at end of file
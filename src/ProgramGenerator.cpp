@@ -12,6 +12,7 @@
 #include "Errors/ProgGenError.h"
 
 #include "Tokenizer.h"
+#include "TokenCache.h"
 #include "OperatorPrecedence.h"
 
 #define BLUEPRINT_SYMBOL_NAME "&_BLUEPRINTS_&"
@@ -1341,6 +1342,29 @@ void addVariable(ProgGenInfo &info, SymbolRef sym)
 	addSymbol(currSym(info), sym);
 }
 
+// Parameters passed in registers get a negative offset (stored by the callee), all others are pushed by the caller
+void assignParamOffsets(ProgGenInfo &info, SymbolRef funcSym)
+{
+	std::vector<Datatype> paramTypes;
+	for (auto &param : funcSym->func.params)
+		paramTypes.push_back(param->var.datatype);
+	funcSym->func.isRegCall = usesRegCallConv(info.program, funcSym->func.retType, paramTypes);
+
+	int nRegParams = getRegParamCount(funcSym);
+	for (int i = 0; i < (int)funcSym->func.params.size(); ++i)
+	{
+		auto &param = funcSym->func.params[i]->var;
+		if (i < nRegParams)
+		{
+			param.offset = -8 * (i + 1);
+			continue;
+		}
+
+		param.offset = funcSym->func.retOffset;
+		funcSym->func.retOffset += getDatatypePushSize(info.program, param.datatype);
+	}
+}
+
 SymbolRef addFunction(ProgGenInfo &info, SymbolRef func)
 {
 	auto funcs = getSymbol(currSym(info), func->name, true);
@@ -1406,6 +1430,9 @@ SymbolRef addFunction(ProgGenInfo &info, SymbolRef func)
 	if (func->func.isNoDiscard != existingOverload->func.isNoDiscard)
 		THROW_PROG_GEN_ERROR_POS(getBestPos(func), "Function '" + getReadableName(existingOverload) + "' was already declared with a non-matching no-discard attribute!: " + getPosStr(getBestPos(existingOverload)));
 
+	if (func->func.isInline != existingOverload->func.isInline || func->func.isNoInline != existingOverload->func.isNoInline)
+		THROW_PROG_GEN_ERROR_POS(getBestPos(func), "Function '" + getReadableName(existingOverload) + "' was already declared with a non-matching inlining attribute!: " + getPosStr(getBestPos(existingOverload)));
+
 	return replaceSymbol(existingOverload, func);
 }
 
@@ -1641,6 +1668,9 @@ ExpressionRef makeConvertExpression(ExpressionRef expToConvert, const Datatype &
 	exp->isObject = true;
 	exp->datatype = newDatatype;
 	exp->left = expToConvert;
+
+	if (expToConvert->eType == Expression::ExprType::Literal)
+		return autoSimplifyExpression(exp);
 	return exp;
 }
 
@@ -2002,142 +2032,259 @@ ExpressionRef getParseParenthesized(ProgGenInfo &info)
 	return exp;
 }
 
-ExpressionRef autoSimplifyExpression(ExpressionRef expr)
+bool isFoldableLiteral(const ExpressionRef expr)
 {
-	if (expr->eType == Expression::ExprType::Literal)
-		return expr;
+	return
+		expr &&
+		expr->eType == Expression::ExprType::Literal &&
+		isConstFoldable(expr->datatype);
+}
 
-	bool leftLiteral = false;
-	bool rightLiteral = false;
-	bool farRightLiteral = false; // TODO: Implement ternary operator
+bool isFoldableLiteral(const ExpressionRef expr, uint64_t value)
+{
+	return
+		isFoldableLiteral(expr) &&
+		truncateConst(expr->value.u64, expr->datatype) == value;
+}
 
-	// Simplify subexpression before simplifying the current expression
-	// Check every operand whether it is a literal or not
-	if (expr->left)
-	{
-		expr->left = autoSimplifyExpression(expr->left);
-		if (expr->left->eType == Expression::ExprType::Literal)
-			leftLiteral = true;
-	}
-	if (expr->right)
+bool isPureExpression(const ExpressionRef expr)
+{
+	if (!expr)
+		return true;
+
+	switch (expr->eType)
 	{
-		expr->right = autoSimplifyExpression(expr->right);
-		if (expr->right->eType == Expression::ExprType::Literal)
-			rightLiteral = true;
+	case Expression::ExprType::Assign:
+	case Expression::ExprType::Assign_Sum:
+	case Expression::ExprType::Assign_Difference:
+	case Expression::ExprType::Assign_Product:
+	case Expression::ExprType::Assign_Quotient:
+	case Expression::ExprType::Assign_Remainder:
+	case Expression::ExprType::Assign_Bw_LeftShift:
+	case Expression::ExprType::Assign_Bw_RightShift:
+	case Expression::ExprType::Assign_Bw_AND:
+	case Expression::ExprType::Assign_Bw_XOR:
+	case Expression::ExprType::Assign_Bw_OR:
+	case Expression::ExprType::Prefix_Increment:
+	case Expression::ExprType::Prefix_Decrement:
+	case Expression::ExprType::Suffix_Increment:
+	case Expression::ExprType::Suffix_Decrement:
+	case Expression::ExprType::FunctionCall:
+	// Memory accesses through pointers and divisions may trap
+	case Expression::ExprType::Dereference:
+	case Expression::ExprType::Subscript:
+	case Expression::ExprType::MemberAccessDereference:
+		return false;
+	case Expression::ExprType::Quotient:
+	case Expression::ExprType::Remainder:
+		if (!isFoldableLiteral(expr->right) || isFoldableLiteral(expr->right, 0))
+			return false;
+		break;
+	default:
+		break;
 	}
-	if (expr->farRight)
+
+	return
+		isPureExpression(expr->left) &&
+		isPureExpression(expr->right) &&
+		isPureExpression(expr->farRight);
+}
+
+// Returns the literal the initializer evaluates to or nullptr if it has to run as code.
+// Null and string literals are only accepted when converted to a pointer, other literals must be foldable.
+ExpressionRef getStaticInitLiteral(const ExpressionRef expr)
+{
+	auto leaf = expr;
+	while (leaf->eType == Expression::ExprType::Conversion && isPointer(leaf->datatype))
+		leaf = leaf->left;
+
+	if (leaf->eType != Expression::ExprType::Literal)
+		return nullptr;
+	if (leaf == expr)
+		return isFoldableLiteral(leaf) ? leaf : nullptr;
+	if (isNull(leaf->datatype) || isArray(leaf->datatype))
+		return leaf;
+	return nullptr;
+}
+
+ExpressionRef makeRValueExpression(ExpressionRef expr)
+{
+	if (!expr->isLValue)
+		return expr;
+
+	auto exp = std::make_shared<Expression>(*expr);
+	exp->isLValue = false;
+	return exp;
+}
+
+void checkDivisionByZero(ExpressionRef expr)
+{
+	switch (expr->eType)
 	{
-		expr->farRight = autoSimplifyExpression(expr->farRight);
-		if (expr->farRight->eType == Expression::ExprType::Literal)
-			farRightLiteral = true;
+	case Expression::ExprType::Quotient:
+	case Expression::ExprType::Remainder:
+	case Expression::ExprType::Assign_Quotient:
+	case Expression::ExprType::Assign_Remainder:
+		if (isFoldableLiteral(expr->right, 0))
+			PRINT_WARNING(MAKE_PROG_GEN_ERROR_POS(expr->right->pos, "Division by zero!"));
+		break;
+	default:
+		break;
 	}
+}
 
-	// TODO: Handle floating point expressions
-	// TODO: Handle signed integer expressions
-	// TODO: Handle Conversion
-	// TODO: Masking
+ExpressionRef simplifyAlgebraicIdentity(ExpressionRef expr)
+{
+	auto &left = expr->left;
+	auto &right = expr->right;
 
-	if (leftLiteral)
+	// Replaces the expression with one of its operands
+	auto keep = [&](ExpressionRef operand) -> ExpressionRef
 	{
-		if (rightLiteral) // leftLiteral == true && rightLiteral == true
-		{
-			switch (expr->eType)
-			{
-			case Expression::ExprType::Logical_OR:
-				expr = makeLiteralExpression(expr->pos, {"bool"}, EValue(uint64_t(expr->left->value.u64 || expr->right->value.u64)));
-				break;
-			case Expression::ExprType::Logical_AND:
-				expr = makeLiteralExpression(expr->pos, {"bool"}, EValue(uint64_t(expr->left->value.u64 && expr->right->value.u64)));
-				break;
-			case Expression::ExprType::Bitwise_OR:
-				expr = makeLiteralExpression(expr->pos, expr->datatype, EValue(uint64_t(expr->left->value.u64 | expr->right->value.u64)));
-				break;
-			case Expression::ExprType::Bitwise_XOR:
-				expr = makeLiteralExpression(expr->pos, expr->datatype, EValue(uint64_t(expr->left->value.u64 ^ expr->right->value.u64)));
-				break;
-			case Expression::ExprType::Bitwise_AND:
-				expr = makeLiteralExpression(expr->pos, expr->datatype, EValue(uint64_t(expr->left->value.u64 & expr->right->value.u64)));
-				break;
-			case Expression::ExprType::Comparison_Equal:
-				expr = makeLiteralExpression(expr->pos, {"bool"}, EValue(uint64_t(expr->left->value.u64 == expr->right->value.u64)));
-				break;
-			case Expression::ExprType::Comparison_NotEqual:
-				expr = makeLiteralExpression(expr->pos, {"bool"}, EValue(uint64_t(expr->left->value.u64 != expr->right->value.u64)));
-				break;
-			case Expression::ExprType::Comparison_Less:
-				expr = makeLiteralExpression(expr->pos, {"bool"}, EValue(uint64_t(expr->left->value.u64 < expr->right->value.u64)));
-				break;
-			case Expression::ExprType::Comparison_LessEqual:
-				expr = makeLiteralExpression(expr->pos, {"bool"}, EValue(uint64_t(expr->left->value.u64 <= expr->right->value.u64)));
-				break;
-			case Expression::ExprType::Comparison_Greater:
-				expr = makeLiteralExpression(expr->pos, {"bool"}, EValue(uint64_t(expr->left->value.u64 > expr->right->value.u64)));
-				break;
-			case Expression::ExprType::Comparison_GreaterEqual:
-				expr = makeLiteralExpression(expr->pos, {"bool"}, EValue(uint64_t(expr->left->value.u64 >= expr->right->value.u64)));
-				break;
-			case Expression::ExprType::Shift_Left:
-				expr = makeLiteralExpression(expr->pos, expr->datatype, EValue(uint64_t(expr->left->value.u64 << expr->right->value.u64)));
-				break;
-			case Expression::ExprType::Shift_Right:
-				expr = makeLiteralExpression(expr->pos, expr->datatype, EValue(uint64_t(expr->left->value.u64 >> expr->right->value.u64)));
-				break;
-			case Expression::ExprType::Sum:
-				expr = makeLiteralExpression(expr->pos, expr->datatype, EValue(uint64_t(expr->left->value.u64 + expr->right->value.u64)));
-				break;
-			case Expression::ExprType::Difference:
-				expr = makeLiteralExpression(expr->pos, expr->datatype, EValue(uint64_t(expr->left->value.u64 - expr->right->value.u64)));
-				break;
-			case Expression::ExprType::Product:
-				expr = makeLiteralExpression(expr->pos, expr->datatype, EValue(uint64_t(expr->left->value.u64 * expr->right->value.u64)));
-				break;
-			case Expression::ExprType::Quotient:
-				expr = makeLiteralExpression(expr->pos, expr->datatype, EValue(uint64_t(expr->left->value.u64 / expr->right->value.u64)));
-				break;
-			case Expression::ExprType::Remainder:
-				expr = makeLiteralExpression(expr->pos, expr->datatype, EValue(uint64_t(expr->left->value.u64 % expr->right->value.u64)));
-				break;
-			}
-		}
-		else // leftLiteral == true && rightLiteral == false
-		{
-			;
-		}
+		if (!dtEqual(operand->datatype, expr->datatype))
+			return expr;
+		return makeRValueExpression(operand);
+	};
+	// Replaces the expression with a constant, the discarded operand must not have any side effects
+	auto constant = [&](ExpressionRef discarded, uint64_t value) -> ExpressionRef
+	{
+		if (!isConstFoldable(expr->datatype) || !isPureExpression(discarded))
+			return expr;
+		return makeLiteralExpression(expr->pos, expr->datatype, EValue(value));
+	};
 
-		switch (expr->eType) // leftLiteral == true
-		{
-		case Expression::ExprType::Logical_NOT:
-			expr = makeLiteralExpression(expr->pos, {"bool"}, EValue(uint64_t(!expr->left->value.u64)));
-			break;
-		case Expression::ExprType::Bitwise_NOT:
-			expr = makeLiteralExpression(expr->pos, expr->datatype, EValue(uint64_t(~expr->left->value.u64)));
-			break;
-		case Expression::ExprType::Prefix_Minus:
-			expr = makeLiteralExpression(expr->pos, expr->datatype, EValue(uint64_t(-expr->left->value.u64)));
-			break;
-		case Expression::ExprType::Conditional_Op:
-			expr = expr->left->value.u64 ? expr->right : expr->farRight;
-			break;
-		}
-	}
-	else
+	uint64_t allOnes = truncateConst(~uint64_t(0), expr->datatype);
+
+	switch (expr->eType)
 	{
-		if (rightLiteral) // leftLiteral == false && rightLiteral == true
-		{
-			;
-		}
-		else // leftLiteral == false && rightLiteral == false
-		{
-			;
-		}
+	case Expression::ExprType::Logical_OR:
+		if (isFoldableLiteral(left, 0)) return keep(right);
+		if (isFoldableLiteral(left, 1)) return constant(nullptr, 1); // Right operand doesn't get evaluated
+		if (isFoldableLiteral(right, 0)) return keep(left);
+		if (isFoldableLiteral(right, 1)) return constant(left, 1);
+		break;
+	case Expression::ExprType::Logical_AND:
+		if (isFoldableLiteral(left, 1)) return keep(right);
+		if (isFoldableLiteral(left, 0)) return constant(nullptr, 0); // Right operand doesn't get evaluated
+		if (isFoldableLiteral(right, 1)) return keep(left);
+		if (isFoldableLiteral(right, 0)) return constant(left, 0);
+		break;
+	case Expression::ExprType::Bitwise_OR:
+	case Expression::ExprType::Bitwise_XOR:
+	case Expression::ExprType::Sum:
+		if (isFoldableLiteral(right, 0)) return keep(left);
+		if (isFoldableLiteral(left, 0)) return keep(right);
+		break;
+	case Expression::ExprType::Bitwise_AND:
+		if (isFoldableLiteral(right, 0)) return constant(left, 0);
+		if (isFoldableLiteral(left, 0)) return constant(right, 0);
+		if (isFoldableLiteral(right, allOnes)) return keep(left);
+		if (isFoldableLiteral(left, allOnes)) return keep(right);
+		break;
+	case Expression::ExprType::Shift_Left:
+	case Expression::ExprType::Shift_Right:
+		if (isFoldableLiteral(right, 0)) return keep(left);
+		if (isFoldableLiteral(left, 0)) return constant(right, 0);
+		break;
+	case Expression::ExprType::Difference:
+		if (isFoldableLiteral(right, 0)) return keep(left);
+		break;
+	case Expression::ExprType::Product:
+		if (isFoldableLiteral(right, 1)) return keep(left);
+		if (isFoldableLiteral(left, 1)) return keep(right);
+		if (isFoldableLiteral(right, 0)) return constant(left, 0);
+		if (isFoldableLiteral(left, 0)) return constant(right, 0);
+		break;
+	// Same restrictions as in evalConstBinary (8 bit and signed divisions)
+	case Expression::ExprType::Quotient:
+		if (isUnsignedInt(expr->datatype) && getConstBitWidth(expr->datatype) > 8 && isFoldableLiteral(right, 1)) return keep(left);
+		break;
+	case Expression::ExprType::Remainder:
+		if (isUnsignedInt(expr->datatype) && getConstBitWidth(expr->datatype) > 8 && isFoldableLiteral(right, 1)) return constant(left, 0);
+		break;
+	default:
+		break;
 	}
 
+	return expr;
+}
+
+ExpressionRef autoSimplifyExpression(ExpressionRef expr, ConstEvalInfo* pConstEval)
+{
+	if (expr->eType == Expression::ExprType::Literal)
+		return expr;
+
+	// Simplify subexpression before simplifying the current expression
+	if (expr->left)
+		expr->left = autoSimplifyExpression(expr->left, pConstEval);
+	if (expr->right)
+		expr->right = autoSimplifyExpression(expr->right, pConstEval);
+	if (expr->farRight)
+		expr->farRight = autoSimplifyExpression(expr->farRight, pConstEval);
+	if (pConstEval) // Parameters have already been simplified while parsing
+		for (auto &param : expr->paramExpr)
+			param = autoSimplifyExpression(param, pConstEval);
+
+	// TODO: Handle floating point expressions
+
+	bool leftLiteral = isFoldableLiteral(expr->left) || (expr->left && expr->left->eType == Expression::ExprType::Literal && isNull(expr->left->datatype));
+	bool rightLiteral = isFoldableLiteral(expr->right);
+
+	uint64_t value;
+
 	switch (expr->eType)
 	{
 	case Expression::ExprType::Conversion:
+		if (leftLiteral && evalConstConversion(expr->left->datatype, expr->datatype, expr->left->value.u64, value))
+			return makeLiteralExpression(expr->pos, expr->datatype, EValue(value));
 		break;
+	case Expression::ExprType::Logical_NOT:
+	case Expression::ExprType::Bitwise_NOT:
 	case Expression::ExprType::Prefix_Plus:
-		break; // Nothing to do
+	case Expression::ExprType::Prefix_Minus:
+		if (leftLiteral && evalConstUnary(expr->eType, expr->datatype, expr->left->value.u64, value))
+			return makeLiteralExpression(expr->pos, expr->datatype, EValue(value));
+		break;
+	case Expression::ExprType::Conditional_Op:
+		if (leftLiteral)
+		{
+			auto chosen = expr->left->value.u64 ? expr->right : expr->farRight;
+			return expr->isLValue ? chosen : makeRValueExpression(chosen);
+		}
+		break;
+	case Expression::ExprType::Logical_OR:
+	case Expression::ExprType::Logical_AND:
+	case Expression::ExprType::Bitwise_OR:
+	case Expression::ExprType::Bitwise_XOR:
+	case Expression::ExprType::Bitwise_AND:
+	case Expression::ExprType::Comparison_Equal:
+	case Expression::ExprType::Comparison_NotEqual:
+	case Expression::ExprType::Comparison_Less:
+	case Expression::ExprType::Comparison_LessEqual:
+	case Expression::ExprType::Comparison_Greater:
+	case Expression::ExprType::Comparison_GreaterEqual:
+	case Expression::ExprType::Shift_Left:
+	case Expression::ExprType::Shift_Right:
+	case Expression::ExprType::Sum:
+	case Expression::ExprType::Difference:
+	case Expression::ExprType::Product:
+	case Expression::ExprType::Quotient:
+	case Expression::ExprType::Remainder:
+		if (
+			leftLiteral && rightLiteral &&
+			isConstFoldable(expr->datatype) &&
+			evalConstBinary(expr->eType, expr->left->datatype, expr->left->value.u64, expr->right->value.u64, value)
+			)
+			return makeLiteralExpression(expr->pos, expr->datatype, EValue(value));
+		if (leftLiteral || rightLiteral)
+			return simplifyAlgebraicIdentity(expr);
+		break;
+	case Expression::ExprType::FunctionCall:
+		if (pConstEval && evalConstFunctionCall(*pConstEval, expr.get(), value))
+			return makeLiteralExpression(expr->pos, expr->datatype, EValue(value));
+		break;
+	default:
+		break;
 	}
 
 	return expr;
@@ -2206,6 +2353,7 @@ ExpressionRef getParseBinaryExpression(ProgGenInfo &info, int precLvl)
 			ENABLE_EXPR_ONLY_FOR_OBJ(currExpr->left);
 			ENABLE_EXPR_ONLY_FOR_OBJ(currExpr->right);
 			autoFixDatatypeMismatch(info, currExpr);
+			checkDivisionByZero(currExpr);
 			if (!currExpr->left->isLValue)
 				THROW_PROG_GEN_ERROR_POS(currExpr->left->pos, "Cannot assign to non-lvalue!");
 			currExpr->datatype = currExpr->left->datatype;
@@ -2283,6 +2431,7 @@ ExpressionRef getParseBinaryExpression(ProgGenInfo &info, int precLvl)
 			ENABLE_EXPR_ONLY_FOR_OBJ(currExpr->left);
 			ENABLE_EXPR_ONLY_FOR_OBJ(currExpr->right);
 			autoFixDatatypeMismatch(info, currExpr);
+			checkDivisionByZero(currExpr);
 			currExpr->datatype = currExpr->left->datatype;
 			currExpr->isLValue = false;
 			currExpr->isObject = true;
@@ -2427,9 +2576,17 @@ ExpressionRef getParseUnarySuffixExpression(ProgGenInfo &info, int precLvl)
 
 			exp->isObject = !isVoid(exp->datatype);
 
+			if (!exp->isExtCall)
+			{
+				std::vector<Datatype> paramTypes;
+				for (auto &param : exp->paramExpr)
+					paramTypes.push_back(param->datatype);
+				exp->isRegCall = usesRegCallConv(info.program, exp->datatype, paramTypes);
+			}
+
 			exp->paramSizeSum = 0;
-			for (auto &param : exp->paramExpr)
-				exp->paramSizeSum += getDatatypePushSize(info.program, param->datatype);
+			for (uint64_t i = getRegParamCount(exp.get()); i < exp->paramExpr.size(); ++i)
+				exp->paramSizeSum += getDatatypePushSize(info.program, exp->paramExpr[i]->datatype);
 		}
 		break;
 		case Expression::ExprType::Suffix_Increment:
@@ -3027,6 +3184,14 @@ bool parseDeclDefVariable(ProgGenInfo &info)
 		assignExpr->right = genConvertExpression(info, initExpr, varSym->var.datatype);
 		assignExpr->ignoreConstness = true;
 
+		// Constant initializers of static locals and of globals outside of control flow are emitted as data
+		bool isInitOnce = isVarContext(varSym, SymVarContext::Static) || (isVarContext(varSym, SymVarContext::Global) && info.mainBodyBackups.empty());
+		if (isInitOnce && !isOfType(varSym->var.datatype, DTType::Reference))
+			varSym->var.staticInit = getStaticInitLiteral(assignExpr->right);
+
+		if (varSym->var.staticInit)
+			return true;
+
 		if (isVarContext(varSym, SymVarContext::Static))
 			pushStaticLocalInit(info, assignExpr);
 		else
@@ -3126,9 +3291,6 @@ bool parseDeclDefFunction(ProgGenInfo &info)
 		if (!param.datatype)
 			THROW_PROG_GEN_ERROR_TOKEN(peekToken(info), "Expected datatype!");
 
-		param.offset = funcSym->func.retOffset;
-		funcSym->func.retOffset += getDatatypePushSize(info.program, param.datatype);
-
 		if (!isIdentifier(peekToken(info)))
 			THROW_PROG_GEN_ERROR_TOKEN(peekToken(info), "Expected identifier!");
 
@@ -3144,6 +3306,8 @@ bool parseDeclDefFunction(ProgGenInfo &info)
 
 	parseExpected(info, Token::Type::Separator, ")");
 
+	assignParamOffsets(info, funcSym);
+
 	funcSym->func.implicitBpMacroCount = funcSym->func.bpMacroTokens.size();
 
 	// Parse the explicit blueprint order if provided
@@ -3202,6 +3366,18 @@ bool parseDeclDefFunction(ProgGenInfo &info)
 		nextToken(info);
 	}
 
+	// Check if an inlining attribute is present
+	if (isKeyword(peekToken(info), "inline"))
+	{
+		funcSym->func.isInline = true;
+		nextToken(info);
+	}
+	else if (isKeyword(peekToken(info), "noinline"))
+	{
+		funcSym->func.isNoInline = true;
+		nextToken(info);
+	}
+
 	// Check whether a pre declaration is required or not
 	bool reqPreDecl = isOperator(peekToken(info), "!");
 	if (reqPreDecl)
@@ -3280,9 +3456,13 @@ bool parseDeclDefFunction(ProgGenInfo &info)
 		pushTempBody(info, funcSym->func.body);
 		enterSymbol(info, funcSym);
 
-		info.funcRetOffset = funcSym->func.retOffset;
+		// Parameters passed in registers are stored below the frame base by the callee
+		int nRegParams = getRegParamCount(funcSym);
+		funcSym->frame.totalOffset = -8 * nRegParams;
+
+		info.funcRetOffset = funcSym->func.isRegCall ? 0 : funcSym->func.retOffset;
 		info.funcRetType = funcSym->func.retType;
-		info.funcFrameSize = 0;
+		info.funcFrameSize = 8 * nRegParams;
 
 		for (auto &param : funcSym->func.params)
 			addSymbol(funcSym, param);
@@ -4111,56 +4291,78 @@ void parseGlobalCode(ProgGenInfo &info, bool fromBeginning)
 	}
 }
 
-void importFile(ProgGenInfo &info, const Token &fileToken)
+std::string toLowerAscii(std::string str)
 {
-	auto getImportFile = [&](const std::string &dir) -> std::string
-	{
-		std::string absPath;
-		try
-		{
-			absPath = std::filesystem::canonical(std::filesystem::path(dir) / fileToken.value).string();
-		}
-		catch (std::filesystem::filesystem_error &)
-		{
-			return "<notFound>";
-		}
+	for (auto &c : str)
+		c = (char)tolower((unsigned char)c);
+	return str;
+}
 
-		if (info.imports.find(absPath) != info.imports.end())
-			return "<alreadyImported>";
+// The names are lowercase, so the lookups also work on case-insensitive filesystems
+const std::set<std::string> &getDirListing(ProgGenInfo &info, const std::string &dir)
+{
+	auto it = info.dirListings.find(dir);
+	if (it != info.dirListings.end())
+		return it->second;
 
-		if (std::filesystem::is_regular_file(absPath))
-		{
-			info.imports.insert(absPath);
-			return absPath;
-		}
-		return "<notFound>";
-	};
+	auto &listing = info.dirListings[dir];
+	std::error_code ec;
+	for (auto &entry : std::filesystem::directory_iterator(dir.empty() ? "." : dir, ec))
+	{
+		if (entry.is_regular_file(ec))
+			listing.insert(toLowerAscii(entry.path().filename().string()));
+	}
+	return listing;
+}
 
-	// Seach for a matching file relative to the current file's directory
-	std::string path = getImportFile(std::filesystem::path(info.progPath).parent_path().string());
+std::string resolveImportFile(ProgGenInfo &info, const std::string &requestingDir, const std::string &importStr)
+{
+	auto key = std::make_tuple(requestingDir, importStr, info.program->platform);
+	auto it = info.importResolutions.find(key);
+	if (it != info.importResolutions.end())
+		return it->second;
 
-	if (path == "<alreadyImported>")
-		return;
+	std::string absPath;
+	auto findInDir = [&](const std::string &dir) -> bool
+	{
+		auto path = (std::filesystem::path(dir) / importStr).lexically_normal();
+		auto &listing = getDirListing(info, path.parent_path().string());
+		if (listing.find(toLowerAscii(path.filename().string())) == listing.end())
+			return false;
+
+		// The filesystem decides whether the case has to match
+		std::error_code ec;
+		if (!std::filesystem::is_regular_file(path, ec))
+			return false;
+		absPath = std::filesystem::canonical(path, ec).string();
+		return !ec;
+	};
 
-	if (path == "<notFound>")
+	// Seach for a matching file relative to the current file's directory, then in the specified import directories
+	if (!findInDir(requestingDir))
 	{
-		// Search for a matching file in the specified import directories
+		absPath.clear();
 		for (auto &dir : info.importDirs)
 		{
-			path = getImportFile(dir);
-
-			if (path == "<alreadyImported>")
-				return;
-
-			if (path != "<notFound>")
+			if (findInDir(dir))
 				break;
+			absPath.clear();
 		}
-
-		if (path == "<notFound>")
-			THROW_PROG_GEN_ERROR_TOKEN(fileToken, "Import file not found: '" + fileToken.value + "'!");
 	}
 
-	std::string code = readTextFile(path);
+	info.importResolutions.insert({ key, absPath });
+	return absPath;
+}
+
+void importFile(ProgGenInfo &info, const Token &fileToken)
+{
+	std::string path = resolveImportFile(info, std::filesystem::path(info.progPath).parent_path().string(), fileToken.value);
+	if (path.empty())
+		THROW_PROG_GEN_ERROR_TOKEN(fileToken, "Import file not found: '" + fileToken.value + "'!");
+
+	if (info.imports.find(path) != info.imports.end())
+		return;
+	info.imports.insert(path);
 
 	std::string origPath = (path.find(info.stdlibPath) == 0)
 		? info.stdlibOrigin + path.substr(info.stdlibPath.size())
@@ -4168,7 +4370,7 @@ void importFile(ProgGenInfo &info, const Token &fileToken)
 
 	parseInlineTokens(
 		info,
-		tokenize(code, std::filesystem::relative(origPath, std::filesystem::current_path()).string(), info.comments),
+		tokenizeFile(path, std::filesystem::path(origPath).lexically_relative(std::filesystem::current_path()).string(), info.comments),
 		path);
 }
 
@@ -4267,6 +4469,109 @@ bool parseSingleGlobalCode(ProgGenInfo &info)
 	return false;
 }
 
+void collectFunctionReferences(ExpressionRef expr, std::set<SymbolRef> &functions)
+{
+	if (!expr)
+		return;
+
+	if (expr->symbol && isFunction(expr->symbol))
+		functions.insert(expr->symbol);
+
+	collectFunctionReferences(expr->left, functions);
+	collectFunctionReferences(expr->right, functions);
+	collectFunctionReferences(expr->farRight, functions);
+	for (auto &param : expr->paramExpr)
+		collectFunctionReferences(param, functions);
+}
+
+void collectFunctionReferences(BodyRef body, std::set<SymbolRef> &functions)
+{
+	if (!body)
+		return;
+
+	for (auto &statement : body->statements)
+	{
+		if (statement->type == Statement::Type::Expression)
+			collectFunctionReferences(std::static_pointer_cast<Expression>(statement), functions);
+		collectFunctionReferences(statement->subExpr, functions);
+		for (auto &condBody : statement->ifConditionalBodies)
+		{
+			collectFunctionReferences(condBody.condition, functions);
+			collectFunctionReferences(condBody.body, functions);
+		}
+		collectFunctionReferences(statement->elseBody, functions);
+		collectFunctionReferences(statement->whileConditionalBody.condition, functions);
+		collectFunctionReferences(statement->whileConditionalBody.body, functions);
+		collectFunctionReferences(statement->doWhileConditionalBody.condition, functions);
+		collectFunctionReferences(statement->doWhileConditionalBody.body, functions);
+	}
+}
+
+void evalConstFunctionCalls(ConstEvalInfo &cei, ExpressionRef &expr)
+{
+	if (expr)
+		expr = autoSimplifyExpression(expr, &cei);
+}
+
+void evalConstFunctionCalls(ConstEvalInfo &cei, BodyRef body)
+{
+	if (!body)
+		return;
+
+	for (auto it = body->statements.begin(); it != body->statements.end();)
+	{
+		auto &statement = *it;
+		if (statement->type == Statement::Type::Expression)
+		{
+			auto expr = autoSimplifyExpression(std::static_pointer_cast<Expression>(statement), &cei);
+			// Evaluated calls are free of side effects
+			if (expr->eType == Expression::ExprType::Literal)
+			{
+				it = body->statements.erase(it);
+				continue;
+			}
+			statement = expr;
+		}
+		evalConstFunctionCalls(cei, statement->subExpr);
+		for (auto &condBody : statement->ifConditionalBodies)
+		{
+			evalConstFunctionCalls(cei, condBody.condition);
+			evalConstFunctionCalls(cei, condBody.body);
+		}
+		evalConstFunctionCalls(cei, statement->elseBody);
+		evalConstFunctionCalls(cei, statement->whileConditionalBody.condition);
+		evalConstFunctionCalls(cei, statement->whileConditionalBody.body);
+		evalConstFunctionCalls(cei, statement->doWhileConditionalBody.condition);
+		evalConstFunctionCalls(cei, statement->doWhileConditionalBody.body);
+		++it;
+	}
+}
+
+void evalConstFunctionCalls(ProgGenInfo &info)
+{
+	ConstEvalInfo cei;
+	cei.program = info.program;
+
+	std::vector<BodyRef> bodies = { info.program->body };
+	for (auto sym : *info.program->symbols)
+		if (isFuncSpec(sym) && isDefined(sym) && !sym->func.isBlueprint && sym->func.body)
+			bodies.push_back(sym->func.body);
+
+	for (auto &body : bodies)
+	{
+		std::set<SymbolRef> before, after;
+		collectFunctionReferences(body, before);
+
+		evalConstFunctionCalls(cei, body);
+
+		// Functions only referenced by evaluated calls are no longer used by this body
+		collectFunctionReferences(body, after);
+		for (auto func : before)
+			if (!after.count(func))
+				body->usedFunctions.erase(getSymbolPath(nullptr, func));
+	}
+}
+
 void markReachableFunctions(ProgGenInfo &info, BodyRef body)
 {
 	for (auto &funcPath : body->usedFunctions)
@@ -4349,8 +4654,12 @@ ProgramRef generateProgram(
 
 	genDeclaredOnlyBpSpecs(info);
 
+	evalConstFunctionCalls(info);
+
 	markReachableFunctions(info, info.program->body);
 	detectUndefinedFunctions(info);
 
+	info.program->imports = info.imports;
+
 	return info.program;
 }
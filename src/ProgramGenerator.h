@@ -2,8 +2,10 @@
 
 #include <set>
 #include <queue>
+#include <tuple>
 
 #include "Program.h"
+#include "ConstEval.h"
 
 ProgramRef generateProgram(
 	const TokenListRef tokens,
@@ -62,6 +64,8 @@ struct ProgGenInfo
 	Datatype funcRetType;
 
 	std::set<std::string> imports;
+	std::map<std::tuple<std::string, std::string, std::string>, std::string> importResolutions = {}; // (requesting directory, import string, platform) -> absolute path ("" if not found)
+	std::map<std::string, std::set<std::string>> dirListings = {}; // directory -> lowercase names of the regular files within
 
 	std::vector<Token> deferredImports;
 	std::queue<ProgGenInfoBackup> deferredCompilations;
@@ -215,7 +219,21 @@ ExpressionRef getParseValue(ProgGenInfo& info, bool localOnly);
 
 ExpressionRef getParseParenthesized(ProgGenInfo& info);
 
-ExpressionRef autoSimplifyExpression(ExpressionRef expr);
+bool isFoldableLiteral(const ExpressionRef expr);
+
+bool isFoldableLiteral(const ExpressionRef expr, uint64_t value);
+
+bool isPureExpression(const ExpressionRef expr);
+
+ExpressionRef getStaticInitLiteral(const ExpressionRef expr);
+
+ExpressionRef makeRValueExpression(ExpressionRef expr);
+
+void checkDivisionByZero(ExpressionRef expr);
+
+ExpressionRef simplifyAlgebraicIdentity(ExpressionRef expr);
+
+ExpressionRef autoSimplifyExpression(ExpressionRef expr, ConstEvalInfo* pConstEval = nullptr);
 
 ExpressionRef getParseBinaryExpression(ProgGenInfo& info, int precLvl);
 
@@ -279,12 +297,26 @@ bool parseEnum(ProgGenInfo& info);
 
 void parseGlobalCode(ProgGenInfo& info, bool fromBeginning);
 
+const std::set<std::string>& getDirListing(ProgGenInfo& info, const std::string& dir);
+
+std::string resolveImportFile(ProgGenInfo& info, const std::string& requestingDir, const std::string& importStr);
+
 void importFile(ProgGenInfo& info, const Token& fileToken);
 
 bool parseStatementImport(ProgGenInfo& info);
 
 bool parseSingleGlobalCode(ProgGenInfo& info);
 
+void collectFunctionReferences(ExpressionRef expr, std::set<SymbolRef>& functions);
+
+void collectFunctionReferences(BodyRef body, std::set<SymbolRef>& functions);
+
+void evalConstFunctionCalls(ConstEvalInfo& cei, ExpressionRef& expr);
+
+void evalConstFunctionCalls(ConstEvalInfo& cei, BodyRef body);
+
+void evalConstFunctionCalls(ProgGenInfo& info);
+
 void markReachableFunctions(ProgGenInfo& info, BodyRef body);
 
 void detectUndefinedFunctions(ProgGenInfo& info);
@@ -2,21 +2,33 @@
 
 #include <map>
 #include <vector>
+#include <thread>
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
 
 #include "Errors/QinpError.h"
 #include "Warning.h"
 #include "Tokenizer.h"
+#include "TokenCache.h"
+#include "CompileServer.h"
+#include "FileWatcher.h"
 #include "ArgsParser.h"
 #include "ProgramGenerator.h"
 #include "PlatformName.h"
 #include "ExecCmd.h"
+#include "TempDir.h"
 #include "ExportSymbolInfo.h"
 #include "ExportComments.h"
+#include "IRGenerator.h"
 #include "pathToExecutableDir.h"
 
 #include "NasmGenerator.h"
+#include "X86Assembler.h"
+#include "ElfWriter.h"
+#include "StaticLinker.h"
+#include "GasTranslator.h"
+#include "Errors/AssemblerError.h"
 
 void writeTextFileOverwrite(const std::string& filename, const std::string& text)
 {
@@ -26,6 +38,14 @@ void writeTextFileOverwrite(const std::string& filename, const std::string& text
 	file << text;
 }
 
+void writeBinaryFileOverwrite(const std::string& filename, const std::string& data)
+{
+	std::ofstream file(filename, std::ios::trunc | std::ios::binary);
+	if (!file.is_open())
+		THROW_QINP_ERROR("Unable to open file!");
+	file.write(data.data(), data.size());
+}
+
 std::map<std::string, std::string> getEnv(char** env)
 {
 	std::map<std::string, std::string> envMap;
@@ -54,6 +74,16 @@ std::map<std::string, OptionInfo> argNames =
 	{ "x", { "extern", OptionInfo::Type::Multi } },
 	{ "e", { "export-symbol-info", OptionInfo::Type::Single } },
 	{ "c", { "export-comments", OptionInfo::Type::Single } },
+	{ "S", { "server", OptionInfo::Type::Single } },
+	{ "C", { "client", OptionInfo::Type::Single } },
+	{ "w", { "watch", OptionInfo::Type::NoValue } },
+	{ "O", { "optimize", OptionInfo::Type::Single } },
+	{ "I", { "emit-ir", OptionInfo::Type::Single } },
+	{ "b", { "backend", OptionInfo::Type::Single } },
+	{ "A", { "assembler", OptionInfo::Type::Single } },
+	{ "j", { "jobs", OptionInfo::Type::Single } },
+	{ "s", { "string-align", OptionInfo::Type::Single } },
+	{ "f", { "function-order", OptionInfo::Type::Single } },
 };
 
 #define HELP_TEXT \
@@ -70,6 +100,7 @@ std::map<std::string, OptionInfo> argNames =
 	"    Specifies the output path of the generated executable.\n" \
 	"  -k, --keep\n" \
 	"    Keeps the generated assembly file.\n" \
+	"    Otherwise intermediate files are written to a private temporary directory.\n" \
 	"  -r, --run\n" \
 	"    Runs the generated program.\n" \
 	"  -p, --platform=[platform]\n" \
@@ -84,13 +115,51 @@ std::map<std::string, OptionInfo> argNames =
 	"    Writes the symbols (including unused ones) of the parsed program code\n" \
 	"    and additional info to the specified file.\n" \
 	"  -c, --export-comments\n" \
-	"    Writes the comments of the parsed program code to the specified file.\n"
+	"    Writes the comments of the parsed program code to the specified file.\n" \
+	"  -S, --server=[socket]\n" \
+	"    Runs a compile server listening on the specified unix socket.\n" \
+	"    The server keeps the tokenized stdlib in memory and handles every request in its own process.\n" \
+	"  -C, --client=[socket]\n" \
+	"    Lets the compile server listening on the specified unix socket compile the program.\n" \
+	"    Running the generated program (--run) is done by the client.\n" \
+	"  -w, --watch\n" \
+	"    Recompiles (and runs, when --run is specified) the program whenever\n" \
+	"    the input file or one of the imported files changes.\n" \
+	"    Prints the time spent in each phase after every iteration.\n" \
+	"  -O, --optimize=[level]\n" \
+	"    Specifies the optimization level. (0, 1; default: 1)\n" \
+	"    Level 0 uses the legacy code generator only, level 1 generates functions via the IR,\n" \
+	"    inlines small functions, turns tail calls into jumps\n" \
+	"    and runs the peephole optimizer on the generated assembly.\n" \
+	"  -I, --emit-ir=[path]\n" \
+	"    Writes the IR of the reachable functions to the specified file.\n" \
+	"  -b, --backend=[backend]\n" \
+	"    Specifies how the object file is produced. (asm, elf; default: asm)\n" \
+	"    The asm backend writes an assembly file and runs the external assembler (see --assembler).\n" \
+	"    The elf backend encodes the instructions itself and writes the object file directly (linux only).\n" \
+	"    Without --extern it also links the executable itself instead of running ld.\n" \
+	"    It falls back to the external assembler for code it cannot encode.\n" \
+	"    The assembly file is only written with --keep.\n" \
+	"  -A, --assembler=[assembler]\n" \
+	"    Specifies the external assembler. (nasm, gas; default: nasm)\n" \
+	"    With gas the generated code is translated to GNU as syntax (.intel_syntax noprefix) and assembled with 'as' (linux only).\n" \
+	"    The translated code is streamed to 'as' through a pipe.\n" \
+	"  -j, --jobs=[count]\n" \
+	"    Specifies the number of threads generating the code of the functions. (default: number of CPU cores)\n" \
+	"  -s, --string-align=[bytes]\n" \
+	"    Specifies the alignment of the string literals. (power of 2, max. 4096; default: 1)\n" \
+	"    Literals that are the tail of another literal are stored as part of it and are not aligned.\n" \
+	"  -f, --function-order=[path]\n" \
+	"    Places the functions listed in the specified file (one mangled name per line) first, in the listed order.\n" \
+	"    Used to group the hot functions of a program together.\n"
+
+typedef std::vector<std::pair<std::string, double>> PhaseTimes; // Phase name -> Duration in seconds
 
 class Timer
 {
 public:
-	Timer(const std::string& msg, bool doPrint)
-		: m_doPrint(doPrint)
+	Timer(const std::string& msg, bool doPrint, PhaseTimes* pTimes = nullptr)
+		: m_msg(msg), m_doPrint(doPrint), m_pTimes(pTimes)
 	{
 		if (m_doPrint)
 			std::cout << msg << "...\n";
@@ -98,34 +167,58 @@ public:
 	}
 	~Timer()
 	{
-		if (!m_doPrint)
-			return;
-
 		end = std::chrono::high_resolution_clock::now();
 		std::chrono::duration<double> diff = end - start;
-		std::cout << " DONE: " << diff.count() << "s" << std::endl;
+
+		if (m_pTimes)
+			m_pTimes->push_back({ m_msg, diff.count() });
+
+		if (m_doPrint)
+			std::cout << " DONE: " << diff.count() << "s" << std::endl;
 	}
 private:
 	std::chrono::time_point<std::chrono::high_resolution_clock> start;
 	std::chrono::time_point<std::chrono::high_resolution_clock> end;
+	std::string m_msg;
 	bool m_doPrint;
+	PhaseTimes* m_pTimes;
 };
 
-int main(int argc, char** argv, char** _env)
+struct CompileInfo
+{
+	std::string outFilename;
+	std::set<std::string> sourceFiles; // Absolute paths of the input file and all imported files
+	PhaseTimes phaseTimes;
+};
+
+int printException(bool verbose)
 {
-	bool verbose = true;
-	int runRet = 0;
 	try
 	{
-		auto args = parseArgs(getArgs(argc, argv), argNames);
-		auto env = getEnv(_env);
-
-		if (args.hasOption("help"))
-		{
-			std::cout << HELP_TEXT;
-			return 0;
-		}
+		throw;
+	}
+	catch (const QinpError& e)
+	{
+		std::cout << "[ ERR ]: QNP: " << e.what() << std::endl;
+		if (verbose)
+			std::cout << "WHERE: " << e.where() << std::endl;
+	}
+	catch (const std::exception& e)
+	{
+		std::cout << "[ ERR ]: STD: " << e.what() << std::endl;
+	}
+	catch (...)
+	{
+		std::cout << "[ ERR ]: Unknown error!" << std::endl;
+	}
+	return -1;
+}
 
+int compile(Args& args, CompileInfo& compInfo)
+{
+	bool verbose = args.hasOption("verbose");
+	try
+	{
 		std::string platform = QINP_PLATFORM;
 		if (args.hasOption("platform"))
 			platform = args.getOption("platform").front();
@@ -138,7 +231,89 @@ int main(int argc, char** argv, char** _env)
 			return -1;
 		}
 
-		verbose = args.hasOption("verbose");
+		int optLevel = 1;
+		if (args.hasOption("optimize"))
+		{
+			auto& level = args.getOption("optimize").front();
+			if (level != "0" && level != "1")
+			{
+				std::cout << "Invalid optimization level '" << level << "'!\n";
+				return -1;
+			}
+			optLevel = std::stoi(level);
+		}
+
+		int nJobs = std::max(1, (int)std::thread::hardware_concurrency());
+		if (args.hasOption("jobs"))
+		{
+			auto& jobs = args.getOption("jobs").front();
+			if (jobs.empty() || jobs.size() > 4 || !std::all_of(jobs.begin(), jobs.end(), isdigit) || std::stoi(jobs) < 1)
+			{
+				std::cout << "Invalid number of jobs '" << jobs << "'!\n";
+				return -1;
+			}
+			nJobs = std::stoi(jobs);
+		}
+
+		int strAlign = 1;
+		if (args.hasOption("string-align"))
+		{
+			auto& align = args.getOption("string-align").front();
+			if (align.empty() || align.size() > 4 || !std::all_of(align.begin(), align.end(), isdigit) ||
+				std::stoi(align) < 1 || std::stoi(align) > 4096 || (std::stoi(align) & (std::stoi(align) - 1)))
+			{
+				std::cout << "Invalid string alignment '" << align << "'!\n";
+				return -1;
+			}
+			strAlign = std::stoi(align);
+		}
+
+		std::vector<std::string> funcOrder;
+		if (args.hasOption("function-order"))
+		{
+			auto& orderFilename = args.getOption("function-order").front();
+			std::ifstream orderFile(orderFilename);
+			if (!orderFile.is_open())
+			{
+				std::cout << "Unable to open function order file '" << orderFilename << "'!\n";
+				return -1;
+			}
+			std::string name;
+			while (orderFile >> name)
+				funcOrder.push_back(name);
+		}
+
+		std::string backend = "asm";
+		if (args.hasOption("backend"))
+		{
+			backend = args.getOption("backend").front();
+			if (backend != "asm" && backend != "elf")
+			{
+				std::cout << "Invalid backend '" << backend << "'!\n";
+				return -1;
+			}
+			if (backend == "elf" && platform != "linux")
+			{
+				std::cout << "The elf backend is only supported on linux!\n";
+				return -1;
+			}
+		}
+
+		std::string assembler = "nasm";
+		if (args.hasOption("assembler"))
+		{
+			assembler = args.getOption("assembler").front();
+			if (assembler != "nasm" && assembler != "gas")
+			{
+				std::cout << "Invalid assembler '" << assembler << "'!\n";
+				return -1;
+			}
+			if (assembler == "gas" && platform != "linux")
+			{
+				std::cout << "The gas assembler is only supported on linux!\n";
+				return -1;
+			}
+		}
 
 		if (args.values.empty())
 		{
@@ -161,19 +336,20 @@ int main(int argc, char** argv, char** _env)
 		ProgramRef program;
 		auto comments = std::make_shared<CommentTokenMap>();
 		{
-			Timer timer("Parsing", verbose);
-			auto code = readTextFile(inFilename);
-			auto tokens = tokenize(code, std::filesystem::relative(inFilename, std::filesystem::current_path()).string(), comments);
+			Timer timer("Parsing", verbose, &compInfo.phaseTimes);
+			compInfo.sourceFiles.insert(std::filesystem::absolute(inFilename).lexically_normal().string());
+			auto tokens = tokenizeFile(inFilename, std::filesystem::relative(inFilename, std::filesystem::current_path()).string(), comments);
 			program = generateProgram(tokens, comments, importDirs, platform, inFilename, stdlibPath, stdlibOrigin);
+			compInfo.sourceFiles.insert(program->imports.begin(), program->imports.end());
 		}
 
 		if (args.hasOption("export-symbol-info"))
 		{
-			auto outFilename = args.getOption("export-symbol-info").front();
-			std::ofstream outFile(outFilename);
+			auto exportFilename = args.getOption("export-symbol-info").front();
+			std::ofstream outFile(exportFilename);
 			if (!outFile.is_open())
 			{
-				std::cout << "Failed to open file '" << outFilename << "' for writing!\n";
+				std::cout << "Failed to open file '" << exportFilename << "' for writing!\n";
 				return -1;
 			}
 			exportSymbolInfo(program->symbols, outFile);
@@ -182,17 +358,30 @@ int main(int argc, char** argv, char** _env)
 
 		if (args.hasOption("export-comments"))
 		{
-			auto outFilename = args.getOption("export-comments").front();
-			std::ofstream outFile(outFilename);
+			auto exportFilename = args.getOption("export-comments").front();
+			std::ofstream outFile(exportFilename);
 			if (!outFile.is_open())
 			{
-				std::cout << "Failed to open file '" << outFilename << "' for writing!\n";
+				std::cout << "Failed to open file '" << exportFilename << "' for writing!\n";
 				return -1;
 			}
 			exportComments(comments, outFile);
 			outFile.close();
 		}
 
+		if (args.hasOption("emit-ir"))
+		{
+			auto exportFilename = args.getOption("emit-ir").front();
+			std::ofstream outFile(exportFilename);
+			if (!outFile.is_open())
+			{
+				std::cout << "Failed to open file '" << exportFilename << "' for writing!\n";
+				return -1;
+			}
+			dumpIR(outFile, program);
+			outFile.close();
+		}
+
 		if (verbose)
 		{
 			for (auto sym : *program->symbols)
@@ -211,12 +400,40 @@ int main(int argc, char** argv, char** _env)
 			}
 		}
 
-		std::string output = genAsm(program, args.hasOption("verbose") && args.hasOption("keep"));
-	
-		std::string asmFilename = std::filesystem::path(inFilename).replace_extension(".asm").string();
-		writeTextFileOverwrite(asmFilename, output);
+		std::string output;
+		OptimizationStats optStats;
+		{
+			Timer timer("Generating assembly", verbose, &compInfo.phaseTimes);
+			NasmGenOptions genOpts;
+			genOpts.generateComments = args.hasOption("verbose") && args.hasOption("keep");
+			genOpts.optLevel = optLevel;
+			genOpts.nJobs = nJobs;
+			genOpts.strAlign = strAlign;
+			genOpts.funcOrder = funcOrder;
+			output = genAsm(program, genOpts, &optStats);
+		}
+
+		if (verbose && optStats.inlining.nInlinedCalls > 0)
+		{
+			auto& inl = optStats.inlining;
+			std::cout << "Inlined " << inl.nInlinedCalls << " call(s), IR instructions: "
+				<< inl.nInstrsBefore << " -> " << inl.nInstrsAfter << std::endl;
+		}
 
-		auto objFilename = std::filesystem::path(inFilename).replace_extension(".o").string();
+		if (verbose && !optStats.peephole.empty())
+		{
+			std::cout << "Peephole rule applications:" << std::endl;
+			for (auto& [rule, count] : optStats.peephole)
+				std::cout << "  " << rule << ": " << count << std::endl;
+		}
+	
+		// Intermediates go to a private directory, only the kept assembly file is placed next to the source
+		TempDir tempDir;
+		bool keepAsm = args.hasOption("keep");
+		std::string asmExt = assembler == "gas" ? ".s" : ".asm";
+		auto stem = std::filesystem::path(inFilename).stem().string();
+		std::string asmFilename = keepAsm ? std::filesystem::path(inFilename).replace_extension(asmExt).string() : tempDir.getPath(stem + asmExt);
+		auto objFilename = tempDir.getPath(stem + ".o");
 
 		std::string outExt;
 		if (platform == "linux")
@@ -224,19 +441,23 @@ int main(int argc, char** argv, char** _env)
 		else if (platform == "windows")
 			outExt = ".exe";
 
-		auto outFilename = args.hasOption("output") ? args.getOption("output").front() : std::filesystem::path(inFilename).replace_extension(outExt).string();
+		auto& outFilename = compInfo.outFilename;
+		outFilename = args.hasOption("output") ? args.getOption("output").front() : std::filesystem::path(inFilename).replace_extension(outExt).string();
 
-		std::string nasmCmd;
+		std::string asmCmd;
 		std::string linkCmd;
 
 		if (platform == "linux")
 		{
-			nasmCmd = "nasm -f elf64 -o '" + objFilename + "' '" + asmFilename + "'";
-			linkCmd = "ld -m elf_x86_64 -o '" + outFilename + "' '" + objFilename + "'";
+			if (assembler == "gas")
+				asmCmd = "as --64 -o '" + objFilename + "'"; // Reads the code from stdin
+			else
+				asmCmd = "nasm -f elf64 -o '" + objFilename + "' '" + asmFilename + "'";
+			linkCmd = "ld -m elf_x86_64 --gc-sections -o '" + outFilename + "' '" + objFilename + "'";
 		}
 		else if (platform == "windows")
 		{
-			nasmCmd = "nasm -f win64 -o \"" + objFilename + "\" \"" + asmFilename + "\"";
+			asmCmd = "nasm -f win64 -o \"" + objFilename + "\" \"" + asmFilename + "\"";
 			// TODO: Link without LARGEADDRESSAWARE:NO
 			linkCmd = "vcvars64.bat >nul 2>nul && link /LARGEADDRESSAWARE:NO /MACHINE:X64 /SUBSYSTEM:CONSOLE /NODEFAULTLIB /ENTRY:_start /OUT:\"" + outFilename + "\" \"" + objFilename + "\" kernel32.lib";
 		}
@@ -248,51 +469,212 @@ int main(int argc, char** argv, char** _env)
 				linkCmd += " \"" + lib + "\"";
 		}
 
+		// The elf backend links by itself unless external objects need ld
+		ObjectFile obj;
+		bool useBuiltinAssembler = backend == "elf";
+		bool useBuiltinLinker = backend == "elf" && !args.hasOption("extern");
 		{
-			Timer timer("Assembling", verbose);
+			Timer timer("Assembling", verbose, &compInfo.phaseTimes);
+			if (useBuiltinAssembler)
+			{
+				try
+				{
+					obj = assembleX86(output);
+					if (!useBuiltinLinker)
+						writeBinaryFileOverwrite(objFilename, writeElfObject(obj));
+				}
+				catch (const AssemblerError& e)
+				{
+					PRINT_WARNING(MAKE_QINP_ERROR("Built-in assembler failed, falling back to " + assembler + ": " + e.what()));
+					useBuiltinAssembler = false;
+					useBuiltinLinker = false;
+				}
+			}
+
 			ExecCmdResult r;
-			if ((r = execCmd(nasmCmd)).first)
+			if (!useBuiltinAssembler && assembler == "gas")
+			{
+				// GNU as reads the code from a pipe and starts assembling while the code is still being translated
+				std::ofstream asmFile;
+				if (keepAsm)
+				{
+					asmFile.open(asmFilename, std::ios::trunc);
+					if (!asmFile.is_open())
+						THROW_QINP_ERROR("Unable to open file!");
+				}
+				r = execCmdWithInput(asmCmd, [&](const ExecCmdWriter& write)
+					{
+						translateToGas(output, [&](const std::string& chunk)
+							{
+								write(chunk);
+								if (keepAsm)
+									asmFile << chunk;
+							}
+						);
+					}
+				);
+			}
+			else
+			{
+				if (!useBuiltinAssembler || keepAsm)
+					writeTextFileOverwrite(asmFilename, assembler == "gas" ? translateToGas(output) : output);
+				if (!useBuiltinAssembler)
+					r = execCmd(asmCmd);
+			}
+			if (r.first)
 				THROW_QINP_ERROR("Assembler Error:\n" + r.second);
 		}
 		{
-			Timer timer("Linking", verbose);
-			ExecCmdResult r;
-			if ((r = execCmd(linkCmd)).first)
-				THROW_QINP_ERROR("Linker Error:\n" + r.second);
+			Timer timer("Linking", verbose, &compInfo.phaseTimes);
+			if (useBuiltinLinker)
+			{
+				// Replace instead of overwrite, the old executable might still be running
+				std::filesystem::remove(outFilename);
+				writeBinaryFileOverwrite(outFilename, linkExecutable({ obj }));
+				using std::filesystem::perms;
+				std::filesystem::permissions(outFilename, perms::owner_all | perms::group_read | perms::group_exec | perms::others_read | perms::others_exec);
+			}
+			else
+			{
+				ExecCmdResult r;
+				if ((r = execCmd(linkCmd)).first)
+					THROW_QINP_ERROR("Linker Error:\n" + r.second);
+			}
 		}
+	}
+	catch (...)
+	{
+		return printException(verbose);
+	}
 
-		std::filesystem::remove(objFilename);
-		if (!args.hasOption("keep"))
-			std::filesystem::remove(asmFilename);
+	return 0;
+}
 
-		if (args.hasOption("run"))
+int runProgram(Args& args, const std::string& outFilename)
+{
+	bool verbose = args.hasOption("verbose");
+
+	auto runCmd = outFilename;
+	if (args.hasOption("runarg"))
+		for (auto& arg : args.getOption("runarg"))
+			runCmd += " \"" + arg + "\""; // TODO: Proper quoting
+	if (verbose) std::cout << "Running generated program..." << std::endl;
+	int runRet = execCmd(runCmd, false).first;
+	if (verbose) std::cout << std::endl << "Exit code: " << runRet << std::endl;
+
+	return runRet;
+}
+
+int watch(Args& args)
+{
+	enableTokenCache(true);
+
+	// The watches exist before the first compilation, so changes made while compiling or running are noticed
+	FileWatcher watcher;
+	std::set<std::string> watchedFiles;
+	if (!args.values.empty())
+		watcher.addFiles({ std::filesystem::absolute(args.values[0]).lexically_normal().string() });
+	while (true)
+	{
+		CompileInfo compInfo;
+		int ret = compile(args, compInfo);
+		if (ret == 0 && args.hasOption("run"))
 		{
-			auto runCmd = outFilename;
-			if (args.hasOption("runarg"))
-				for (auto& arg : args.getOption("runarg"))
-					runCmd += " \"" + arg + "\""; // TODO: Proper quoting
-			if (verbose) std::cout << "Running generated program..." << std::endl;
-			runRet = execCmd(runCmd, false).first;
-			if (verbose) std::cout << std::endl << "Exit code: " << runRet << std::endl;
+			Timer timer("Running", false, &compInfo.phaseTimes);
+			ret = runProgram(args, compInfo.outFilename);
 		}
+
+		// Keep watching the previous files when the import graph is unknown due to an error
+		if (!compInfo.sourceFiles.empty())
+			watchedFiles.insert(compInfo.sourceFiles.begin(), compInfo.sourceFiles.end());
+		watcher.addFiles(watchedFiles);
+		if (watchedFiles.empty())
+			return ret;
+
+		double total = 0.0;
+		std::cout << "[ WATCH ]:";
+		for (auto& [phase, seconds] : compInfo.phaseTimes)
+		{
+			std::cout << " " << phase << ": " << seconds << "s |";
+			total += seconds;
+		}
+		std::cout << " Total: " << total << "s (Exit code: " << ret << ")" << std::endl;
+		std::cout << "[ WATCH ]: Waiting for changes of " << watchedFiles.size() << " files..." << std::endl;
+
+		watcher.waitForChange();
 	}
-	catch (const QinpError& e)
-	{
-		std::cout << "[ ERR ]: QNP: " << e.what() << std::endl;
-		if (verbose)
-			std::cout << "WHERE: " << e.where() << std::endl;
-		return -1;
-	}
-	catch (const std::exception& e)
+}
+
+int main(int argc, char** argv, char** _env)
+{
+	bool verbose = true;
+	try
 	{
-		std::cout << "[ ERR ]: STD: " << e.what() << std::endl;
-		return -1;
+		auto args = parseArgs(getArgs(argc, argv), argNames);
+		auto env = getEnv(_env);
+
+		if (args.hasOption("help"))
+		{
+			std::cout << HELP_TEXT;
+			return 0;
+		}
+
+		verbose = args.hasOption("verbose");
+
+		if (args.hasOption("server"))
+		{
+			enableTokenCache(true);
+			preloadTokenCache(pathToExecutableDir() + "stdlib/");
+
+			return runCompileServer(
+				args.getOption("server").front(),
+				[](const std::vector<std::string>& argsVec, std::string& outFilename)
+				{
+					Args args;
+					try
+					{
+						args = parseArgs(argsVec, argNames);
+					}
+					catch (...)
+					{
+						return printException(false);
+					}
+					CompileInfo compInfo;
+					int ret = compile(args, compInfo);
+					outFilename = compInfo.outFilename;
+					return ret;
+				}
+			);
+		}
+
+		if (args.hasOption("watch"))
+			return watch(args);
+
+		CompileInfo compInfo;
+		int compRet;
+		if (args.hasOption("client"))
+		{
+			// The server never runs the generated program, the client does
+			auto reply = requestCompilation(args.getOption("client").front(), getArgs(argc, argv));
+			std::cout << reply.output;
+			compRet = reply.exitCode;
+			compInfo.outFilename = reply.outFilename;
+		}
+		else
+		{
+			compRet = compile(args, compInfo);
+		}
+
+		if (compRet != 0)
+			return compRet;
+
+		if (args.hasOption("run"))
+			return runProgram(args, compInfo.outFilename);
 	}
 	catch (...)
 	{
-		std::cout << "[ ERR ]: Unknown error!" << std::endl;
-		return -1;
+		return printException(verbose);
 	}
 
-    return runRet;
+	return 0;
 }
@@ -51,7 +51,7 @@ struct Statement
 	std::vector<std::string> asmLines; // Single-/multi-line assembly code
 
 	ExpressionRef subExpr; // Exit/Return
-	int funcRetOffset; // Return
+	int funcRetOffset; // Return (0 if the value is returned in rax)
 
 	std::vector<ConditionalBody> ifConditionalBodies; // If-Clause
 	BodyRef elseBody; // If-Clause
@@ -162,8 +162,9 @@ struct Expression : public Statement
 	} value = {};
 	std::vector<ExpressionRef> paramExpr; // Function call
 	std::vector<TokenListRef> bpExplicitMacros; // Function call
-	int paramSizeSum;
+	int paramSizeSum; // Size of the parameters passed on the stack
 	bool isExtCall = false;
+	bool isRegCall = false; // Function call (see usesRegCallConv)
 
 	SymbolRef symbol;
 
@@ -0,0 +1,357 @@
+#include "StaticLinker.h"
+
+#include <map>
+#include <algorithm>
+
+#include "ElfWriter.h"
+#include "Errors/LinkerError.h"
+
+#define LINK_BASE_ADDRESS 0x400000 // Same as ld
+#define LINK_PAGE_SIZE 0x1000
+
+#define ELF_PT_LOAD 1
+#define ELF_PF_X 0x1
+#define ELF_PF_W 0x2
+#define ELF_PF_R 0x4
+
+enum class OutSection
+{
+	Text,
+	ROData,
+	Data,
+	BSS,
+	Count
+};
+
+struct OutSectionInfo
+{
+	std::string name;
+	std::string data;
+	uint64_t size = 0;
+	uint64_t align = 1;
+	uint64_t addr = 0;
+	uint64_t offset = 0; // File offset
+	int headerIndex = 0; // Index of the section header, 0 if the section is empty
+};
+
+struct LinkerInfo
+{
+	OutSectionInfo sections[(int)OutSection::Count];
+	std::vector<std::vector<uint64_t>> inputAddrs; // [object][section] -> Address of the input section
+	std::map<std::string, uint64_t> globals; // Name -> Address
+};
+
+uint64_t alignUp(uint64_t value, uint64_t align)
+{
+	return (value + align - 1) / align * align;
+}
+
+// Input sections are merged by their name prefix like ld does (.text.foo -> .text), unknown names by their flags
+OutSection getOutSection(const ObjSection& section)
+{
+	auto hasPrefix = [&](const std::string& prefix) { return section.name.compare(0, prefix.size(), prefix) == 0; };
+	if (section.isNoBits || hasPrefix(".bss"))
+		return OutSection::BSS;
+	if (section.isExecutable || hasPrefix(".text"))
+		return OutSection::Text;
+	if (section.isWritable || hasPrefix(".data"))
+		return OutSection::Data;
+	return OutSection::ROData;
+}
+
+uint64_t getSymbolAddress(LinkerInfo& li, const ObjectFile& obj, int objIndex, int symIndex)
+{
+	auto& symbol = obj.symbols[symIndex];
+	if (symbol.section != -1)
+		return li.inputAddrs[objIndex][symbol.section] + symbol.value;
+
+	auto it = li.globals.find(symbol.name);
+	if (it == li.globals.end())
+		THROW_LINKER_ERROR("Undefined reference to '" + symbol.name + "'!");
+	return it->second;
+}
+
+void applyRelocation(LinkerInfo& li, const ObjectFile& obj, int objIndex, const ObjSection& section, const ObjReloc& reloc)
+{
+	auto& out = li.sections[(int)getOutSection(section)];
+	uint64_t place = li.inputAddrs[objIndex][&section - obj.sections.data()] + reloc.offset;
+	uint64_t value = getSymbolAddress(li, obj, objIndex, reloc.symbol) + reloc.addend;
+
+	int size = 4;
+	bool fits = true;
+	switch (reloc.type)
+	{
+	case RelocType::Abs64:
+		size = 8;
+		break;
+	case RelocType::PC32:
+	case RelocType::PLT32:
+		value -= place;
+		fits = (int64_t)value >= INT32_MIN && (int64_t)value <= INT32_MAX;
+		break;
+	case RelocType::Abs32:
+		fits = value <= UINT32_MAX;
+		break;
+	case RelocType::Abs32S:
+		fits = (int64_t)value >= INT32_MIN && (int64_t)value <= INT32_MAX;
+		break;
+	}
+	if (!fits)
+		THROW_LINKER_ERROR("Relocation against '" + obj.symbols[reloc.symbol].name + "' is out of range!");
+
+	uint64_t pos = place - out.addr;
+	for (int i = 0; i < size; ++i)
+		out.data[pos + i] = (char)((value >> (8 * i)) & 0xFF);
+}
+
+// Returns which input sections are reachable from the entry point through relocations, the others are removed like ld --gc-sections does
+std::vector<std::vector<bool>> findLiveSections(const std::vector<ObjectFile>& objects)
+{
+	std::map<std::string, std::pair<int, int>> definitions; // Global name -> Object index, Section index
+	for (uint64_t i = 0; i < objects.size(); ++i)
+		for (auto& symbol : objects[i].symbols)
+			if (symbol.isGlobal && symbol.section != -1)
+				definitions.insert({ symbol.name, { i, symbol.section } });
+
+	auto itEntry = definitions.find("_start");
+	if (itEntry == definitions.end())
+		THROW_LINKER_ERROR("Missing entry point '_start'!");
+
+	std::vector<std::vector<bool>> live;
+	for (auto& obj : objects)
+		live.emplace_back(obj.sections.size(), false);
+
+	std::vector<std::pair<int, int>> pending;
+	auto markLive = [&](std::pair<int, int> section)
+	{
+		if (live[section.first][section.second])
+			return;
+		live[section.first][section.second] = true;
+		pending.push_back(section);
+	};
+	markLive(itEntry->second);
+
+	while (!pending.empty())
+	{
+		auto [objIndex, sectionIndex] = pending.back();
+		pending.pop_back();
+		for (auto& reloc : objects[objIndex].sections[sectionIndex].relocs)
+		{
+			auto& symbol = objects[objIndex].symbols[reloc.symbol];
+			if (symbol.section != -1)
+				markLive({ objIndex, symbol.section });
+			else if (auto it = definitions.find(symbol.name); it != definitions.end())
+				markLive(it->second);
+		}
+	}
+
+	return live;
+}
+
+std::string linkExecutable(const std::vector<ObjectFile>& objects)
+{
+	auto live = findLiveSections(objects);
+
+	LinkerInfo li;
+	li.sections[(int)OutSection::Text].name = ".text";
+	li.sections[(int)OutSection::ROData].name = ".rodata";
+	li.sections[(int)OutSection::Data].name = ".data";
+	li.sections[(int)OutSection::BSS].name = ".bss";
+
+	// Place the input sections inside of the output sections
+	std::vector<std::vector<uint64_t>> inputOffsets;
+	for (uint64_t i = 0; i < objects.size(); ++i)
+	{
+		inputOffsets.emplace_back();
+		for (uint64_t s = 0; s < objects[i].sections.size(); ++s)
+		{
+			auto& section = objects[i].sections[s];
+			if (!live[i][s])
+			{
+				inputOffsets.back().push_back(0);
+				continue;
+			}
+			auto& out = li.sections[(int)getOutSection(section)];
+			out.size = alignUp(out.size, section.align);
+			out.align = std::max(out.align, section.align);
+			inputOffsets.back().push_back(out.size);
+			out.size += section.size;
+		}
+	}
+
+	auto& text = li.sections[(int)OutSection::Text];
+	auto& rodata = li.sections[(int)OutSection::ROData];
+	auto& data = li.sections[(int)OutSection::Data];
+	auto& bss = li.sections[(int)OutSection::BSS];
+
+	// The headers are loaded as part of the text segment. Every following segment starts on a new page,
+	// its file offset only has to match the address modulo the page size.
+	int nSegments = 1 + (rodata.size > 0 ? 1 : 0) + (data.size + bss.size > 0 ? 1 : 0);
+	uint64_t headerSize = ELF_HEADER_SIZE + nSegments * ELF_PROGRAM_HEADER_SIZE;
+	text.offset = alignUp(headerSize, text.align);
+	text.addr = LINK_BASE_ADDRESS + text.offset;
+	uint64_t fileEnd = text.offset + text.size;
+	uint64_t addrEnd = text.addr + text.size;
+	for (auto* pOut : { &rodata, &data })
+	{
+		pOut->offset = alignUp(fileEnd, pOut->align);
+		pOut->addr = alignUp(addrEnd, LINK_PAGE_SIZE) + pOut->offset % LINK_PAGE_SIZE;
+		if (pOut->size > 0 || (pOut == &data && bss.size > 0))
+		{
+			fileEnd = pOut->offset + pOut->size;
+			addrEnd = pOut->addr + pOut->size;
+		}
+	}
+	bss.addr = alignUp(addrEnd, bss.align);
+	bss.offset = fileEnd;
+
+	for (uint64_t i = 0; i < objects.size(); ++i)
+	{
+		li.inputAddrs.emplace_back();
+		for (uint64_t s = 0; s < objects[i].sections.size(); ++s)
+			li.inputAddrs.back().push_back(li.sections[(int)getOutSection(objects[i].sections[s])].addr + inputOffsets[i][s]);
+	}
+
+	for (uint64_t i = 0; i < objects.size(); ++i)
+	{
+		for (auto& symbol : objects[i].symbols)
+		{
+			if (!symbol.isGlobal || symbol.section == -1)
+				continue;
+			if (!li.globals.insert({ symbol.name, li.inputAddrs[i][symbol.section] + symbol.value }).second)
+				THROW_LINKER_ERROR("Multiple definitions of '" + symbol.name + "'!");
+		}
+	}
+
+	auto itEntry = li.globals.find("_start");
+
+	for (auto* pOut : { &text, &rodata, &data })
+		pOut->data.assign(pOut->size, '\0');
+	for (uint64_t i = 0; i < objects.size(); ++i)
+	{
+		for (uint64_t s = 0; s < objects[i].sections.size(); ++s)
+		{
+			auto& section = objects[i].sections[s];
+			if (section.isNoBits || !live[i][s])
+				continue;
+			auto& out = li.sections[(int)getOutSection(section)];
+			uint64_t pos = li.inputAddrs[i][&section - objects[i].sections.data()] - out.addr;
+			std::copy(section.data.begin(), section.data.end(), out.data.begin() + pos);
+		}
+	}
+	for (uint64_t i = 0; i < objects.size(); ++i)
+		for (uint64_t s = 0; s < objects[i].sections.size(); ++s)
+			if (live[i][s])
+				for (auto& reloc : objects[i].sections[s].relocs)
+					applyRelocation(li, objects[i], i, objects[i].sections[s], reloc);
+
+	std::vector<ElfSectionHeader> headers(1);
+	std::string shstrtab(1, '\0');
+	auto addSection = [&](ElfSectionHeader header, const std::string& name)
+	{
+		header.name = addString(shstrtab, name);
+		headers.push_back(header);
+	};
+
+	for (auto* pOut : { &text, &rodata, &data, &bss })
+	{
+		if (pOut->size == 0)
+			continue;
+		ElfSectionHeader header;
+		header.type = pOut == &bss ? ELF_SHT_NOBITS : ELF_SHT_PROGBITS;
+		header.flags = ELF_SHF_ALLOC | (pOut == &text ? ELF_SHF_EXECINSTR : 0) | (pOut == &data || pOut == &bss ? ELF_SHF_WRITE : 0);
+		header.addr = pOut->addr;
+		header.offset = pOut->offset;
+		header.size = pOut->size;
+		header.align = pOut->align;
+		pOut->headerIndex = headers.size();
+		addSection(header, pOut->name);
+	}
+
+	// The symbol table is not needed to run the program, but keeps the output usable with objdump/gdb/perf
+	std::string symtab(ELF_SYMBOL_SIZE, '\0');
+	std::string strtab(1, '\0');
+	int nLocals = 1;
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		for (uint64_t i = 0; i < objects.size(); ++i)
+		{
+			for (auto& symbol : objects[i].symbols)
+			{
+				if (symbol.section == -1 || !live[i][symbol.section] || symbol.isGlobal != (pass == 1))
+					continue;
+				int headerIndex = li.sections[(int)getOutSection(objects[i].sections[symbol.section])].headerIndex;
+				nLocals += pass == 0 ? 1 : 0;
+				writeLE(symtab, addString(strtab, symbol.name), 4);
+				writeLE(symtab, (symbol.isGlobal ? 1 : 0) << 4, 1);
+				writeLE(symtab, 0, 1);
+				writeLE(symtab, headerIndex == 0 ? 0xFFF1 : headerIndex, 2); // SHN_ABS for symbols in empty sections
+				writeLE(symtab, li.inputAddrs[i][symbol.section] + symbol.value, 8);
+				writeLE(symtab, 0, 8);
+			}
+		}
+	}
+
+	uint64_t tableOffset = alignUp(fileEnd, 8);
+	ElfSectionHeader symtabHeader;
+	symtabHeader.type = ELF_SHT_SYMTAB;
+	symtabHeader.offset = tableOffset;
+	symtabHeader.size = symtab.size();
+	symtabHeader.link = headers.size() + 1;
+	symtabHeader.info = nLocals;
+	symtabHeader.align = 8;
+	symtabHeader.entSize = ELF_SYMBOL_SIZE;
+	addSection(symtabHeader, ".symtab");
+
+	ElfSectionHeader strtabHeader;
+	strtabHeader.type = ELF_SHT_STRTAB;
+	strtabHeader.offset = symtabHeader.offset + symtab.size();
+	strtabHeader.size = strtab.size();
+	strtabHeader.align = 1;
+	addSection(strtabHeader, ".strtab");
+
+	ElfSectionHeader shstrtabHeader;
+	shstrtabHeader.type = ELF_SHT_STRTAB;
+	shstrtabHeader.offset = strtabHeader.offset + strtab.size();
+	shstrtabHeader.align = 1;
+	addSection(shstrtabHeader, ".shstrtab");
+	headers.back().size = shstrtab.size();
+
+	uint64_t shOffset = alignUp(headers.back().offset + shstrtab.size(), 8);
+	std::string out;
+	writeElfHeader(out, ELF_TYPE_EXEC, itEntry->second, nSegments, shOffset, headers.size());
+
+	auto writeSegment = [&](uint32_t flags, uint64_t offset, uint64_t addr, uint64_t fileSize, uint64_t memSize)
+	{
+		writeLE(out, ELF_PT_LOAD, 4);
+		writeLE(out, flags, 4);
+		writeLE(out, offset, 8);
+		writeLE(out, addr, 8);
+		writeLE(out, addr, 8); // Physical address
+		writeLE(out, fileSize, 8);
+		writeLE(out, memSize, 8);
+		writeLE(out, LINK_PAGE_SIZE, 8);
+	};
+	writeSegment(ELF_PF_R | ELF_PF_X, 0, LINK_BASE_ADDRESS, text.offset + text.size, text.offset + text.size);
+	if (rodata.size > 0)
+		writeSegment(ELF_PF_R, rodata.offset, rodata.addr, rodata.size, rodata.size);
+	if (data.size + bss.size > 0)
+		writeSegment(ELF_PF_R | ELF_PF_W, data.offset, data.addr, data.size, bss.addr + bss.size - data.addr);
+
+	for (auto* pOut : { &text, &rodata, &data })
+	{
+		if (pOut->size == 0)
+			continue;
+		out.resize(pOut->offset, '\0');
+		out += pOut->data;
+	}
+	out.resize(tableOffset, '\0');
+	out += symtab;
+	out += strtab;
+	out += shstrtab;
+	out.resize(shOffset, '\0');
+	for (auto& header : headers)
+		writeSectionHeader(out, header);
+
+	return out;
+}
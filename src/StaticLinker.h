@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "ObjectFile.h"
+
+// Links the objects into a static x86-64 ELF executable starting at '_start' and returns the file contents.
+// The input sections are merged into .text (R-X), .rodata (R--), .data and .bss (RW-), dynamic linking is not supported.
+// Sections that are not reachable from '_start' through relocations are removed (like ld --gc-sections).
+// Throws a LinkerError for undefined/duplicate symbols and relocations that are out of range.
+std::string linkExecutable(const std::vector<ObjectFile>& objects);
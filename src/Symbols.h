@@ -53,6 +53,7 @@ struct Symbol
 		int offset = -1;
 		Datatype datatype;
 		int id = 0;
+		ExpressionRef staticInit; // Literal placed in the data section instead of initializing the variable at runtime (Global/Static only)
 
 		enum class Context
 		{
@@ -69,6 +70,7 @@ struct Symbol
 	{
 		Datatype retType;
 		int retOffset = 16; // Stack pointer + return address (2x 8 bytes)
+		bool isRegCall = false; // Uses the register calling convention (see usesRegCallConv)
 		std::vector<SymbolRef> params;
 		BodyRef body;
 		bool isReachable = false;
@@ -83,6 +85,8 @@ struct Symbol
 		bool genFromBlueprint = false;
 		TokenListRef blueprintTokens;
 		bool isNoDiscard = false;
+		bool isInline = false; // Inlined up to a larger size limit
+		bool isNoInline = false; // Never inlined
 	} func;
 
 	struct Frame
@@ -111,6 +115,8 @@ struct Symbol
 
 	SymbolRef aliasedSymbol;
 
+	std::string mangledName; // Set by cacheMangledNames
+
 public:
 	SymbolIterator begin();
 	SymbolIterator end();
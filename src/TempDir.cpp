@@ -0,0 +1,71 @@
+#include "TempDir.h"
+
+#include <vector>
+#include <cstdlib>
+
+#include "Errors/QinpError.h"
+
+#if defined QINP_PLATFORM_UNIX
+
+#include <unistd.h>
+
+TempDir::TempDir()
+{
+	std::vector<std::string> candidates;
+	if (auto runtimeDir = getenv("XDG_RUNTIME_DIR"))
+		candidates.push_back(runtimeDir);
+	candidates.push_back("/dev/shm");
+	std::error_code ec;
+	candidates.push_back(std::filesystem::temp_directory_path(ec).string());
+
+	for (auto& base : candidates)
+	{
+		if (base.empty() || access(base.c_str(), W_OK | X_OK) != 0)
+			continue;
+
+		// mkdtemp creates the directory with mode 0700
+		std::string templ = base + "/qinp-XXXXXX";
+		if (mkdtemp(templ.data()))
+		{
+			m_path = templ;
+			return;
+		}
+	}
+
+	THROW_QINP_ERROR("Unable to create a temporary directory!");
+}
+
+#elif defined QINP_PLATFORM_WINDOWS
+
+#include <windows.h>
+
+TempDir::TempDir()
+{
+	auto base = std::filesystem::temp_directory_path();
+	auto prefix = "qinp-" + std::to_string(GetCurrentProcessId()) + "-";
+	for (int i = 0; i < 100; ++i)
+	{
+		std::error_code ec;
+		auto path = base / (prefix + std::to_string(GetTickCount64() + i));
+		if (std::filesystem::create_directory(path, ec))
+		{
+			m_path = path;
+			return;
+		}
+	}
+
+	THROW_QINP_ERROR("Unable to create a temporary directory!");
+}
+
+#endif
+
+TempDir::~TempDir()
+{
+	std::error_code ec;
+	std::filesystem::remove_all(m_path, ec);
+}
+
+std::string TempDir::getPath(const std::string& filename) const
+{
+	return (m_path / filename).string();
+}
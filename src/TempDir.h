@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+#include <filesystem>
+
+// Private directory for intermediate files, removed together with its contents on destruction.
+// Prefers a tmpfs ($XDG_RUNTIME_DIR, /dev/shm) so the intermediates never hit the disk.
+// Every instance gets its own directory, so concurrent compilations of the same source don't interfere.
+class TempDir
+{
+public:
+	TempDir();
+	~TempDir();
+	TempDir(const TempDir&) = delete;
+	TempDir& operator=(const TempDir&) = delete;
+
+	std::string getPath(const std::string& filename) const;
+private:
+	std::filesystem::path m_path;
+};
@@ -181,8 +181,10 @@ bool isKeyword(const std::string& name)
 		"fn",
 		"if",
 		"import",
+		"inline",
 		"lambda",
 		"nodiscard",
+		"noinline",
 		"null",
 		"pack",
 		"pass",
@@ -0,0 +1,133 @@
+#include "TokenCache.h"
+
+#include <map>
+#include <filesystem>
+
+#include "Tokenizer.h"
+
+struct CachedFile
+{
+	std::filesystem::file_time_type lastWriteTime;
+	uintmax_t fileSize;
+	std::string name; // The name the tokens were generated with
+	TokenList tokens;
+	std::map<int, std::string> comments;
+};
+
+static bool tokenCacheEnabled = false;
+static std::map<std::string, CachedFile> tokenCache; // Absolute path -> Cached file
+
+std::string getCacheKey(const std::string& path)
+{
+	return std::filesystem::absolute(path).lexically_normal().string();
+}
+
+bool getFileStamp(const std::string& path, std::filesystem::file_time_type& lastWriteTime, uintmax_t& fileSize)
+{
+	std::error_code ec;
+	lastWriteTime = std::filesystem::last_write_time(path, ec);
+	if (ec)
+		return false;
+	fileSize = std::filesystem::file_size(path, ec);
+	return !ec;
+}
+
+CachedFile& loadCachedFile(const std::string& key, const std::string& name)
+{
+	CachedFile file;
+	if (!getFileStamp(key, file.lastWriteTime, file.fileSize))
+		file.lastWriteTime = {};
+
+	auto comments = std::make_shared<CommentTokenMap>();
+	file.tokens = std::move(*tokenize(readTextFile(key), name, comments));
+	file.name = name;
+	auto it = comments->find(name);
+	if (it != comments->end())
+		file.comments = std::move(it->second);
+
+	return tokenCache[key] = std::move(file);
+}
+
+bool isUpToDate(const std::string& key, const CachedFile& file)
+{
+	std::filesystem::file_time_type lastWriteTime;
+	uintmax_t fileSize;
+	if (!getFileStamp(key, lastWriteTime, fileSize))
+		return false;
+	return lastWriteTime == file.lastWriteTime && fileSize == file.fileSize;
+}
+
+void enableTokenCache(bool enable)
+{
+	tokenCacheEnabled = enable;
+	if (!enable)
+		tokenCache.clear();
+}
+
+TokenListRef tokenizeFile(const std::string& path, const std::string& name, CommentTokenMapRef comments)
+{
+	if (!tokenCacheEnabled)
+		return tokenize(readTextFile(path), name, comments);
+
+	auto key = getCacheKey(path);
+	auto it = tokenCache.find(key);
+
+	const CachedFile& file = (it != tokenCache.end() && isUpToDate(key, it->second))
+		? it->second
+		: loadCachedFile(key, name);
+
+	// The tokens get modified while parsing, the cached ones must stay untouched
+	auto tokens = std::make_shared<TokenList>(file.tokens);
+	if (file.name != name)
+		for (auto& token : *tokens)
+			token.pos.file = name;
+
+	if (!file.comments.empty())
+		(*comments)[name].insert(file.comments.begin(), file.comments.end());
+
+	return tokens;
+}
+
+void preloadTokenCache(const std::string& dir)
+{
+	std::error_code ec;
+	for (auto& entry : std::filesystem::recursive_directory_iterator(dir, ec))
+	{
+		if (!entry.is_regular_file() || entry.path().extension() != ".qnp")
+			continue;
+
+		auto key = getCacheKey(entry.path().string());
+		try
+		{
+			loadCachedFile(key, key);
+		}
+		catch (...)
+		{
+			// Files that cannot be tokenized are reported when they get imported
+			tokenCache.erase(key);
+		}
+	}
+}
+
+void refreshTokenCache()
+{
+	for (auto it = tokenCache.begin(); it != tokenCache.end();)
+	{
+		auto& [key, file] = *it;
+		if (isUpToDate(key, file))
+		{
+			++it;
+			continue;
+		}
+
+		try
+		{
+			loadCachedFile(key, file.name);
+			++it;
+		}
+		catch (...)
+		{
+			it = tokenCache.erase(it);
+		}
+	}
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+
+#include "Token.h"
+
+// Enables/Disables reusing tokenized files across multiple compilations within the same process.
+void enableTokenCache(bool enable);
+
+// Tokenizes the specified file. When the cache is enabled and the file did not change
+// (modification time and size) since it was last tokenized, a copy of the cached tokens is returned.
+TokenListRef tokenizeFile(const std::string& path, const std::string& name, CommentTokenMapRef comments);
+
+// Tokenizes all source files located in the specified directory (recursively) into the cache.
+void preloadTokenCache(const std::string& dir);
+
+// Re-tokenizes all cached files that changed on disk and drops the ones that no longer exist.
+void refreshTokenCache();
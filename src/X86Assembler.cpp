@@ -0,0 +1,1304 @@
+#include "X86Assembler.h"
+
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <cctype>
+
+#include "Errors/AssemblerError.h"
+
+struct X86Reg
+{
+	int num = -1; // 0-15
+	int size = 0; // 1, 2, 4, 8 or 16 (xmm)
+	bool isHighByte = false; // ah, ch, dh, bh (not encodable with a REX prefix)
+	bool needsRex = false; // spl, bpl, sil, dil
+};
+
+struct Operand
+{
+	enum class Type
+	{
+		Reg,
+		Imm,
+		Mem,
+	} type = Type::Imm;
+	int size = 0; // Size in bytes (registers, size specifiers), 0 if unknown
+	X86Reg reg;
+	int64_t value = 0; // Immediate value or displacement
+	std::string symbol; // Label added to the immediate value/displacement
+	int base = -1;
+	int index = -1;
+	int scale = 1;
+};
+
+struct Fixup
+{
+	uint64_t offset = 0; // Offset of the field relative to the start of the encoding
+	RelocType type = RelocType::Abs64;
+	std::string symbol;
+	int64_t addend = 0;
+};
+
+struct Encoding
+{
+	std::vector<uint8_t> bytes;
+	std::vector<Fixup> fixups;
+};
+
+// Instruction, label or data definition of a section
+struct AsmItem
+{
+	enum class Type
+	{
+		Bytes,
+		Branch, // jmp/jcc/call to a label, the size depends on the distance to the target
+		Label,
+		Reserve, // resb, ...
+		Align,
+	} type = Type::Bytes;
+	int line = 0;
+	Encoding enc;
+	std::string name; // Label name/branch target
+	int cond = -1; // Condition code of conditional jumps, -1 for jmp/call
+	bool isCall = false;
+	bool isLong = false;
+	uint64_t size = 0; // Reserve: Number of bytes, Align: Alignment
+	uint64_t offset = 0;
+};
+
+struct AsmSection
+{
+	std::string name;
+	uint64_t align = 1;
+	bool isWritable = false;
+	bool isExecutable = false;
+	bool isNoBits = false;
+	std::vector<AsmItem> items;
+};
+
+struct AssemblerInfo
+{
+	std::vector<AsmSection> sections;
+	int currSection = -1;
+	int line = 0;
+	std::string lastLabel; // Base of local labels (starting with '.')
+	std::set<std::string> globals;
+	std::set<std::string> externs;
+};
+
+static const std::unordered_map<std::string, X86Reg> x86Regs = []()
+{
+	std::unordered_map<std::string, X86Reg> regs;
+	const char* names64[] = { "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi" };
+	const char* names32[] = { "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi" };
+	const char* names16[] = { "ax", "cx", "dx", "bx", "sp", "bp", "si", "di" };
+	const char* names8[] = { "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil" };
+	const char* namesHigh[] = { "ah", "ch", "dh", "bh" };
+	for (int i = 0; i < 8; ++i)
+	{
+		regs[names64[i]] = { i, 8 };
+		regs[names32[i]] = { i, 4 };
+		regs[names16[i]] = { i, 2 };
+		regs[names8[i]] = { i, 1, false, i >= 4 };
+		if (i < 4)
+			regs[namesHigh[i]] = { i + 4, 1, true };
+	}
+	for (int i = 8; i < 16; ++i)
+	{
+		auto name = "r" + std::to_string(i);
+		regs[name] = { i, 8 };
+		regs[name + "d"] = { i, 4 };
+		regs[name + "w"] = { i, 2 };
+		regs[name + "b"] = { i, 1 };
+	}
+	for (int i = 0; i < 16; ++i)
+		regs["xmm" + std::to_string(i)] = { i, 16 };
+	return regs;
+}();
+
+static const std::unordered_map<std::string, int> condCodes = {
+	{ "o", 0 }, { "no", 1 }, { "b", 2 }, { "c", 2 }, { "nae", 2 }, { "ae", 3 }, { "nb", 3 }, { "nc", 3 },
+	{ "e", 4 }, { "z", 4 }, { "ne", 5 }, { "nz", 5 }, { "be", 6 }, { "na", 6 }, { "a", 7 }, { "nbe", 7 },
+	{ "s", 8 }, { "ns", 9 }, { "p", 10 }, { "pe", 10 }, { "np", 11 }, { "po", 11 },
+	{ "l", 12 }, { "nge", 12 }, { "ge", 13 }, { "nl", 13 }, { "le", 14 }, { "ng", 14 }, { "g", 15 }, { "nle", 15 },
+};
+
+static const std::unordered_map<std::string, int> sizeSpecs = {
+	{ "byte", 1 }, { "word", 2 }, { "dword", 4 }, { "qword", 8 }, { "oword", 16 },
+};
+
+std::string trim(const std::string& str)
+{
+	auto begin = str.find_first_not_of(" \t\r");
+	if (begin == std::string::npos)
+		return "";
+	auto end = str.find_last_not_of(" \t\r");
+	return str.substr(begin, end - begin + 1);
+}
+
+std::string toLower(std::string str)
+{
+	for (auto& c : str)
+		c = tolower(c);
+	return str;
+}
+
+bool isIdentChar(char c)
+{
+	return isalnum(c) || c == '_' || c == '.' || c == '$' || c == '#' || c == '@' || c == '~' || c == '?';
+}
+
+bool fitsInt8(int64_t value)
+{
+	return value >= INT8_MIN && value <= INT8_MAX;
+}
+
+bool fitsInt32(int64_t value)
+{
+	return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+// Splits at commas that are not part of a memory operand or string
+std::vector<std::string> splitArgs(const std::string& str)
+{
+	std::vector<std::string> operands;
+	std::string curr;
+	int depth = 0;
+	char quote = 0;
+	for (char c : str)
+	{
+		if (quote)
+		{
+			if (c == quote)
+				quote = 0;
+		}
+		else if (c == '"' || c == '\'' || c == '`')
+			quote = c;
+		else if (c == '[')
+			++depth;
+		else if (c == ']')
+			--depth;
+		else if (c == ',' && depth == 0)
+		{
+			operands.push_back(trim(curr));
+			curr.clear();
+			continue;
+		}
+		curr += c;
+	}
+	if (!trim(curr).empty() || !operands.empty())
+		operands.push_back(trim(curr));
+	return operands;
+}
+
+bool parseNumber(const std::string& str, int64_t& value)
+{
+	if (str.empty())
+		return false;
+
+	if (str.size() >= 3 && (str[0] == '\'' || str[0] == '"' || str[0] == '`') && str.back() == str[0])
+	{
+		value = 0;
+		for (int i = str.size() - 2; i >= 1; --i)
+			value = (value << 8) | (uint8_t)str[i];
+		return str.size() <= 10;
+	}
+
+	if (!isdigit(str[0]))
+		return false;
+
+	std::string digits = str;
+	int base = 10;
+	if (digits.size() > 2 && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X'))
+		base = 16, digits = digits.substr(2);
+	else if (digits.size() > 2 && digits[0] == '0' && (digits[1] == 'b' || digits[1] == 'B'))
+		base = 2, digits = digits.substr(2);
+	else if (digits.size() > 2 && digits[0] == '0' && (digits[1] == 'o' || digits[1] == 'O'))
+		base = 8, digits = digits.substr(2);
+	else if (digits.back() == 'h' || digits.back() == 'H')
+		base = 16, digits.pop_back();
+
+	uint64_t result = 0;
+	for (char c : digits)
+	{
+		if (c == '_')
+			continue;
+		int digit = isdigit(c) ? c - '0' : (isxdigit(c) ? tolower(c) - 'a' + 10 : base);
+		if (digit >= base)
+			return false;
+		result = result * base + digit;
+	}
+	value = (int64_t)result;
+	return true;
+}
+
+// Local labels (starting with a single '.') belong to the last non-local label
+std::string resolveLabel(AssemblerInfo& ai, std::string name)
+{
+	if (!name.empty() && name[0] == '$')
+		name = name.substr(1);
+	if (name.size() > 1 && name[0] == '.' && name[1] != '.')
+		return ai.lastLabel + name;
+	return name;
+}
+
+bool isRegName(const std::string& name, X86Reg& reg)
+{
+	auto it = x86Regs.find(toLower(name));
+	if (it == x86Regs.end())
+		return false;
+	reg = it->second;
+	return true;
+}
+
+// Parses '[+-] term [+-] term ...' where a term is a number, label, register or 'register * scale'
+void parseExpression(AssemblerInfo& ai, const std::string& str, Operand& op, bool isAddress)
+{
+	uint64_t i = 0;
+	bool hasTerm = false;
+	while (i < str.size())
+	{
+		int sign = 1;
+		while (i < str.size() && (str[i] == ' ' || str[i] == '+' || str[i] == '-'))
+		{
+			if (str[i] == '-')
+				sign = -sign;
+			++i;
+		}
+		if (i >= str.size())
+			break;
+
+		uint64_t begin = i;
+		char quote = 0;
+		while (i < str.size() && (quote || (str[i] != '+' && str[i] != '-')))
+		{
+			if (quote && str[i] == quote)
+				quote = 0;
+			else if (!quote && (str[i] == '\'' || str[i] == '"' || str[i] == '`'))
+				quote = str[i];
+			++i;
+		}
+		auto term = trim(str.substr(begin, i - begin));
+		hasTerm = true;
+
+		std::vector<std::string> factors;
+		uint64_t start = 0;
+		for (uint64_t j = 0; j <= term.size(); ++j)
+		{
+			if (j == term.size() || term[j] == '*')
+			{
+				factors.push_back(trim(term.substr(start, j - start)));
+				start = j + 1;
+			}
+		}
+
+		X86Reg reg;
+		int64_t number = 0;
+		int64_t product = 1;
+		int nRegs = 0;
+		for (auto& factor : factors)
+		{
+			if (isRegName(factor, reg))
+				++nRegs;
+			else if (parseNumber(factor, number))
+				product *= number;
+			else if (factors.size() == 1 && !factor.empty() && !isdigit(factor[0]) && isIdentChar(factor[0]))
+			{
+				for (char c : factor)
+					if (!isIdentChar(c))
+						THROW_ASSEMBLER_ERROR(ai.line, "Invalid character in label '" + factor + "'!");
+				if (!op.symbol.empty() || sign < 0)
+					THROW_ASSEMBLER_ERROR(ai.line, "Unsupported expression '" + str + "'!");
+				op.symbol = resolveLabel(ai, factor);
+				product = 0;
+			}
+			else
+				THROW_ASSEMBLER_ERROR(ai.line, "Unsupported expression '" + str + "'!");
+		}
+
+		if (nRegs == 0)
+		{
+			op.value += sign * product;
+			continue;
+		}
+
+		if (!isAddress || nRegs > 1 || sign < 0 || reg.size != 8)
+			THROW_ASSEMBLER_ERROR(ai.line, "Unsupported expression '" + str + "'!");
+		if (factors.size() == 1 && op.base == -1)
+			op.base = reg.num;
+		else if (op.index == -1)
+			op.index = reg.num, op.scale = product;
+		else
+			THROW_ASSEMBLER_ERROR(ai.line, "Too many registers in '" + str + "'!");
+	}
+
+	if (!hasTerm)
+		THROW_ASSEMBLER_ERROR(ai.line, "Missing expression!");
+}
+
+Operand parseOperand(AssemblerInfo& ai, std::string str)
+{
+	Operand op;
+
+	// Size specifier/jump distance
+	auto space = str.find(' ');
+	if (space != std::string::npos)
+	{
+		auto word = toLower(str.substr(0, space));
+		auto it = sizeSpecs.find(word);
+		if (it != sizeSpecs.end())
+		{
+			op.size = it->second;
+			str = trim(str.substr(space));
+		}
+		else if (word == "short" || word == "near")
+		{
+			str = trim(str.substr(space));
+		}
+	}
+
+	if (!str.empty() && str[0] == '[')
+	{
+		if (str.back() != ']')
+			THROW_ASSEMBLER_ERROR(ai.line, "Invalid memory operand '" + str + "'!");
+		auto inner = trim(str.substr(1, str.size() - 2));
+		auto lower = toLower(inner);
+		if (lower.find("rel ") == 0 || lower.find("abs ") == 0)
+			inner = trim(inner.substr(4));
+		if (inner.find(':') != std::string::npos)
+			THROW_ASSEMBLER_ERROR(ai.line, "Segment overrides are not supported!");
+
+		op.type = Operand::Type::Mem;
+		parseExpression(ai, inner, op, true);
+
+		if (op.scale != 1 && op.scale != 2 && op.scale != 4 && op.scale != 8)
+			THROW_ASSEMBLER_ERROR(ai.line, "Invalid scale in '" + str + "'!");
+		if (op.index == 4)
+		{
+			// rsp cannot be an index register
+			if (op.scale != 1 || op.base == 4)
+				THROW_ASSEMBLER_ERROR(ai.line, "rsp cannot be used as an index register!");
+			std::swap(op.base, op.index);
+		}
+		return op;
+	}
+
+	if (isRegName(str, op.reg))
+	{
+		if (op.size != 0 && op.size != op.reg.size)
+			THROW_ASSEMBLER_ERROR(ai.line, "Size specifier does not match register '" + str + "'!");
+		op.type = Operand::Type::Reg;
+		op.size = op.reg.size;
+		return op;
+	}
+
+	op.type = Operand::Type::Imm;
+	parseExpression(ai, str, op, false);
+	return op;
+}
+
+void emitInt(Encoding& enc, uint64_t value, int size)
+{
+	for (int i = 0; i < size; ++i)
+		enc.bytes.push_back((value >> (8 * i)) & 0xFF);
+}
+
+// Immediates of 32 bit operand size may be signed or unsigned, sign-extended ones must be signed
+void emitImm(AssemblerInfo& ai, Encoding& enc, const Operand& imm, int size, bool isSignExtended = false)
+{
+	if (!imm.symbol.empty())
+	{
+		if (size != 4 && size != 8)
+			THROW_ASSEMBLER_ERROR(ai.line, "Labels need a 32 or 64 bit field!");
+		RelocType type = size == 8 ? RelocType::Abs64 : (isSignExtended ? RelocType::Abs32S : RelocType::Abs32);
+		enc.fixups.push_back({ enc.bytes.size(), type, imm.symbol, imm.value });
+		emitInt(enc, 0, size);
+		return;
+	}
+
+	bool fits = true;
+	switch (size)
+	{
+	case 1: fits = imm.value >= INT8_MIN && imm.value <= UINT8_MAX; break;
+	case 2: fits = imm.value >= INT16_MIN && imm.value <= UINT16_MAX; break;
+	case 4: fits = isSignExtended ? fitsInt32(imm.value) : (imm.value >= INT32_MIN && imm.value <= UINT32_MAX); break;
+	default: break;
+	}
+	if (!fits)
+		THROW_ASSEMBLER_ERROR(ai.line, "Immediate value " + std::to_string(imm.value) + " does not fit into " + std::to_string(size) + " byte(s)!");
+	emitInt(enc, imm.value, size);
+}
+
+// Encodes [prefix] [66] [REX] opcode ModRM [SIB] [displacement].
+// The reg field is either the register 'pReg' or the opcode extension 'digit'.
+void encodeModRM(AssemblerInfo& ai, Encoding& enc, int opSize, const std::vector<uint8_t>& opcode, const X86Reg* pReg, int digit, const Operand& rm, uint8_t prefix = 0)
+{
+	if (prefix)
+		enc.bytes.push_back(prefix);
+	if (opSize == 2)
+		enc.bytes.push_back(0x66);
+
+	int regNum = pReg ? pReg->num : digit;
+	uint8_t rex = 0;
+	if (opSize == 8)
+		rex |= 0x08;
+	if (regNum >= 8)
+		rex |= 0x04;
+	if (rm.type == Operand::Type::Reg && rm.reg.num >= 8)
+		rex |= 0x01;
+	if (rm.type == Operand::Type::Mem && rm.index >= 8)
+		rex |= 0x02;
+	if (rm.type == Operand::Type::Mem && rm.base >= 8)
+		rex |= 0x01;
+
+	bool rmIsReg = rm.type == Operand::Type::Reg;
+	bool needsRex = (pReg && pReg->needsRex) || (rmIsReg && rm.reg.needsRex);
+	bool hasHighByte = (pReg && pReg->isHighByte) || (rmIsReg && rm.reg.isHighByte);
+	if (rex || needsRex)
+	{
+		if (hasHighByte)
+			THROW_ASSEMBLER_ERROR(ai.line, "High byte registers cannot be used with a REX prefix!");
+		enc.bytes.push_back(0x40 | rex);
+	}
+	enc.bytes.insert(enc.bytes.end(), opcode.begin(), opcode.end());
+
+	uint8_t reg3 = (regNum & 7) << 3;
+	if (rmIsReg)
+	{
+		enc.bytes.push_back(0xC0 | reg3 | (rm.reg.num & 7));
+		return;
+	}
+
+	static const uint8_t scaleBits[] = { 0, 0, 1, 0, 2, 0, 0, 0, 3 };
+	auto emitDisp32 = [&](RelocType type)
+	{
+		if (!rm.symbol.empty())
+		{
+			enc.fixups.push_back({ enc.bytes.size(), type, rm.symbol, rm.value });
+			emitInt(enc, 0, 4);
+			return;
+		}
+		if (!fitsInt32(rm.value))
+			THROW_ASSEMBLER_ERROR(ai.line, "Displacement does not fit into 32 bits!");
+		emitInt(enc, rm.value, 4);
+	};
+
+	if (rm.base == -1 && rm.index == -1)
+	{
+		// Labels are addressed relative to rip, plain numbers absolute
+		if (!rm.symbol.empty())
+		{
+			enc.bytes.push_back(0x05 | reg3);
+			emitDisp32(RelocType::PC32);
+		}
+		else
+		{
+			enc.bytes.push_back(0x04 | reg3);
+			enc.bytes.push_back(0x25);
+			emitDisp32(RelocType::Abs32S);
+		}
+		return;
+	}
+
+	if (rm.base == -1)
+	{
+		enc.bytes.push_back(0x04 | reg3);
+		enc.bytes.push_back((scaleBits[rm.scale] << 6) | ((rm.index & 7) << 3) | 5);
+		emitDisp32(RelocType::Abs32S);
+		return;
+	}
+
+	int mod = 2;
+	if (rm.symbol.empty() && rm.value == 0 && (rm.base & 7) != 5)
+		mod = 0;
+	else if (rm.symbol.empty() && fitsInt8(rm.value))
+		mod = 1;
+
+	bool needsSib = rm.index != -1 || (rm.base & 7) == 4;
+	enc.bytes.push_back((mod << 6) | reg3 | (needsSib ? 4 : (rm.base & 7)));
+	if (needsSib)
+		enc.bytes.push_back((scaleBits[rm.scale] << 6) | ((rm.index == -1 ? 4 : rm.index & 7) << 3) | (rm.base & 7));
+	if (mod == 1)
+		emitInt(enc, rm.value, 1);
+	else if (mod == 2)
+		emitDisp32(RelocType::Abs32S);
+}
+
+// Encodes the register in the low bits of the opcode ([66] [REX] opcode+reg)
+void encodeOpcodeReg(AssemblerInfo& ai, Encoding& enc, int opSize, uint8_t opcode, const X86Reg& reg)
+{
+	if (opSize == 2)
+		enc.bytes.push_back(0x66);
+	uint8_t rex = (opSize == 8 ? 0x08 : 0) | (reg.num >= 8 ? 0x01 : 0);
+	if (rex || reg.needsRex)
+	{
+		if (reg.isHighByte)
+			THROW_ASSEMBLER_ERROR(ai.line, "High byte registers cannot be used with a REX prefix!");
+		enc.bytes.push_back(0x40 | rex);
+	}
+	enc.bytes.push_back(opcode + (reg.num & 7));
+}
+
+bool isReg(const Operand& op) { return op.type == Operand::Type::Reg && op.reg.size <= 8; }
+bool isXmm(const Operand& op) { return op.type == Operand::Type::Reg && op.reg.size == 16; }
+bool isMem(const Operand& op) { return op.type == Operand::Type::Mem; }
+bool isImm(const Operand& op) { return op.type == Operand::Type::Imm; }
+bool isRM(const Operand& op) { return isReg(op) || isMem(op); }
+
+// Returns the operand size of the instruction, taken from the register operands or the size specifiers
+int getOpSize(AssemblerInfo& ai, const std::vector<Operand>& ops)
+{
+	int size = 0;
+	for (auto& op : ops)
+	{
+		if (op.type == Operand::Type::Imm || op.size == 0)
+			continue;
+		if (size != 0 && size != op.size)
+			THROW_ASSEMBLER_ERROR(ai.line, "Mismatching operand sizes!");
+		size = op.size;
+	}
+	if (size == 0)
+		THROW_ASSEMBLER_ERROR(ai.line, "Operation size not specified!");
+	return size;
+}
+
+void expectOperands(AssemblerInfo& ai, const std::string& mnemonic, const std::vector<Operand>& ops, uint64_t count)
+{
+	if (ops.size() != count)
+		THROW_ASSEMBLER_ERROR(ai.line, "'" + mnemonic + "' expects " + std::to_string(count) + " operand(s)!");
+}
+
+[[noreturn]] void throwInvalidOperands(AssemblerInfo& ai, const std::string& mnemonic)
+{
+	THROW_ASSEMBLER_ERROR(ai.line, "Invalid/unsupported operands for '" + mnemonic + "'!");
+}
+
+// add, or, adc, sbb, and, sub, xor, cmp
+void encodeArithmetic(AssemblerInfo& ai, Encoding& enc, const std::string& mnemonic, int digit, const std::vector<Operand>& ops)
+{
+	expectOperands(ai, mnemonic, ops, 2);
+	int size = getOpSize(ai, ops);
+	uint8_t base = digit * 8 + (size == 1 ? 0 : 1);
+	bool isImm8 = ops[1].symbol.empty() && fitsInt8(ops[1].value);
+	if (isReg(ops[0]) && ops[0].reg.num == 0 && isImm(ops[1]) && (size == 1 || !isImm8))
+	{
+		// Short form for al/ax/eax/rax
+		encodeOpcodeReg(ai, enc, size, base + 4, ops[0].reg);
+		emitImm(ai, enc, ops[1], std::min(size, 4), size == 8);
+	}
+	else if (isRM(ops[0]) && isImm(ops[1]))
+	{
+		if (size == 1)
+		{
+			encodeModRM(ai, enc, size, { 0x80 }, nullptr, digit, ops[0]);
+			emitImm(ai, enc, ops[1], 1);
+		}
+		else if (isImm8)
+		{
+			encodeModRM(ai, enc, size, { 0x83 }, nullptr, digit, ops[0]);
+			emitImm(ai, enc, ops[1], 1);
+		}
+		else
+		{
+			encodeModRM(ai, enc, size, { 0x81 }, nullptr, digit, ops[0]);
+			emitImm(ai, enc, ops[1], size == 2 ? 2 : 4, size == 8);
+		}
+	}
+	else if (isRM(ops[0]) && isReg(ops[1]))
+		encodeModRM(ai, enc, size, { base }, &ops[1].reg, 0, ops[0]);
+	else if (isReg(ops[0]) && isMem(ops[1]))
+		encodeModRM(ai, enc, size, { (uint8_t)(base + 2) }, &ops[0].reg, 0, ops[1]);
+	else
+		throwInvalidOperands(ai, mnemonic);
+}
+
+void encodeMov(AssemblerInfo& ai, Encoding& enc, const std::vector<Operand>& ops)
+{
+	expectOperands(ai, "mov", ops, 2);
+	int size = getOpSize(ai, ops);
+	if (isRM(ops[0]) && isReg(ops[1]))
+		encodeModRM(ai, enc, size, { (uint8_t)(size == 1 ? 0x88 : 0x89) }, &ops[1].reg, 0, ops[0]);
+	else if (isReg(ops[0]) && isMem(ops[1]))
+		encodeModRM(ai, enc, size, { (uint8_t)(size == 1 ? 0x8A : 0x8B) }, &ops[0].reg, 0, ops[1]);
+	else if (isReg(ops[0]) && isImm(ops[1]))
+	{
+		auto& imm = ops[1];
+		if (size == 8 && imm.symbol.empty() && imm.value >= 0 && imm.value <= UINT32_MAX)
+		{
+			// Writing the lower half clears the upper one
+			encodeOpcodeReg(ai, enc, 4, 0xB8, ops[0].reg);
+			emitImm(ai, enc, imm, 4);
+		}
+		else if (size == 8 && imm.symbol.empty() && fitsInt32(imm.value))
+		{
+			encodeModRM(ai, enc, 8, { 0xC7 }, nullptr, 0, ops[0]);
+			emitImm(ai, enc, imm, 4, true);
+		}
+		else
+		{
+			encodeOpcodeReg(ai, enc, size, size == 1 ? 0xB0 : 0xB8, ops[0].reg);
+			emitImm(ai, enc, imm, size);
+		}
+	}
+	else if (isMem(ops[0]) && isImm(ops[1]))
+	{
+		encodeModRM(ai, enc, size, { (uint8_t)(size == 1 ? 0xC6 : 0xC7) }, nullptr, 0, ops[0]);
+		emitImm(ai, enc, ops[1], std::min(size, 4), size == 8);
+	}
+	else
+		throwInvalidOperands(ai, "mov");
+}
+
+// movzx, movsx, movsxd
+void encodeMovExtend(AssemblerInfo& ai, Encoding& enc, const std::string& mnemonic, const std::vector<Operand>& ops)
+{
+	expectOperands(ai, mnemonic, ops, 2);
+	if (!isReg(ops[0]) || !isRM(ops[1]) || ops[1].size == 0)
+		throwInvalidOperands(ai, mnemonic);
+
+	int destSize = ops[0].size;
+	int srcSize = ops[1].size;
+	// nasm accepts movsx for 32 bit sources too
+	if (mnemonic == "movsxd" || (mnemonic == "movsx" && srcSize == 4))
+	{
+		if (destSize != 8 || srcSize != 4)
+			throwInvalidOperands(ai, mnemonic);
+		encodeModRM(ai, enc, 8, { 0x63 }, &ops[0].reg, 0, ops[1]);
+		return;
+	}
+
+	if (srcSize >= destSize || srcSize > 2)
+		throwInvalidOperands(ai, mnemonic);
+	uint8_t opcode = (mnemonic == "movzx" ? 0xB6 : 0xBE) + (srcSize == 2 ? 1 : 0);
+	encodeModRM(ai, enc, destSize, { 0x0F, opcode }, &ops[0].reg, 0, ops[1]);
+}
+
+// inc, dec, not, neg, mul, imul, div, idiv
+void encodeUnary(AssemblerInfo& ai, Encoding& enc, const std::string& mnemonic, int digit, const std::vector<Operand>& ops)
+{
+	expectOperands(ai, mnemonic, ops, 1);
+	if (!isRM(ops[0]))
+		throwInvalidOperands(ai, mnemonic);
+	int size = getOpSize(ai, ops);
+	bool isIncDec = mnemonic == "inc" || mnemonic == "dec";
+	uint8_t opcode = (isIncDec ? 0xFE : 0xF6) + (size == 1 ? 0 : 1);
+	encodeModRM(ai, enc, size, { opcode }, nullptr, digit, ops[0]);
+}
+
+void encodeImul(AssemblerInfo& ai, Encoding& enc, const std::vector<Operand>& ops)
+{
+	if (ops.size() == 1)
+		return encodeUnary(ai, enc, "imul", 5, ops);
+
+	if (ops.size() == 2 && isReg(ops[0]) && isRM(ops[1]))
+	{
+		encodeModRM(ai, enc, getOpSize(ai, ops), { 0x0F, 0xAF }, &ops[0].reg, 0, ops[1]);
+		return;
+	}
+
+	// imul reg, imm is short for imul reg, reg, imm
+	const Operand* pSrc = ops.size() == 2 ? &ops[0] : &ops[1];
+	auto& imm = ops.back();
+	if (ops.size() > 3 || !isReg(ops[0]) || !isRM(*pSrc) || !isImm(imm))
+		throwInvalidOperands(ai, "imul");
+
+	int size = getOpSize(ai, { ops[0], *pSrc });
+	if (size == 1)
+		throwInvalidOperands(ai, "imul");
+	if (imm.symbol.empty() && fitsInt8(imm.value))
+	{
+		encodeModRM(ai, enc, size, { 0x6B }, &ops[0].reg, 0, *pSrc);
+		emitImm(ai, enc, imm, 1);
+	}
+	else
+	{
+		encodeModRM(ai, enc, size, { 0x69 }, &ops[0].reg, 0, *pSrc);
+		emitImm(ai, enc, imm, size == 2 ? 2 : 4, size == 8);
+	}
+}
+
+// rol, ror, rcl, rcr, shl, sal, shr, sar
+void encodeShift(AssemblerInfo& ai, Encoding& enc, const std::string& mnemonic, int digit, const std::vector<Operand>& ops)
+{
+	expectOperands(ai, mnemonic, ops, 2);
+	if (!isRM(ops[0]))
+		throwInvalidOperands(ai, mnemonic);
+	int size = ops[0].size;
+	if (size == 0)
+		THROW_ASSEMBLER_ERROR(ai.line, "Operation size not specified!");
+	uint8_t sizeBit = size == 1 ? 0 : 1;
+
+	if (isReg(ops[1]) && ops[1].reg.num == 1 && ops[1].size == 1)
+		encodeModRM(ai, enc, size, { (uint8_t)(0xD2 + sizeBit) }, nullptr, digit, ops[0]);
+	else if (isImm(ops[1]) && ops[1].symbol.empty() && ops[1].value == 1)
+		encodeModRM(ai, enc, size, { (uint8_t)(0xD0 + sizeBit) }, nullptr, digit, ops[0]);
+	else if (isImm(ops[1]))
+	{
+		encodeModRM(ai, enc, size, { (uint8_t)(0xC0 + sizeBit) }, nullptr, digit, ops[0]);
+		emitImm(ai, enc, ops[1], 1);
+	}
+	else
+		throwInvalidOperands(ai, mnemonic);
+}
+
+void encodeTest(AssemblerInfo& ai, Encoding& enc, const std::vector<Operand>& ops)
+{
+	expectOperands(ai, "test", ops, 2);
+	int size = getOpSize(ai, ops);
+	if (isRM(ops[0]) && isReg(ops[1]))
+		encodeModRM(ai, enc, size, { (uint8_t)(size == 1 ? 0x84 : 0x85) }, &ops[1].reg, 0, ops[0]);
+	else if (isReg(ops[0]) && isMem(ops[1]))
+		encodeModRM(ai, enc, size, { (uint8_t)(size == 1 ? 0x84 : 0x85) }, &ops[0].reg, 0, ops[1]);
+	else if (isReg(ops[0]) && ops[0].reg.num == 0 && isImm(ops[1]))
+	{
+		encodeOpcodeReg(ai, enc, size, size == 1 ? 0xA8 : 0xA9, ops[0].reg);
+		emitImm(ai, enc, ops[1], std::min(size, 4), size == 8);
+	}
+	else if (isRM(ops[0]) && isImm(ops[1]))
+	{
+		encodeModRM(ai, enc, size, { (uint8_t)(size == 1 ? 0xF6 : 0xF7) }, nullptr, 0, ops[0]);
+		emitImm(ai, enc, ops[1], std::min(size, 4), size == 8);
+	}
+	else
+		throwInvalidOperands(ai, "test");
+}
+
+void encodePushPop(AssemblerInfo& ai, Encoding& enc, const std::string& mnemonic, const std::vector<Operand>& ops)
+{
+	expectOperands(ai, mnemonic, ops, 1);
+	bool isPush = mnemonic == "push";
+	auto& op = ops[0];
+	if (isReg(op) && op.size == 8)
+		encodeOpcodeReg(ai, enc, 4, isPush ? 0x50 : 0x58, op.reg);
+	else if (isMem(op) && (op.size == 0 || op.size == 8))
+		encodeModRM(ai, enc, 4, { (uint8_t)(isPush ? 0xFF : 0x8F) }, nullptr, isPush ? 6 : 0, op);
+	else if (isPush && isImm(op) && op.symbol.empty() && fitsInt8(op.value))
+	{
+		enc.bytes.push_back(0x6A);
+		emitImm(ai, enc, op, 1);
+	}
+	else if (isPush && isImm(op))
+	{
+		enc.bytes.push_back(0x68);
+		emitImm(ai, enc, op, 4, true);
+	}
+	else
+		throwInvalidOperands(ai, mnemonic);
+}
+
+// movups, movaps, movdqu
+void encodeSseMove(AssemblerInfo& ai, Encoding& enc, const std::string& mnemonic, const std::vector<Operand>& ops)
+{
+	expectOperands(ai, mnemonic, ops, 2);
+	uint8_t prefix = mnemonic == "movdqu" ? 0xF3 : 0;
+	uint8_t load = mnemonic == "movups" ? 0x10 : (mnemonic == "movaps" ? 0x28 : 0x6F);
+	uint8_t store = mnemonic == "movups" ? 0x11 : (mnemonic == "movaps" ? 0x29 : 0x7F);
+	if (isXmm(ops[0]) && (isXmm(ops[1]) || isMem(ops[1])))
+		encodeModRM(ai, enc, 0, { 0x0F, load }, &ops[0].reg, 0, ops[1], prefix);
+	else if (isMem(ops[0]) && isXmm(ops[1]))
+		encodeModRM(ai, enc, 0, { 0x0F, store }, &ops[1].reg, 0, ops[0], prefix);
+	else
+		throwInvalidOperands(ai, mnemonic);
+}
+
+// Instructions without operands
+static const std::unordered_map<std::string, std::vector<uint8_t>> fixedEncodings = {
+	{ "ret", { 0xC3 } }, { "leave", { 0xC9 } }, { "nop", { 0x90 } }, { "hlt", { 0xF4 } }, { "int3", { 0xCC } },
+	{ "syscall", { 0x0F, 0x05 } }, { "rdtsc", { 0x0F, 0x31 } }, { "cpuid", { 0x0F, 0xA2 } }, { "ud2", { 0x0F, 0x0B } },
+	{ "pause", { 0xF3, 0x90 } }, { "cld", { 0xFC } }, { "std", { 0xFD } },
+	{ "cbw", { 0x66, 0x98 } }, { "cwde", { 0x98 } }, { "cdqe", { 0x48, 0x98 } },
+	{ "cwd", { 0x66, 0x99 } }, { "cdq", { 0x99 } }, { "cqo", { 0x48, 0x99 } },
+	{ "movsb", { 0xA4 } }, { "movsw", { 0x66, 0xA5 } }, { "movsd", { 0xA5 } }, { "movsq", { 0x48, 0xA5 } },
+	{ "stosb", { 0xAA } }, { "stosw", { 0x66, 0xAB } }, { "stosd", { 0xAB } }, { "stosq", { 0x48, 0xAB } },
+	{ "lodsb", { 0xAC } }, { "lodsq", { 0x48, 0xAD } }, { "cmpsb", { 0xA6 } }, { "scasb", { 0xAE } },
+};
+
+static const std::unordered_map<std::string, int> arithmeticDigits = {
+	{ "add", 0 }, { "or", 1 }, { "adc", 2 }, { "sbb", 3 }, { "and", 4 }, { "sub", 5 }, { "xor", 6 }, { "cmp", 7 },
+};
+
+static const std::unordered_map<std::string, int> unaryDigits = {
+	{ "inc", 0 }, { "dec", 1 }, { "not", 2 }, { "neg", 3 }, { "mul", 4 }, { "div", 6 }, { "idiv", 7 },
+};
+
+static const std::unordered_map<std::string, int> shiftDigits = {
+	{ "rol", 0 }, { "ror", 1 }, { "rcl", 2 }, { "rcr", 3 }, { "shl", 4 }, { "sal", 4 }, { "shr", 5 }, { "sar", 7 },
+};
+
+// Returns the condition code if the mnemonic is the prefix followed by a condition (e.g. 'jne' -> 5)
+int getCondCode(const std::string& mnemonic, const std::string& prefix)
+{
+	if (mnemonic.compare(0, prefix.size(), prefix) != 0)
+		return -1;
+	auto it = condCodes.find(mnemonic.substr(prefix.size()));
+	return it == condCodes.end() ? -1 : it->second;
+}
+
+Encoding encodeInstr(AssemblerInfo& ai, const std::string& mnemonic, const std::vector<Operand>& ops)
+{
+	Encoding enc;
+
+	auto itFixed = fixedEncodings.find(mnemonic);
+	if (itFixed != fixedEncodings.end() && ops.empty())
+	{
+		enc.bytes = itFixed->second;
+		return enc;
+	}
+
+	auto itArith = arithmeticDigits.find(mnemonic);
+	auto itUnary = unaryDigits.find(mnemonic);
+	auto itShift = shiftDigits.find(mnemonic);
+	int cond = -1;
+
+	if (itArith != arithmeticDigits.end())
+		encodeArithmetic(ai, enc, mnemonic, itArith->second, ops);
+	else if (itUnary != unaryDigits.end())
+		encodeUnary(ai, enc, mnemonic, itUnary->second, ops);
+	else if (itShift != shiftDigits.end())
+		encodeShift(ai, enc, mnemonic, itShift->second, ops);
+	else if (mnemonic == "mov")
+		encodeMov(ai, enc, ops);
+	else if (mnemonic == "movzx" || mnemonic == "movsx" || mnemonic == "movsxd")
+		encodeMovExtend(ai, enc, mnemonic, ops);
+	else if (mnemonic == "lea")
+	{
+		expectOperands(ai, mnemonic, ops, 2);
+		if (!isReg(ops[0]) || !isMem(ops[1]) || ops[0].size == 1)
+			throwInvalidOperands(ai, mnemonic);
+		encodeModRM(ai, enc, ops[0].size, { 0x8D }, &ops[0].reg, 0, ops[1]);
+	}
+	else if (mnemonic == "imul")
+		encodeImul(ai, enc, ops);
+	else if (mnemonic == "test")
+		encodeTest(ai, enc, ops);
+	else if (mnemonic == "xchg")
+	{
+		expectOperands(ai, mnemonic, ops, 2);
+		int size = getOpSize(ai, ops);
+		if (isRM(ops[0]) && isReg(ops[1]))
+			encodeModRM(ai, enc, size, { (uint8_t)(size == 1 ? 0x86 : 0x87) }, &ops[1].reg, 0, ops[0]);
+		else if (isMem(ops[0]) == false && isReg(ops[0]) && isMem(ops[1]))
+			encodeModRM(ai, enc, size, { (uint8_t)(size == 1 ? 0x86 : 0x87) }, &ops[0].reg, 0, ops[1]);
+		else
+			throwInvalidOperands(ai, mnemonic);
+	}
+	else if (mnemonic == "push" || mnemonic == "pop")
+		encodePushPop(ai, enc, mnemonic, ops);
+	else if ((cond = getCondCode(mnemonic, "cmov")) != -1)
+	{
+		expectOperands(ai, mnemonic, ops, 2);
+		if (!isReg(ops[0]) || !isRM(ops[1]) || ops[0].size == 1)
+			throwInvalidOperands(ai, mnemonic);
+		encodeModRM(ai, enc, getOpSize(ai, ops), { 0x0F, (uint8_t)(0x40 + cond) }, &ops[0].reg, 0, ops[1]);
+	}
+	else if ((cond = getCondCode(mnemonic, "set")) != -1)
+	{
+		expectOperands(ai, mnemonic, ops, 1);
+		if (!isRM(ops[0]) || (ops[0].size != 0 && ops[0].size != 1))
+			throwInvalidOperands(ai, mnemonic);
+		encodeModRM(ai, enc, 1, { 0x0F, (uint8_t)(0x90 + cond) }, nullptr, 0, ops[0]);
+	}
+	else if ((mnemonic == "jmp" || mnemonic == "call") && ops.size() == 1 && isRM(ops[0]))
+	{
+		// Indirect jumps/calls always use 64 bit addresses
+		if (ops[0].size != 0 && ops[0].size != 8)
+			throwInvalidOperands(ai, mnemonic);
+		encodeModRM(ai, enc, 4, { 0xFF }, nullptr, mnemonic == "jmp" ? 4 : 2, ops[0]);
+	}
+	else if (mnemonic == "movups" || mnemonic == "movaps" || mnemonic == "movdqu")
+		encodeSseMove(ai, enc, mnemonic, ops);
+	else if (mnemonic == "ret" && ops.size() == 1 && isImm(ops[0]))
+	{
+		enc.bytes.push_back(0xC2);
+		emitImm(ai, enc, ops[0], 2);
+	}
+	else if (mnemonic == "int" && ops.size() == 1 && isImm(ops[0]))
+	{
+		enc.bytes.push_back(0xCD);
+		emitImm(ai, enc, ops[0], 1);
+	}
+	else
+		THROW_ASSEMBLER_ERROR(ai.line, "Unsupported instruction '" + mnemonic + "'!");
+
+	// rip-relative displacements are relative to the end of the instruction
+	for (auto& fixup : enc.fixups)
+		if (fixup.type == RelocType::PC32)
+			fixup.addend -= enc.bytes.size() - fixup.offset;
+
+	return enc;
+}
+
+AsmSection& currSection(AssemblerInfo& ai)
+{
+	return ai.sections[ai.currSection];
+}
+
+void selectSection(AssemblerInfo& ai, const std::string& args)
+{
+	std::vector<std::string> parts;
+	for (uint64_t begin = 0, end; begin < args.size(); begin = end + 1)
+	{
+		end = args.find(' ', begin);
+		if (end == std::string::npos)
+			end = args.size();
+		if (end > begin)
+			parts.push_back(args.substr(begin, end - begin));
+	}
+	if (parts.empty())
+		THROW_ASSEMBLER_ERROR(ai.line, "Missing section name!");
+
+	auto& name = parts[0];
+	for (uint64_t i = 0; i < ai.sections.size(); ++i)
+	{
+		if (ai.sections[i].name == name)
+		{
+			ai.currSection = i;
+			return;
+		}
+	}
+
+	// Same defaults as nasm
+	AsmSection section;
+	section.name = name;
+	section.isExecutable = name.find(".text") == 0;
+	section.isNoBits = name.find(".bss") == 0;
+	section.isWritable = name.find(".data") == 0 || section.isNoBits;
+	section.align = section.isExecutable ? 16 : 4;
+	for (uint64_t i = 1; i < parts.size(); ++i)
+	{
+		auto attr = toLower(parts[i]);
+		int64_t align = 0;
+		if (attr.find("align=") == 0 && parseNumber(attr.substr(6), align) && align > 0)
+			section.align = align;
+		else if (attr == "exec" || attr == "noexec")
+			section.isExecutable = attr == "exec";
+		else if (attr == "write" || attr == "nowrite")
+			section.isWritable = attr == "write";
+		else if (attr == "nobits" || attr == "progbits")
+			section.isNoBits = attr == "nobits";
+		else if (attr != "alloc")
+			THROW_ASSEMBLER_ERROR(ai.line, "Unsupported section attribute '" + parts[i] + "'!");
+	}
+	ai.sections.push_back(section);
+	ai.currSection = ai.sections.size() - 1;
+}
+
+void addItem(AssemblerInfo& ai, AsmItem item)
+{
+	item.line = ai.line;
+	if (currSection(ai).isNoBits && (item.type == AsmItem::Type::Bytes || item.type == AsmItem::Type::Branch))
+		THROW_ASSEMBLER_ERROR(ai.line, "Section '" + currSection(ai).name + "' cannot contain code/data!");
+	currSection(ai).items.push_back(item);
+}
+
+// db, dw, dd, dq
+void parseData(AssemblerInfo& ai, int size, const std::string& args)
+{
+	AsmItem item;
+	for (auto& value : splitArgs(args))
+	{
+		if (value.size() >= 2 && (value[0] == '"' || value[0] == '\'' || value[0] == '`') && value.back() == value[0])
+		{
+			if (size != 1)
+				THROW_ASSEMBLER_ERROR(ai.line, "Strings are only supported with 'db'!");
+			for (uint64_t i = 1; i + 1 < value.size(); ++i)
+				item.enc.bytes.push_back(value[i]);
+			continue;
+		}
+
+		auto op = parseOperand(ai, value);
+		if (!isImm(op))
+			THROW_ASSEMBLER_ERROR(ai.line, "Invalid data value '" + value + "'!");
+		emitImm(ai, item.enc, op, size);
+	}
+	addItem(ai, item);
+}
+
+void parseLine(AssemblerInfo& ai, std::string text)
+{
+	// Strip the comment
+	char quote = 0;
+	for (uint64_t i = 0; i < text.size(); ++i)
+	{
+		if (quote)
+		{
+			if (text[i] == quote)
+				quote = 0;
+		}
+		else if (text[i] == '"' || text[i] == '\'' || text[i] == '`')
+			quote = text[i];
+		else if (text[i] == ';')
+		{
+			text.resize(i);
+			break;
+		}
+	}
+	text = trim(text);
+	if (text.empty())
+		return;
+
+	// Label definition
+	uint64_t nameEnd = 0;
+	while (nameEnd < text.size() && isIdentChar(text[nameEnd]))
+		++nameEnd;
+	if (nameEnd > 0 && nameEnd < text.size() && text[nameEnd] == ':')
+	{
+		auto name = text.substr(0, nameEnd);
+		if (name[0] != '.')
+			ai.lastLabel = name;
+		AsmItem item;
+		item.type = AsmItem::Type::Label;
+		item.name = resolveLabel(ai, name);
+		addItem(ai, item);
+		text = trim(text.substr(nameEnd + 1));
+		if (text.empty())
+			return;
+	}
+
+	auto space = text.find_first_of(" \t");
+	auto word = toLower(text.substr(0, space));
+	auto args = space == std::string::npos ? "" : trim(text.substr(space));
+
+	if (word == "section" || word == "segment")
+		return selectSection(ai, args);
+	if (word == "global" || word == "extern")
+	{
+		for (auto& name : splitArgs(args))
+		{
+			auto symbol = resolveLabel(ai, name.substr(0, name.find(':')));
+			(word == "global" ? ai.globals : ai.externs).insert(symbol);
+		}
+		return;
+	}
+	if (word == "bits" || word == "default")
+	{
+		if (word == "bits" && args != "64")
+			THROW_ASSEMBLER_ERROR(ai.line, "Only 64 bit code is supported!");
+		return;
+	}
+
+	static const std::map<std::string, int> dataSizes = { { "db", 1 }, { "dw", 2 }, { "dd", 4 }, { "dq", 8 } };
+	static const std::map<std::string, int> reserveSizes = { { "resb", 1 }, { "resw", 2 }, { "resd", 4 }, { "resq", 8 } };
+	auto itData = dataSizes.find(word);
+	if (itData != dataSizes.end())
+		return parseData(ai, itData->second, args);
+	auto itReserve = reserveSizes.find(word);
+	if (itReserve != reserveSizes.end() || word == "align")
+	{
+		auto op = parseOperand(ai, args);
+		if (!isImm(op) || !op.symbol.empty() || op.value < 0 || (word == "align" && (op.value & (op.value - 1))))
+			THROW_ASSEMBLER_ERROR(ai.line, "Invalid argument for '" + word + "'!");
+		AsmItem item;
+		item.type = word == "align" ? AsmItem::Type::Align : AsmItem::Type::Reserve;
+		item.size = word == "align" ? op.value : op.value * itReserve->second;
+		ai.sections[ai.currSection].items.push_back(item);
+		return;
+	}
+
+	// Instruction prefixes
+	std::vector<uint8_t> prefixes;
+	static const std::map<std::string, uint8_t> prefixBytes = {
+		{ "rep", 0xF3 }, { "repe", 0xF3 }, { "repz", 0xF3 }, { "repne", 0xF2 }, { "repnz", 0xF2 }, { "lock", 0xF0 },
+	};
+	for (auto it = prefixBytes.find(word); it != prefixBytes.end(); it = prefixBytes.find(word))
+	{
+		prefixes.push_back(it->second);
+		space = args.find_first_of(" \t");
+		word = toLower(args.substr(0, space));
+		args = space == std::string::npos ? "" : trim(args.substr(space));
+	}
+
+	std::vector<Operand> ops;
+	for (auto& operand : splitArgs(args))
+		ops.push_back(parseOperand(ai, operand));
+
+	int cond = getCondCode(word, "j");
+	bool isBranch = (word == "jmp" || word == "call" || cond != -1) && ops.size() == 1 && isImm(ops[0]);
+	if (isBranch && prefixes.empty())
+	{
+		if (ops[0].value != 0 || ops[0].symbol.empty())
+			THROW_ASSEMBLER_ERROR(ai.line, "Branches to absolute addresses are not supported!");
+		AsmItem item;
+		item.type = AsmItem::Type::Branch;
+		item.name = ops[0].symbol;
+		item.cond = cond;
+		item.isCall = word == "call";
+		item.isLong = item.isCall;
+		return addItem(ai, item);
+	}
+
+	AsmItem item;
+	item.enc = encodeInstr(ai, word, ops);
+	item.enc.bytes.insert(item.enc.bytes.begin(), prefixes.begin(), prefixes.end());
+	for (auto& fixup : item.enc.fixups)
+		fixup.offset += prefixes.size();
+	addItem(ai, item);
+}
+
+uint64_t getBranchSize(const AsmItem& item)
+{
+	if (!item.isLong)
+		return 2;
+	return item.cond == -1 ? 5 : 6;
+}
+
+// Assigns offsets to all items, returns the label -> (section, offset) map
+std::map<std::string, std::pair<int, uint64_t>> layoutSections(AssemblerInfo& ai)
+{
+	std::map<std::string, std::pair<int, uint64_t>> labels;
+	for (uint64_t s = 0; s < ai.sections.size(); ++s)
+	{
+		uint64_t offset = 0;
+		for (auto& item : ai.sections[s].items)
+		{
+			item.offset = offset;
+			switch (item.type)
+			{
+			case AsmItem::Type::Bytes: offset += item.enc.bytes.size(); break;
+			case AsmItem::Type::Branch: offset += getBranchSize(item); break;
+			case AsmItem::Type::Reserve: offset += item.size; break;
+			case AsmItem::Type::Align: offset = (offset + item.size - 1) / item.size * item.size; break;
+			case AsmItem::Type::Label:
+				if (!labels.insert({ item.name, { (int)s, offset } }).second)
+					THROW_ASSEMBLER_ERROR(item.line, "Label '" + item.name + "' redefined!");
+				break;
+			}
+		}
+	}
+	return labels;
+}
+
+ObjectFile assembleX86(const std::string& code)
+{
+	AssemblerInfo ai;
+	selectSection(ai, ".text");
+
+	for (uint64_t begin = 0; begin < code.size();)
+	{
+		auto end = code.find('\n', begin);
+		if (end == std::string::npos)
+			end = code.size();
+		++ai.line;
+		parseLine(ai, code.substr(begin, end - begin));
+		begin = end + 1;
+	}
+
+	// Start with short jumps and lengthen the ones whose target is out of reach until nothing changes anymore
+	auto labels = layoutSections(ai);
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+		for (uint64_t s = 0; s < ai.sections.size(); ++s)
+		{
+			for (auto& item : ai.sections[s].items)
+			{
+				if (item.type != AsmItem::Type::Branch || item.isLong)
+					continue;
+				auto it = labels.find(item.name);
+				if (it != labels.end() && it->second.first == (int)s && fitsInt8(it->second.second - (item.offset + 2)))
+					continue;
+				item.isLong = true;
+				changed = true;
+			}
+		}
+		if (changed)
+			labels = layoutSections(ai);
+	}
+
+	ObjectFile obj;
+	std::map<std::string, int> symbolIDs;
+	for (uint64_t s = 0; s < ai.sections.size(); ++s)
+	{
+		for (auto& item : ai.sections[s].items)
+		{
+			if (item.type != AsmItem::Type::Label)
+				continue;
+			symbolIDs[item.name] = obj.symbols.size();
+			obj.symbols.push_back({ item.name, (int)s, item.offset, ai.globals.count(item.name) > 0 });
+		}
+	}
+	for (auto& name : ai.externs)
+	{
+		if (symbolIDs.count(name))
+			continue;
+		symbolIDs[name] = obj.symbols.size();
+		obj.symbols.push_back({ name, -1, 0, true });
+	}
+	for (auto& name : ai.globals)
+		if (!symbolIDs.count(name))
+			THROW_ASSEMBLER_ERROR(0, "Global symbol '" + name + "' is never defined!");
+
+	auto getSymbolID = [&](const std::string& name, int line)
+	{
+		auto it = symbolIDs.find(name);
+		if (it == symbolIDs.end())
+			THROW_ASSEMBLER_ERROR(line, "Symbol '" + name + "' is not defined!");
+		return it->second;
+	};
+
+	for (uint64_t s = 0; s < ai.sections.size(); ++s)
+	{
+		auto& asmSection = ai.sections[s];
+		ObjSection section;
+		section.name = asmSection.name;
+		section.align = asmSection.align;
+		section.isWritable = asmSection.isWritable;
+		section.isExecutable = asmSection.isExecutable;
+		section.isNoBits = asmSection.isNoBits;
+
+		auto& data = section.data;
+		for (auto& item : asmSection.items)
+		{
+			switch (item.type)
+			{
+			case AsmItem::Type::Bytes:
+				for (auto& fixup : item.enc.fixups)
+					section.relocs.push_back({ item.offset + fixup.offset, fixup.type, getSymbolID(fixup.symbol, item.line), fixup.addend });
+				data.insert(data.end(), item.enc.bytes.begin(), item.enc.bytes.end());
+				break;
+			case AsmItem::Type::Branch:
+			{
+				Encoding enc;
+				if (!item.isLong)
+					enc.bytes = { (uint8_t)(item.cond == -1 ? 0xEB : 0x70 + item.cond) };
+				else if (item.cond == -1)
+					enc.bytes = { (uint8_t)(item.isCall ? 0xE8 : 0xE9) };
+				else
+					enc.bytes = { 0x0F, (uint8_t)(0x80 + item.cond) };
+
+				uint64_t end = item.offset + getBranchSize(item);
+				auto it = labels.find(item.name);
+				if (it != labels.end() && it->second.first == (int)s)
+					emitInt(enc, it->second.second - end, item.isLong ? 4 : 1);
+				else
+				{
+					section.relocs.push_back({ item.offset + enc.bytes.size(), item.isCall ? RelocType::PLT32 : RelocType::PC32, getSymbolID(item.name, item.line), -4 });
+					emitInt(enc, 0, 4);
+				}
+				data.insert(data.end(), enc.bytes.begin(), enc.bytes.end());
+			}
+				break;
+			case AsmItem::Type::Reserve:
+			case AsmItem::Type::Align:
+			{
+				uint64_t size = item.type == AsmItem::Type::Reserve ? item.size : (item.size - item.offset % item.size) % item.size;
+				if (item.type == AsmItem::Type::Align)
+					section.align = std::max(section.align, item.size);
+				if (!section.isNoBits)
+					data.insert(data.end(), size, section.isExecutable && item.type == AsmItem::Type::Align ? 0x90 : 0);
+				section.size += size;
+			}
+				break;
+			case AsmItem::Type::Label:
+				break;
+			}
+		}
+		if (!section.isNoBits)
+			section.size = data.size();
+		obj.sections.push_back(section);
+	}
+
+	return obj;
+}
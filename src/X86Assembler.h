@@ -0,0 +1,10 @@
+#pragma once
+
+#include <string>
+
+#include "ObjectFile.h"
+
+// Built-in assembler for the NASM code generated by genAsm, including the common forms used in inline assembly.
+// Jumps are relaxed to their short form when the target is close enough, like nasm does by default.
+// Throws an AssemblerError for instructions/directives it does not support.
+ObjectFile assembleX86(const std::string& code);